@@ -102,6 +102,43 @@ s21_decode_float_sensor (const unsigned char *payload)
    return (float) s21_decode_int_sensor (payload) * 0.1;
 }
 
+// Convert between Daikin mode characters and Faikin mode enums
+static inline unsigned char
+s21_encode_mode (int mode)
+{
+   switch (mode)
+   {
+   case FAIKIN_MODE_COOL:
+      return AC_MODE_COOL + '0';
+   case FAIKIN_MODE_HEAT:
+      return AC_MODE_HEAT + '0';
+   case FAIKIN_MODE_DRY:
+      return AC_MODE_DRY + '0';
+   case FAIKIN_MODE_FAN:
+      return AC_MODE_FAN + '0';
+   default:
+      return AC_MODE_AUTO + '0';
+   }
+}
+
+static inline int
+s21_decode_mode (unsigned char v)
+{
+   switch (v - '0')
+   {
+   case AC_MODE_COOL:
+      return FAIKIN_MODE_COOL;
+   case AC_MODE_HEAT:
+      return FAIKIN_MODE_HEAT;
+   case AC_MODE_DRY:
+      return FAIKIN_MODE_DRY;
+   case AC_MODE_FAN:
+      return FAIKIN_MODE_FAN;
+   default:
+      return FAIKIN_MODE_AUTO;
+   }
+}
+
 // Convert between Daikin and Faikin fan speed enums
 static inline unsigned char
 s21_encode_fan (int speed)
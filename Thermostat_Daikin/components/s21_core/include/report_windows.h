@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Subscriptions with changes pending at once, and changes pending per subscription
+#define REPORT_MAX_SUBSCRIPTIONS 8
+#define REPORT_MAX_PENDING       16
+
+// Add() results
+#define REPORT_QUEUED    0 // Pending for the subscription; its window may have just opened
+#define REPORT_COALESCED 1 // Already pending for the subscription
+#define REPORT_FULL      2 // No room; nothing was queued
+
+// One attribute, as a Matter concrete attribute path
+typedef struct {
+    uint16_t endpoint_id;
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+} report_path_t;
+
+static inline bool report_path_equal(const report_path_t *a, const report_path_t *b) {
+    return a->endpoint_id == b->endpoint_id && a->cluster_id == b->cluster_id && a->attribute_id == b->attribute_id;
+}
+
+/**
+ * Report windows, one per subscription.
+ *
+ * A subscription's window opens with the first change pending for it and closes after its
+ * own min-interval, clamped to [min_window_ms, max_window_ms]. Its pending changes are then
+ * reported together. Windows of different subscriptions open and close independently. The
+ * class has no platform dependencies: the caller supplies the time, owns the timer, and
+ * decides at close whether the subscription still wants each path.
+ */
+class ReportWindows {
+public:
+    ReportWindows(uint32_t min_window_ms, uint32_t max_window_ms);
+
+    void Clear();
+
+    // Queue a change for a subscription. Returns REPORT_QUEUED, REPORT_COALESCED or REPORT_FULL.
+    int Add(uint32_t subscription, uint16_t min_interval_s, const report_path_t &path, int64_t now_us);
+
+    // Earliest close of any open window, or -1 if none is open
+    int64_t NextDeadline() const;
+
+    // Close the earliest window due by now_us. Copies its subscription and pending paths out
+    // (out holds REPORT_MAX_PENDING) and returns the number of paths, or -1 if none is due.
+    int TakeDue(int64_t now_us, uint32_t *subscription, report_path_t *out);
+
+    // Close one subscription's window now, due or not. Returns the number of paths copied.
+    int Take(uint32_t subscription, report_path_t *out);
+
+    // A path was reported. Reporting wakes every subscription covering it, so it is no longer
+    // pending anywhere; a window left empty closes.
+    void Reported(const report_path_t &path);
+
+    int OpenWindows() const;
+
+private:
+    struct Window {
+        uint32_t subscription;
+        int64_t deadline_us; // -1 while the slot is free
+        uint8_t count;
+        report_path_t pending[REPORT_MAX_PENDING];
+    };
+
+    Window *Find(uint32_t subscription);
+    int Close(Window *w, report_path_t *out);
+
+    Window m_windows[REPORT_MAX_SUBSCRIPTIONS];
+    uint32_t m_min_window_ms;
+    uint32_t m_max_window_ms;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include "s21_port.h"
+#include "s21_driver.h"
+
+// Driver configuration and state that outlive a reboot, in one versioned blob under a single
+// storage key. It is read once at boot. Changes go to a copy in RAM and s21_config_service()
+// writes them back once they have settled, so a burst of changes costs one flash write and a
+// change that is undone before then costs none.
+//
+// Fields are only ever appended. A blob shorter than the current layout gets defaults for the
+// rest; a longer one of the same version keeps its tail, so firmware rolled back after an OTA
+// does not drop what the newer image stored. S21_CONFIG_VERSION changes only when an existing
+// field changes meaning, with a migration step in s21_config.cpp from the version before.
+
+#define S21_CONFIG_VERSION 1
+#define S21_STORAGE_KEY_CONFIG "config"
+// Largest blob kept, a stored tail from newer firmware included
+#define S21_CONFIG_MAX_LEN 128
+
+// A change is written once nothing else has changed for S21_CONFIG_QUIET_MS, and no later than
+// S21_CONFIG_MAX_DELAY_MS after it was made
+#define S21_CONFIG_QUIET_MS 5000
+#define S21_CONFIG_MAX_DELAY_MS 60000
+// Bit period drift, in 1/16 us, that is worth a write
+#define S21_CONFIG_BIT_Q4_SLACK 4
+
+// Fields of s21_config_t that hold a stored value rather than their default
+#define S21_CONFIG_HAS_CAPS       (1 << 0)
+#define S21_CONFIG_HAS_BIT_PERIOD (1 << 1)
+#define S21_CONFIG_HAS_STATE      (1 << 2)
+#define S21_CONFIG_HAS_FILTER     (1 << 3)
+
+typedef struct {
+    uint8_t version;            // S21_CONFIG_VERSION
+    uint8_t reserved;
+    uint16_t length;            // Bytes stored, this header included
+    uint32_t flags;             // S21_CONFIG_HAS_*
+    s21_caps_t caps;            // Capability map from discovery
+    uint32_t poll_interval_ms;  // Idle time between poll cycles, 0 for the board default
+    uint32_t bit_q4;            // Bit-bang receive bit period in 1/16 us
+    // Last state of the unit, shown until the first status read after a reboot. Mode and fan
+    // are kept as the unit sends them, which do not move with the FAIKIN_* numbering.
+    uint8_t power;
+    uint8_t mode;               // AC_MODE_* character, as in G1
+    uint8_t fan_speed;          // AC_FAN_* character, as in G1
+    uint8_t reserved2;
+    int16_t target_temp;        // 0.01 C
+    uint16_t filter_base_hours; // Unit filter hours at the last Matter ResetCondition
+} s21_config_t;
+
+// Write-back counters since boot
+typedef struct {
+    uint32_t changes;           // Setter calls that changed the cached copy
+    uint32_t writes;            // Blobs written to storage
+    uint32_t write_errors;
+    bool dirty;                 // Changes not yet written
+} s21_config_stats_t;
+
+// Read the blob, migrating an older version in place. On the first boot with the blob, the
+// separate capability key used before it is folded in and erased. Later calls do nothing.
+// Returns ESP_OK with defaults if nothing was stored.
+esp_err_t s21_config_load(void);
+// Snapshot of the cached copy. Any task.
+s21_config_t s21_config_get(void);
+
+// Change the cached copy. Any task; the write happens in s21_config_service().
+void s21_config_set_caps(const s21_caps_t *caps); // NULL to forget the map
+void s21_config_set_poll_interval(uint32_t ms);
+void s21_config_set_bit_q4(uint32_t bit_q4);
+void s21_config_set_state(const ac_state_t *state);
+void s21_config_set_filter_base(uint16_t hours);
+
+// Write pending changes once they have settled. Call regularly, from one task only.
+void s21_config_service(int64_t now_us);
+// Write pending changes now. Same task as s21_config_service().
+esp_err_t s21_config_flush(void);
+// Drop everything back to defaults and erase the stored blob
+esp_err_t s21_config_reset(void);
+s21_config_stats_t s21_config_get_stats(void);
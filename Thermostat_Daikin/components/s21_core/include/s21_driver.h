@@ -0,0 +1,396 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "s21_port.h"
+#include "daikin_s21.h"
+#include "s21_parser.h"
+#include "s21_trace.h"
+
+// Represents the state of the AC
+typedef struct {
+    bool power;
+    uint8_t mode;        // Uses FAIKIN_MODE_* enums
+    float target_temp;   // Celsius
+    float current_temp;  // Celsius (Room temp)
+    float outside_temp;  // Celsius
+    uint8_t fan_speed;   // Uses FAIKIN_FAN_* enums
+    int16_t compressor_hz; // Compressor frequency, -1 unless the unit reports it (Rd)
+} ac_state_t;
+
+// Registers the driver knows how to query. Values are bit positions in the capability map.
+typedef enum {
+    S21_REG_STATUS = 0,   // F1 -> G1: power, mode, setpoint, fan
+    S21_REG_FEATURES,     // F2 -> G2: feature flags
+    S21_REG_SWING,        // F5 -> G5: louvre swing
+    S21_REG_SPECIAL,      // F6 -> G6: powerful/comfort/quiet
+    S21_REG_ECONO,        // F7 -> G7: econo
+    S21_REG_PROTOCOL,     // F8 -> G8: protocol version
+    S21_REG_TEMPS,        // F9 -> G9: combined temperatures
+    S21_REG_FEATURES2,    // FK -> GK: more feature flags
+    S21_REG_ROOM_TEMP,    // RH -> SH: room temperature
+    S21_REG_OUTSIDE_TEMP, // Ra -> Sa: outside temperature
+    S21_REG_COIL_TEMP,    // RI -> SI: indoor coil temperature
+    S21_REG_FAN_RPM,      // RL -> SL: indoor fan speed
+    S21_REG_COMPRESSOR,   // Rd -> Sd: compressor frequency
+    S21_REG_ERROR,        // RW -> SW: current error code
+    S21_REG_FILTER,       // RF -> SF: hours since filter cleaning
+    S21_REG_RUNTIME,      // RM -> SM: compressor run hours
+    S21_REG_COUNT
+} s21_reg_t;
+
+// Bump when the meaning of s21_caps_t bits changes, to force a fresh discovery
+#define S21_CAPS_VERSION 2
+
+// What the connected unit supports, cached in NVS after the first discovery
+typedef struct {
+    uint8_t version;        // S21_CAPS_VERSION
+    uint8_t protocol_major; // 2 for the two-character command set, 3 for v3
+    uint8_t v3;             // Unit answered the v3 version query
+    uint8_t reserved;
+    uint32_t regs;          // Bitmap of supported s21_reg_t
+} s21_caps_t;
+
+// Fields of s21_control_t to apply
+#define S21_CTRL_POWER (1 << 0)
+#define S21_CTRL_MODE  (1 << 1)
+#define S21_CTRL_TEMP  (1 << 2)
+#define S21_CTRL_FAN   (1 << 3)
+
+// A set of control changes, sent to the unit together as one D1 write
+typedef struct {
+    uint8_t fields;      // S21_CTRL_* mask of the fields below that are set
+    bool power;
+    uint8_t mode;        // FAIKIN_MODE_*
+    float target_temp;   // Celsius
+    uint8_t fan_speed;   // FAIKIN_FAN_*
+    uint16_t trace_id;   // s21_trace_begin() span to stamp, 0 if untraced
+} s21_control_t;
+
+// Demand limit, as a share of the unit's rated input. The unit does not accept caps below the
+// minimum; 100 means no cap.
+#define S21_DEMAND_MIN_PCT 30
+#define S21_DEMAND_MAX_PCT 100
+
+// Demand control, sent to the unit as one D7 write. Needs S21_REG_ECONO.
+typedef struct {
+    uint8_t limit_pct;   // S21_DEMAND_MIN_PCT to S21_DEMAND_MAX_PCT
+    bool econo;          // Econo mode, the unit's own fixed power saving
+} s21_demand_t;
+
+// Next limit on a ramp from the applied limit to the target, at most step_pct away
+static inline uint8_t s21_demand_ramp_step(uint8_t applied_pct, uint8_t target_pct, uint8_t step_pct) {
+    if (target_pct < applied_pct) {
+        return applied_pct - target_pct > step_pct ? applied_pct - step_pct : target_pct;
+    }
+    return target_pct - applied_pct > step_pct ? applied_pct + step_pct : target_pct;
+}
+
+// Filter hours after which the filter sign comes on
+#define S21_FILTER_LIFE_HOURS 2500
+
+// Maintenance data, read in idle bus time
+typedef struct {
+    char error_code[3];        // Unit error code such as "U4", empty when there is none
+    bool filter_sign;          // Filter needs cleaning: S21_FILTER_LIFE_HOURS used since the
+                               // last reset, counted from the config's filter_base_hours
+    uint16_t filter_hours;     // Unit's filter counter, since the filter was cleaned at the unit
+    bool filter_known;         // filter_hours has been read; the registers are read one at a time
+    uint16_t compressor_hours; // Compressor run hours
+} s21_maint_t;
+
+// What kind of fault a unit error code reports
+typedef enum {
+    S21_FAULT_NONE = 0,   // No error code
+    S21_FAULT_SENSOR,     // Thermistor or sensor: C*, H*, J*, P4
+    S21_FAULT_OVER_TEMP,  // High pressure or overheating: A5, E3, E5, F3, F6, L4
+    S21_FAULT_POWER,      // Supply voltage or inverter power: L*, P1, U2
+    S21_FAULT_OTHER,      // Anything else, communication errors included
+} s21_fault_class_t;
+
+// Classify a unit error code such as "E5"; "" is S21_FAULT_NONE
+s21_fault_class_t s21_fault_class(const char *code);
+
+// Hours used since the filter was last reset, given the unit's counter and the config's base.
+// A counter below the base was reset at the unit, so it counts from zero.
+static inline uint16_t s21_filter_used_hours(uint16_t filter_hours, uint16_t base_hours) {
+    return filter_hours >= base_hours ? filter_hours - base_hours : filter_hours;
+}
+
+// Base to keep for the unit's counter: zero once the counter is below it, as it was reset at
+// the unit. Until the counter has been read there is nothing to compare, so the base stands.
+static inline uint16_t s21_filter_base_check(const s21_maint_t *maint, uint16_t base_hours) {
+    return maint->filter_known && maint->filter_hours < base_hours ? 0 : base_hours;
+}
+
+// True while the unit is on and heating or cooling: its compressor runs, or on units without
+// Rd, the room is on the far side of the setpoint for the mode
+static inline bool s21_state_active(const ac_state_t *state) {
+    if (!state->power) return false;
+    if (state->compressor_hz >= 0) return state->compressor_hz > 0;
+    return (state->mode == FAIKIN_MODE_HEAT && state->current_temp < state->target_temp) ||
+           (state->mode == FAIKIN_MODE_COOL && state->current_temp > state->target_temp);
+}
+
+// Commands the driver task accepts from other tasks
+typedef enum {
+    S21_CMD_CONTROL = 0, // Apply an s21_control_t
+    S21_CMD_REFRESH,     // Read the unit status now instead of at the next poll
+    S21_CMD_DEMAND,      // Apply an s21_demand_t
+} s21_cmd_type_t;
+
+// Completion callback, called on the driver task once a command is done or has timed out
+typedef void (*s21_cmd_done_cb_t)(esp_err_t result, void *ctx);
+
+typedef struct {
+    s21_cmd_type_t type;
+    s21_control_t control; // For S21_CMD_CONTROL
+    s21_demand_t demand;   // For S21_CMD_DEMAND
+    bool urgent;           // Taken ahead of the commands already queued
+    int64_t deadline_us;   // s21_port_time_us() after which the command fails with ESP_ERR_TIMEOUT
+    s21_cmd_done_cb_t done;
+    void *ctx;
+} s21_cmd_t;
+
+// Commands waiting for the driver task; submitting to a full queue fails instead of blocking
+#define S21_CMD_QUEUE_DEPTH 8
+// Default time a command may take from submission to the unit's ACK
+#define S21_CMD_TIMEOUT_MS 10000
+
+// Callback function type
+typedef void (*s21_state_change_cb_t)(const ac_state_t *state);
+typedef void (*s21_maint_change_cb_t)(const s21_maint_t *maint);
+
+// Times we NAK a bad frame or re-send a query before giving up on it
+#define S21_MAX_RETRIES 3
+
+// Link quality counters, cumulative since boot
+typedef struct {
+    s21_uart_stats_t uart;     // Character level errors and timing
+    s21_parser_stats_t parser; // Framing and checksum errors
+    uint32_t naks_sent;        // Bad frames we NAKed
+    uint32_t retries;          // Queries re-sent after a bad or missing reply
+    uint32_t timeouts;         // Queries that got no reply at all
+    uint32_t link_losses;      // Times the unit went silent for S21_LINK_LOST_QUERIES queries
+    uint32_t last_outage_ms;   // Last reply before the latest loss to the first one after it
+    uint32_t max_outage_ms;
+} s21_link_stats_t;
+
+// Queries in a row that get no reply, even when re-sent, before the link counts as lost. The
+// driver then only probes the status register until the unit answers again, and reads the
+// full status as soon as it does.
+#define S21_LINK_LOST_QUERIES 3
+// NAKs this soon after the link comes up are from a unit still booting, not missing registers
+#define S21_LINK_SETTLE_MS 30000
+
+// Stack for the poll task. Frame buffers live in the driver object, not on the stack; the
+// statistics rollup (s21_stats.h) runs on this task too and may write flash.
+#define S21_POLL_TASK_STACK_SIZE 4096
+
+// Memory usage snapshot of the driver hot path
+typedef struct {
+    uint32_t stack_hwm_bytes;    // Lowest free stack seen on the poll task
+    uint32_t heap_free_bytes;    // Free heap after the last poll cycle, system wide
+    uint32_t heap_min_free_bytes;// Lowest free heap since boot
+    int32_t heap_delta_bytes;    // Free heap change across the last poll cycle
+    uint32_t heap_delta_cycles;  // Poll cycles where free heap changed
+    uint32_t poll_cycles;        // Total poll cycles
+} s21_mem_stats_t;
+
+class DaikinS21 {
+public:
+    DaikinS21();
+
+    /**
+     * @brief Initialize S21 Interface
+     * @param tx_pin GPIO for TX
+     * @param rx_pin GPIO for RX
+     * @param transport Bit-banged GPIO or the UART peripheral
+     */
+    esp_err_t Init(int tx_pin, int rx_pin, s21_transport_t transport = S21_TRANSPORT_BITBANG);
+
+    /**
+     * @brief Find out which registers the unit supports.
+     *
+     * Uses the map cached in NVS when there is one, otherwise probes every known register
+     * once and caches the result. Call after Init() and before creating Matter endpoints.
+     * A unit with demand control then gets its demand limit lifted.
+     * @return ESP_OK if the map is known, ESP_ERR_NOT_FOUND if the unit did not answer
+     *         (a default map is used and nothing is cached).
+     */
+    esp_err_t DiscoverCapabilities();
+
+    // Forget the cached map, so the next DiscoverCapabilities() probes the unit again
+    esp_err_t ResetCapabilities();
+
+    bool HasRegister(s21_reg_t reg) const { return (m_caps.regs & (1UL << reg)) != 0; }
+    s21_caps_t GetCapabilities() const { return m_caps; }
+
+    /**
+     * @brief Main polling function. Call this periodically, from the driver task only.
+     *
+     * Queued commands are picked up between queries, so a control change waits for at
+     * most the exchange in progress.
+     */
+    void Poll();
+
+    /**
+     * @brief Wait for commands between polls. Driver task only.
+     * @param ms Longest time to wait; returns early once a command needs the bus.
+     */
+    void Idle(uint32_t ms);
+
+    /**
+     * @brief Queue a command for the driver task. Safe from any task, never blocks.
+     * @param cmd Command; done (optional) is called with the result on the driver task.
+     * @return ESP_OK if queued, ESP_ERR_NO_MEM if the queue is full.
+     */
+    esp_err_t Submit(const s21_cmd_t *cmd);
+
+    // Setters. These queue a command and return straight away.
+    esp_err_t SetPower(bool on);
+    esp_err_t SetMode(uint8_t mode);
+    esp_err_t SetTemp(float temp);
+    esp_err_t SetFan(uint8_t fan);
+
+    /**
+     * @brief Queue several fields at once; they go out in a single D1 write.
+     * @param ctrl Fields to change
+     * @param done Optional completion callback, called on the driver task
+     * @param ctx Passed to done
+     * @param timeout_ms Time allowed until the unit ACKs the write
+     */
+    esp_err_t ApplyControl(const s21_control_t *ctrl, s21_cmd_done_cb_t done = nullptr, void *ctx = nullptr,
+                           uint32_t timeout_ms = S21_CMD_TIMEOUT_MS);
+
+    /**
+     * @brief Queue a demand limit ahead of other commands. Safe from any task, never blocks.
+     *
+     * The D7 write goes out before any pending D1, as soon as the bus gap allows. A limit
+     * still waiting when the next one arrives is replaced and fails with ESP_ERR_INVALID_STATE.
+     * The unit forgets its limit in a power cut, so the driver sends it again once the link
+     * comes back.
+     * @param demand Limit and econo mode
+     * @param done Optional completion callback, called on the driver task once the unit ACKs
+     * @param ctx Passed to done
+     * @param timeout_ms Time allowed until the unit ACKs the write
+     */
+    esp_err_t ApplyDemand(const s21_demand_t *demand, s21_cmd_done_cb_t done = nullptr, void *ctx = nullptr,
+                          uint32_t timeout_ms = S21_CMD_TIMEOUT_MS);
+
+    // Demand limit last requested. Safe from any task.
+    s21_demand_t GetDemand() const;
+
+    // Register a callback to update Matter attributes when AC changes
+    void SetStateCallback(s21_state_change_cb_t cb);
+
+    // Register a callback for changes in error code, filter or runtime counters
+    void SetMaintCallback(s21_maint_change_cb_t cb);
+
+    s21_maint_t GetMaint() const { return m_maint; }
+
+    // Get current known state, including queued changes. Safe from any task.
+    ac_state_t GetState() const;
+
+    /**
+     * @brief Record stack and heap usage around one poll cycle.
+     * @param heap_before Free heap sampled before Poll()
+     */
+    void UpdateMemStats(uint32_t heap_before);
+
+    // Get the latest memory usage snapshot
+    s21_mem_stats_t GetMemStats() const { return m_mem_stats; }
+
+    // Get link quality counters
+    s21_link_stats_t GetLinkStats() const;
+
+    // True while the unit answers; false before the first reply and after a loss
+    bool IsConnected() const { return m_connected; }
+
+private:
+    // Owned by the driver task
+    ac_state_t m_state;
+    bool m_dirty;
+    // Whether m_state holds a status read from the unit, rather than the stored one from Init()
+    bool m_status_read;
+    // Copy of m_state for other tasks, guarded by s21_port_lock()
+    ac_state_t m_shared_state;
+    // Demand limit: what the unit should have, whether it still needs a D7, and the command
+    // waiting for its ACK
+    s21_demand_t m_demand;
+    bool m_demand_dirty;
+    s21_cmd_t m_demand_cmd;
+    bool m_demand_waiting;
+    s21_demand_t m_shared_demand;
+
+    // Command queue, from static storage
+    s21_port_queue_t m_queue;
+    uint8_t m_queue_storage[S21_CMD_QUEUE_DEPTH * sizeof(s21_cmd_t)];
+    // Control commands merged into m_state and waiting for the next D1 ACK
+    s21_cmd_t m_inflight[S21_CMD_QUEUE_DEPTH];
+    uint8_t m_inflight_count;
+    bool m_refresh;
+    // End of the last exchange on the bus, for the inter-query gap
+    int64_t m_last_bus_us;
+    // When the unit last ACKed a query or write
+    int64_t m_last_ack_us;
+    // Link watchdog: whether the unit answers, since when, and its last ACK before a loss
+    bool m_connected;
+    uint8_t m_silent_queries;
+    int64_t m_link_up_us;
+    int64_t m_link_down_us;
+    // Trace spans merged into the pending D1 write, and those waiting for a G1 to confirm
+    uint16_t m_trace_pending[S21_CMD_QUEUE_DEPTH];
+    uint8_t m_trace_pending_count;
+    uint16_t m_trace_confirm[S21_CMD_QUEUE_DEPTH];
+    uint8_t m_trace_confirm_count;
+    s21_state_change_cb_t m_callback;
+    s21_mem_stats_t m_mem_stats;
+    s21_link_stats_t m_link_stats;
+    S21Parser m_parser;
+    s21_caps_t m_caps;
+    uint32_t m_poll_cycle;
+    s21_maint_t m_maint;
+    s21_maint_change_cb_t m_maint_callback;
+    uint8_t m_maint_next;
+
+    // Transmit buffer, sized at compile time so SendPacket() stays off the heap and stack.
+    // Received frames are assembled in m_parser.
+    uint8_t m_tx_buf[S21_MAX_PKT_LEN];
+
+    // Internal helpers
+    esp_err_t SendPacket(uint8_t cmd1, uint8_t cmd2, uint8_t *payload, int len);
+    esp_err_t SendFrame(const char *cmd, int cmd_len, const uint8_t *payload, int len);
+    esp_err_t QueryRegister(s21_reg_t reg);
+    void DropRegister(s21_reg_t reg);
+    esp_err_t ProbeCapabilities();
+    esp_err_t LoadCapabilities();
+    esp_err_t SaveCapabilities();
+    esp_err_t ReadReply(int &retries_left);
+    void HandleFrame(const uint8_t *frame, int len);
+    void ParseStatusG1(const uint8_t *payload, int len);
+    void ParseSensorsGH(const uint8_t *payload, int len);
+    void ParseSensorsG9(const uint8_t *payload, int len);
+    void ParseSensorsSH(const uint8_t *payload, int len);
+    void ParseSensorsSa(const uint8_t *payload, int len);
+    void ParseCompressorSd(const uint8_t *payload, int len);
+    void ParseProtocolG8(const uint8_t *payload, int len);
+    void ParseErrorSW(const uint8_t *payload, int len);
+    void ParseFilterSF(const uint8_t *payload, int len);
+    void ParseRuntimeSM(const uint8_t *payload, int len);
+    void PollMaintenance();
+    void CheckLink();
+    void LinkUp();
+    esp_err_t SendControlD1();
+    esp_err_t SendDemandD7();
+    void AcceptDemand(const s21_cmd_t *cmd);
+    void CompleteDemand(esp_err_t result);
+    bool WaitCommands(int64_t until_us, bool wake_on_work);
+    void Gap();
+    void AcceptCommand(const s21_cmd_t *cmd);
+    void MergeControl(const s21_control_t *ctrl);
+    void CompleteInflight(esp_err_t result);
+    void ExpireInflight();
+    void FlushCommands();
+    void NotifyState();
+};
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "daikin_s21.h"
+
+// Largest payload we expect from the unit (v3 replies included)
+#define S21_MAX_PAYLOAD_LEN 32
+// Largest frame: STX + 4-char command + payload + CRC + ETX
+#define S21_MAX_PKT_LEN (S21_MAX_PAYLOAD_LEN + S21_MIN_V3_PKT_LEN)
+
+// Result of feeding one byte into the parser
+typedef enum {
+    S21_PARSE_NONE = 0,  // Need more bytes
+    S21_PARSE_ACK,       // Bare ACK outside of a frame
+    S21_PARSE_NAK,       // Bare NAK outside of a frame
+    S21_PARSE_FRAME,     // Complete frame with a valid checksum
+    S21_PARSE_BAD_FRAME, // Complete frame with a bad checksum or too short
+    S21_PARSE_OVERFLOW,  // Frame did not fit the buffer and was dropped
+} s21_parse_result_t;
+
+// Parser counters, cumulative since boot
+typedef struct {
+    uint32_t frames;     // Valid frames
+    uint32_t bad_frames; // Checksum failures and truncated frames
+    uint32_t resyncs;    // STX seen in the middle of a frame
+    uint32_t overflows;  // Frames longer than S21_MAX_PKT_LEN
+    uint32_t noise;      // Bytes outside of a frame that were not ACK/NAK
+} s21_parser_stats_t;
+
+/**
+ * Byte-at-a-time S21 frame parser.
+ *
+ * Frames are STX, command, payload, checksum, ETX. s21_checksum() promotes any checksum
+ * that would collide with STX/ETX/ACK, so an ETX always terminates a frame and an STX
+ * always starts one: the parser resynchronizes on every STX it sees.
+ */
+class S21Parser {
+public:
+    S21Parser();
+
+    // Drop any partial frame
+    void Reset();
+
+    // Feed one received byte
+    s21_parse_result_t Feed(uint8_t byte);
+
+    // True while a frame has been started but not terminated
+    bool InFrame() const { return m_in_frame; }
+
+    // Last complete frame, including STX and ETX. Valid after S21_PARSE_FRAME.
+    const uint8_t *Frame() const { return m_buf; }
+    int FrameLen() const { return m_len; }
+
+    // Payload of the last complete frame (between the 2-char command and the checksum)
+    const uint8_t *Payload() const { return &m_buf[S21_PAYLOAD_OFFSET]; }
+    int PayloadLen() const { return m_len - S21_MIN_PKT_LEN; }
+
+    s21_parser_stats_t GetStats() const { return m_stats; }
+
+private:
+    uint8_t m_buf[S21_MAX_PKT_LEN];
+    int m_len;
+    bool m_in_frame;
+    bool m_overflow;
+    s21_parser_stats_t m_stats;
+};
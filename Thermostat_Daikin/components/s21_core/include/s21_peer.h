@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "s21_driver.h"
+
+// Compact UDP messages between S21 nodes and a bridge. A unit multicasts its state; the
+// bridge sends control changes back to the address the state came from.
+//
+// All messages start with the same 20-byte header, multi-byte fields are little-endian and
+// temperatures are hundredths of a degree Celsius, as in Matter. Decoders accept messages
+// longer than they expect, so fields can be appended without a version bump.
+//
+// Every message carries a SipHash-2-4 tag in its header, keyed with the site's shared key
+// and covering the whole datagram; messages that fail it are dropped. A unit applies a
+// control only through an s21_peer_guard_t, which pins the bridge's address and drops
+// replays.
+
+#define S21_PEER_PORT          5321
+// Site-local scope so state crosses a Thread border router to Wi-Fi peers
+#define S21_PEER_GROUP         "ff05::5321"
+#define S21_PEER_VERSION       2
+#define S21_PEER_UNIT_ID_LEN   6
+#define S21_PEER_MAX_MSG_LEN   32
+#define S21_PEER_KEY_LEN       16
+#define S21_PEER_MAC_LEN       8
+// Source of a control as the guard compares it: IPv6 address, then port
+#define S21_PEER_ADDR_LEN      18
+// A control must echo one of the unit's last this many state seqs
+#define S21_PEER_ACK_WINDOW    8
+// A bridge not heard from for this long is forgotten, and the next one is learned. Longer
+// than S21_PEER_ACK_WINDOW state publishes, so nothing it sent is still fresh by then.
+#define S21_PEER_BRIDGE_FORGET_S 600
+
+typedef enum {
+    S21_PEER_MSG_STATE = 1,   // Unit -> group: current state
+    S21_PEER_MSG_CONTROL = 2, // Bridge -> unit: s21_control_t to apply
+} s21_peer_msg_type_t;
+
+typedef struct {
+    uint8_t unit_id[S21_PEER_UNIT_ID_LEN]; // Sender's MAC address
+    uint16_t seq;                          // Per-sender counter, to drop reordered messages
+    s21_peer_msg_type_t type;
+    ac_state_t state;                      // For S21_PEER_MSG_STATE; NAN outside_temp if unknown
+    s21_control_t control;                 // For S21_PEER_MSG_CONTROL
+    uint16_t ack_seq;                      // For S21_PEER_MSG_CONTROL: latest state seq the
+                                           // bridge has from the unit
+} s21_peer_msg_t;
+
+// What a unit knows about the bridge that controls it
+typedef struct {
+    bool has_bridge;                        // bridge_addr is pinned
+    uint8_t bridge_addr[S21_PEER_ADDR_LEN];
+    int64_t bridge_seen_us;                 // Last control accepted from it
+    bool has_last;                          // A control was accepted since boot
+    uint16_t last_ack_seq;                  // (ack_seq, seq) of that control
+    uint16_t last_seq;
+} s21_peer_guard_t;
+
+// Encode msg into buf and sign it with key. Returns the message length, or 0 if buf is too
+// small.
+size_t s21_peer_encode(const s21_peer_msg_t *msg, const uint8_t key[S21_PEER_KEY_LEN], uint8_t *buf, size_t len);
+// Decode a received datagram. ESP_ERR_INVALID_RESPONSE if it is not a peer message,
+// ESP_ERR_INVALID_VERSION if it comes from an incompatible sender, ESP_ERR_INVALID_CRC if
+// its tag does not match key.
+esp_err_t s21_peer_decode(const uint8_t *buf, size_t len, const uint8_t key[S21_PEER_KEY_LEN], s21_peer_msg_t *msg);
+// True if seq is newer than last, allowing for wrap-around
+bool s21_peer_seq_newer(uint16_t seq, uint16_t last);
+// SipHash-2-4 of data under key
+uint64_t s21_peer_siphash(const uint8_t key[S21_PEER_KEY_LEN], const uint8_t *data, size_t len);
+
+// Whether a unit applies a decoded control that came from addr. publish_seq is the unit's
+// latest state seq. The first control is taken from any address, which is then the only
+// one accepted until it has been silent for S21_PEER_BRIDGE_FORGET_S. ack_seq must be one
+// of the last S21_PEER_ACK_WINDOW state seqs, and (ack_seq, seq) newer than the last
+// accepted pair, so a recorded control is not applied twice. On ESP_OK the guard records
+// the control; ESP_ERR_INVALID_STATE if addr is not the bridge's, ESP_ERR_INVALID_RESPONSE
+// for a stale or replayed control.
+esp_err_t s21_peer_guard_check(s21_peer_guard_t *guard, const s21_peer_msg_t *msg,
+                               const uint8_t addr[S21_PEER_ADDR_LEN], uint16_t publish_seq, int64_t now_us);
@@ -0,0 +1,101 @@
+#pragma once
+
+// Platform shims used by the S21 core. The core itself never includes FreeRTOS, driver or
+// NVS headers; everything it needs from the platform goes through the functions below.
+// port/s21_port_esp.cpp implements them for ESP-IDF. A host build provides its own
+// implementation, which is also where a virtual clock and a scripted bus plug in.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_err.h>
+#include <esp_log.h>
+#else
+#include <stdio.h>
+
+// Subset of esp_err.h used by the core, with the same values
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC     0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { } while (0)
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buf, len, level) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Software UART receiver counters, cumulative since boot
+typedef struct {
+    uint32_t bytes;              // Characters received
+    uint32_t parity_errors;      // Characters with bad parity
+    uint32_t framing_errors;     // Characters with a missing stop bit
+    uint32_t vote_disagreements; // Bits where the three samples did not all agree
+    float bit_period_us;         // Current bit period estimate
+} s21_uart_stats_t;
+
+// Monotonic clock
+int64_t s21_port_time_us(void);
+void s21_port_delay_ms(uint32_t ms);
+
+// How bytes reach the unit
+typedef enum {
+    S21_TRANSPORT_BITBANG = 0, // GPIO bit-banging; any pins, but busy-waits for every byte
+    S21_TRANSPORT_UART,        // UART peripheral with inverted lines; the CPU is free meanwhile
+    S21_TRANSPORT_SIM,         // No unit: the simulated one in s21_sim.h, pins unused
+} s21_transport_t;
+
+// Byte transport to the unit: 2400 baud, 8E2, inverted line levels
+esp_err_t s21_port_uart_init(int tx_pin, int rx_pin, s21_transport_t transport);
+void s21_port_uart_write(uint8_t byte);
+// Returns the byte, or -1 if nothing valid arrived within timeout_ms
+int s21_port_uart_read(uint32_t timeout_ms);
+void s21_port_uart_get_stats(s21_uart_stats_t *stats);
+// Bit-bang receive bit period in 1/16 us, to carry the timing calibration across reboots.
+// 0 for transports with a fixed rate. A period outside the tracking range is ignored.
+uint32_t s21_port_uart_get_bit_q4(void);
+void s21_port_uart_set_bit_q4(uint32_t bit_q4);
+
+// Fixed-size message queue over caller-provided storage of depth * item_size bytes
+typedef struct s21_port_queue *s21_port_queue_t;
+s21_port_queue_t s21_port_queue_create(size_t depth, size_t item_size, uint8_t *storage);
+// Never blocks; false if the queue is full
+bool s21_port_queue_send(s21_port_queue_t queue, const void *item);
+// Same, but the item is received before those already queued
+bool s21_port_queue_send_front(s21_port_queue_t queue, const void *item);
+bool s21_port_queue_receive(s21_port_queue_t queue, void *item, uint32_t timeout_ms);
+
+// Short critical section for state shared between tasks
+void s21_port_lock(void);
+void s21_port_unlock(void);
+
+// Persistent blobs. Erasing a missing key is not an error.
+esp_err_t s21_port_storage_read(const char *key, void *buf, size_t *len);
+esp_err_t s21_port_storage_write(const char *key, const void *buf, size_t len);
+esp_err_t s21_port_storage_erase(const char *key);
+
+// Memory figures for s21_mem_stats_t
+uint32_t s21_port_heap_free(void);
+uint32_t s21_port_heap_min_free(void);
+uint32_t s21_port_stack_free(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include "s21_port.h"
+
+// Host implementation of s21_port.h, in port/s21_port_host.cpp. The bus is the simulated unit
+// from s21_sim.h whatever the transport, storage lives in memory and the clock is virtual:
+// it only moves while the driver waits, so a simulated day runs in seconds of wall time.
+// Single-threaded; s21_port_lock() does nothing.
+
+// Longest step the virtual clock takes between two calls of the tick callback
+#define S21_HOST_TICK_MS 10
+
+// Called each time the virtual clock moves, with the new time. This is where a host program
+// submits commands, changes faults or checks the driver while it is inside Poll() or Idle().
+typedef void (*s21_host_tick_cb_t)(int64_t now_us);
+void s21_host_set_tick(s21_host_tick_cb_t cb);
+
+// Move the virtual clock forward, calling the tick callback on the way
+void s21_host_advance_us(int64_t us);
+
+// Forget stored blobs, as after an erase of the NVS partition
+void s21_host_storage_clear(void);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "s21_port.h"
+#include "s21_driver.h"
+
+// A simulated indoor unit on the byte level, with scripted faults. It answers the queries and
+// D1 and D7 writes the driver sends, the way a v2 unit does. Ports use it for S21_TRANSPORT_SIM, and a
+// host program can run DaikinS21 against it on a virtual clock.
+
+// Time from the end of a query to the first reply byte
+#define S21_SIM_REPLY_DELAY_MS 30
+// Time on the wire per character at 2400 baud 8E2
+#define S21_SIM_CHAR_US 5000
+
+// For s21_sim_set_compressor()
+#define S21_SIM_COMPRESSOR_AUTO (-2) // Runs while the room is short of the setpoint
+#define S21_SIM_COMPRESSOR_NONE (-1) // No Rd register: the unit NAKs it
+
+// Faults injected into the unit's replies. Percentages apply to each query independently.
+typedef struct {
+    uint8_t drop_pct;          // Query gets no reply at all, not even the ACK
+    uint8_t truncate_pct;      // Reply frame stops before its ETX
+    uint8_t bad_checksum_pct;  // Reply frame has a wrong checksum
+    uint8_t answer_every;      // Only every Nth query is answered; 0 or 1 for all
+    uint32_t outage_every_s;   // Brown-out period, 0 for none
+    uint32_t outage_s;         // Unit silent for this long, then back with power off
+    uint32_t boot_nak_s;       // After an outage, the unit NAKs every query this long
+} s21_sim_faults_t;
+
+// What the simulated unit has seen and injected, cumulative since s21_sim_reset()
+typedef struct {
+    uint32_t queries;          // Frames received from the driver
+    uint32_t bad_queries;      // Received with a bad checksum, NAKed
+    uint32_t dropped;
+    uint32_t truncated;
+    uint32_t bad_checksums;
+    uint32_t skipped;          // Left unanswered by answer_every
+    uint32_t outages;
+    uint32_t boot_naks;
+    uint32_t writes;           // D1 writes accepted
+} s21_sim_stats_t;
+
+// Start over: unit off, no pending bytes. seed makes the fault sequence repeatable.
+void s21_sim_reset(const s21_sim_faults_t *faults, uint32_t seed, int64_t now_us);
+// Change the fault profile without resetting the unit
+void s21_sim_set_faults(const s21_sim_faults_t *faults);
+// Fill faults from a named profile: clean, lost-ack, truncated, checksum, every-other,
+// brownout or mixed. False if the name is unknown.
+bool s21_sim_profile(const char *name, s21_sim_faults_t *faults);
+
+// A byte from the driver at now_us
+void s21_sim_write(uint8_t byte, int64_t now_us);
+// The next byte for the driver if it has arrived by now_us, otherwise -1 with *next_us set to
+// when it will arrive (INT64_MAX if nothing is on the way)
+int s21_sim_read(int64_t now_us, int64_t *next_us);
+
+// The unit's own settings and room temperature, as the driver should eventually see them
+ac_state_t s21_sim_get_unit(void);
+// Demand limit the unit runs with; a brown-out clears it
+s21_demand_t s21_sim_get_demand(void);
+void s21_sim_set_room_temp(float temp);
+// Error code the unit reports, such as "E5"; nullptr or "" for none
+void s21_sim_set_error(const char *code);
+// Compressor frequency the unit reports in Rd, in Hz, or S21_SIM_COMPRESSOR_AUTO or _NONE.
+// Kept until the next s21_sim_reset().
+void s21_sim_set_compressor(int hz);
+// The unit's filter counter
+void s21_sim_set_filter_hours(uint16_t hours);
+// True while the unit is in a brown-out at now_us
+bool s21_sim_in_outage(int64_t now_us);
+s21_sim_stats_t s21_sim_get_stats(void);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include "s21_port.h"
+#include "s21_driver.h"
+
+// Runtime statistics, integrated from the decoded unit state. Each sample adds the time since
+// the previous one to the state seen then, so the cost per sample is constant. Time is
+// accumulated in milliseconds and temperatures as 0.01 C x milliseconds, all in integers.
+
+// Length of one rollup bucket
+#define S21_STATS_BUCKET_S 3600
+// Longer gaps between samples are not counted; the state in between is unknown
+#define S21_STATS_MAX_GAP_S 120
+// Average of a bucket with no time to average over
+#define S21_STATS_NO_TEMP INT16_MIN
+
+// Modes runtime is counted in while the unit is on
+typedef enum {
+    S21_STATS_MODE_COOL = 0,
+    S21_STATS_MODE_HEAT,
+    S21_STATS_MODE_AUTO,
+    S21_STATS_MODE_DRY,
+    S21_STATS_MODE_FAN,
+    S21_STATS_MODE_COUNT,
+} s21_stats_mode_t;
+
+// One bucket, as rolled up and logged
+typedef struct {
+    uint16_t mode_s[S21_STATS_MODE_COUNT]; // Seconds on in each mode
+    uint16_t off_s;                        // Seconds off
+    uint16_t active_s;                     // Seconds the compressor ran; on units without Rd,
+                                           // seconds the room was short of the setpoint
+    uint16_t setpoint_changes;
+    uint16_t power_ons;                    // Off to on transitions
+    int16_t room_avg;                      // 0.01 C, averaged over the sampled time
+    int16_t target_avg;                    // 0.01 C, averaged over the time on
+    int16_t outside_avg;                   // 0.01 C, over the time the unit reported it
+} s21_stats_bucket_t;
+
+// Counters since the statistics were last cleared
+typedef struct {
+    uint32_t mode_s[S21_STATS_MODE_COUNT];
+    uint32_t active_s;
+    uint32_t setpoint_changes;
+    uint32_t power_ons;
+    uint32_t buckets;                      // Buckets rolled up
+} s21_stats_totals_t;
+
+// Called from s21_stats_sample() each time a bucket is complete
+typedef void (*s21_stats_rollup_cb_t)(const s21_stats_bucket_t *bucket, const s21_stats_totals_t *totals);
+
+// Start over from saved totals (NULL for zero). The current bucket starts empty.
+void s21_stats_init(const s21_stats_totals_t *totals, s21_stats_rollup_cb_t cb);
+// Feed the state at now_us. Call regularly, at least every S21_STATS_MAX_GAP_S.
+void s21_stats_sample(const ac_state_t *state, int64_t now_us);
+// Snapshot of the bucket in progress, with its length so far, and of the totals. Any task.
+void s21_stats_get(s21_stats_bucket_t *current, uint32_t *current_s, s21_stats_totals_t *totals);
+// Duty cycle in 0.1 % of the time on, 0 if the unit was never on
+uint16_t s21_stats_duty_permille(uint32_t active_s, uint32_t on_s);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "s21_port.h"
+
+// Stages of a control command, from the Matter write to the unit reporting the new state
+typedef enum {
+    S21_TRACE_PRE_UPDATE = 0, // Attribute PRE_UPDATE callback, start of the span
+    S21_TRACE_ENQUEUE,        // Posted to the driver's command queue
+    S21_TRACE_DEQUEUE,        // Taken off the queue by the driver task
+    S21_TRACE_TX,             // First byte of the D1 write on the wire
+    S21_TRACE_ACK,            // Unit ACKed the D1 write
+    S21_TRACE_CONFIRM,        // A G1 status read shows the requested values
+    S21_TRACE_STAGE_COUNT,
+} s21_trace_stage_t;
+
+// Spans kept; the oldest is overwritten once the buffer is full
+#define S21_TRACE_SPANS 32
+// Stage offset of a stage the command has not reached
+#define S21_TRACE_NONE UINT32_MAX
+
+typedef struct {
+    uint16_t id;                                 // 0 if the slot is unused
+    uint32_t tag;                                // Attribute ID that started the span, 0 if internal
+    int64_t start_us;                            // s21_port_time_us() at S21_TRACE_PRE_UPDATE
+    uint32_t stage_us[S21_TRACE_STAGE_COUNT];    // Offset of each stage from start_us
+    esp_err_t result;                            // ESP_OK, or why the span ended early
+    bool done;
+} s21_trace_span_t;
+
+// Start a span and return its ID, never 0. Safe from any task.
+uint16_t s21_trace_begin(uint32_t tag);
+// Record a stage now. IDs of 0 or of spans already overwritten are ignored.
+void s21_trace_stamp(uint16_t id, s21_trace_stage_t stage);
+void s21_trace_stamp_at(uint16_t id, s21_trace_stage_t stage, int64_t t_us);
+// Close a span with its result
+void s21_trace_end(uint16_t id, esp_err_t result);
+// Copy out the index-th slot counting from the oldest. False once index is past the end;
+// true with out->id == 0 for a slot not used yet.
+bool s21_trace_get(size_t index, s21_trace_span_t *out);
+void s21_trace_clear(void);
+// Short name of a stage, e.g. for the trace dump
+const char *s21_trace_stage_name(s21_trace_stage_t stage);
+
+// Latency from the start of a span to one stage, over every span since the last clear, not
+// just those still in the buffer. Percentiles are the upper edge of a histogram bucket, within
+// 25 % of the true value, with 1 ms resolution.
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} s21_trace_latency_t;
+
+// Stages with a latency histogram: S21_TRACE_ACK and S21_TRACE_CONFIRM. False for others.
+bool s21_trace_latency(s21_trace_stage_t stage, s21_trace_latency_t *out);
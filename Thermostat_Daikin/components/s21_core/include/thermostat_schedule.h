@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Limits advertised through NumberOfWeeklyTransitions / NumberOfDailyTransitions
+#define SCHEDULE_MAX_TRANSITIONS 40
+#define SCHEDULE_MAX_DAILY       10
+
+#define SCHEDULE_MINUTES_PER_DAY  1440
+#define SCHEDULE_MINUTES_PER_WEEK (7 * SCHEDULE_MINUTES_PER_DAY)
+
+// Transition flags, stored in the top bits of `when`
+#define SCHEDULE_WHEN_MASK 0x3FFF
+#define SCHEDULE_HAS_HEAT  0x4000
+#define SCHEDULE_HAS_COOL  0x8000
+
+// Layout version of the stored schedule
+#define SCHEDULE_STORAGE_VERSION 1
+
+// One setpoint change, 4 bytes. Setpoints are in 0.5 C steps, which is all S21 can do.
+typedef struct {
+    uint16_t when;     // Minute of the week, Sunday 00:00 = 0, plus SCHEDULE_HAS_* flags
+    uint8_t heat_half; // Heating setpoint * 2
+    uint8_t cool_half; // Cooling setpoint * 2
+} schedule_transition_t;
+
+// Stored form of the whole schedule, in NVS as a single blob
+typedef struct {
+    uint8_t version; // SCHEDULE_STORAGE_VERSION
+    uint8_t count;
+    schedule_transition_t transitions[SCHEDULE_MAX_TRANSITIONS];
+} schedule_storage_t;
+
+static inline uint16_t schedule_minute(const schedule_transition_t *t) { return t->when & SCHEDULE_WHEN_MASK; }
+
+// Convert between Matter setpoints (0.01 C) and stored half degrees
+static inline uint8_t schedule_encode_setpoint(int16_t centi) {
+    int v = (centi + 25) / 50;
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+static inline int16_t schedule_decode_setpoint(uint8_t half) { return (int16_t)half * 50; }
+
+/**
+ * Weekly thermostat schedule.
+ *
+ * Transitions are kept sorted by minute of the week. A cursor points at the next
+ * transition to fire, so stepping from one transition to the next is O(1); Seek() (binary
+ * search) is only needed after an edit or a clock jump. The class has no platform
+ * dependencies: the caller supplies the time and owns the timer and storage.
+ */
+class ThermostatSchedule {
+public:
+    ThermostatSchedule();
+
+    void Clear();
+
+    /**
+     * @brief Replace the transitions of every day in day_mask.
+     * @param day_mask Bit 0 = Sunday ... bit 6 = Saturday
+     * @param day Transitions with `when` in minutes since midnight, plus SCHEDULE_HAS_* flags
+     * @return false if count exceeds SCHEDULE_MAX_DAILY or the weekly total would exceed
+     *         SCHEDULE_MAX_TRANSITIONS. The schedule is unchanged in that case.
+     */
+    bool SetDays(uint8_t day_mask, const schedule_transition_t *day, int count);
+
+    // Copy one day's transitions (minute of day). Returns the number copied.
+    int GetDay(int weekday, schedule_transition_t *out, int max) const;
+
+    int Count() const { return m_count; }
+
+    // Position the cursor on the first transition after now (minute of week)
+    void Seek(uint16_t now);
+
+    // Transition in effect at the last Seek() or Advance(), or NULL if the schedule is empty
+    const schedule_transition_t *Current() const;
+
+    // Next transition to fire, or NULL if the schedule is empty
+    const schedule_transition_t *Next() const;
+
+    // Step past the next transition (it has fired). O(1).
+    void Advance();
+
+    // Minutes from now until Next() fires, in (0, SCHEDULE_MINUTES_PER_WEEK]
+    uint32_t MinutesUntilNext(uint16_t now) const;
+
+    void Save(schedule_storage_t *out) const;
+    bool Load(const schedule_storage_t *in);
+
+private:
+    schedule_transition_t m_transitions[SCHEDULE_MAX_TRANSITIONS];
+    int m_count;
+    int m_next; // Index of the next transition to fire
+};
@@ -0,0 +1,326 @@
+#include "s21_port.h"
+#include "s21_sim.h"
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <soc/soc_caps.h>
+#include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <nvs.h>
+
+// ESP-IDF implementation of s21_port.h: a bit-banged UART on two GPIOs, the UART peripheral
+// or the simulated unit, FreeRTOS queues and NVS storage.
+
+#define BIT_DELAY_US 417 
+
+#define S21_NVS_NAMESPACE "s21"
+
+// UART peripheral used by S21_TRANSPORT_UART; the RX buffer must exceed the hardware FIFO
+#define S21_UART_NUM     UART_NUM_1
+#define S21_UART_BAUD    2400
+#define S21_UART_RX_BUF  (SOC_UART_FIFO_LEN * 2)
+
+// Queues come from a small static pool so the driver never allocates
+#define S21_PORT_MAX_QUEUES 2
+
+// Receiver timing. The bit period is tracked in 1/16 us and adapts to the unit's actual
+// baud rate, within S21_BIT_TRACK_LIMIT_PCT of nominal.
+#define S21_BIT_Q4_NOMINAL     (BIT_DELAY_US << 4)
+#define S21_BIT_TRACK_LIMIT_PCT 10
+// Accept a single measurement only if it is this close to the current estimate
+#define S21_BIT_MEASURE_LIMIT_PCT 15
+// Weight of a new measurement in the running estimate (1/2^n)
+#define S21_BIT_TRACK_SHIFT 3
+// Bits in a character: start, 8 data, parity, stop
+#define S21_CHAR_DATA_BITS 8
+
+static s21_transport_t s_transport = S21_TRANSPORT_BITBANG;
+static int s_tx_pin = 0;
+static int s_rx_pin = 0;
+static portMUX_TYPE s_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_bit_q4 = S21_BIT_Q4_NOMINAL;
+static s21_uart_stats_t s_uart_stats;
+
+static inline uint32_t bit_us() {
+    return (s_bit_q4 + 8) >> 4;
+}
+
+static void sw_write_byte(uint8_t byte) {
+    uint32_t bit_delay = bit_us();
+    taskENTER_CRITICAL(&s_spinlock);
+    gpio_set_level((gpio_num_t)s_tx_pin, 1);
+    esp_rom_delay_us(bit_delay);
+    int ones = 0;
+    for (int i = 0; i < 8; i++) {
+        int bit = (byte >> i) & 0x01;
+        if (bit) ones++;
+        gpio_set_level((gpio_num_t)s_tx_pin, bit ? 0 : 1); 
+        esp_rom_delay_us(bit_delay);
+    }
+    int parity = (ones % 2 == 0) ? 0 : 1;
+    gpio_set_level((gpio_num_t)s_tx_pin, parity ? 0 : 1); 
+    esp_rom_delay_us(bit_delay);
+    gpio_set_level((gpio_num_t)s_tx_pin, 0);
+    taskEXIT_CRITICAL(&s_spinlock);
+    esp_rom_delay_us(bit_delay * 2);
+}
+
+// Busy-wait until `until`, noting when the line first leaves `level` (relative to t0)
+static int wait_and_sample(int64_t until, int64_t t0, int level, int64_t *edge_us) {
+    int64_t now;
+    while ((now = esp_timer_get_time()) < until) {
+        if (*edge_us < 0 && gpio_get_level((gpio_num_t)s_rx_pin) != level) *edge_us = now - t0;
+    }
+    return gpio_get_level((gpio_num_t)s_rx_pin);
+}
+
+// Sample one bit three times around its centre and take the majority
+static int sample_bit(int64_t t0, int bit_index, uint32_t bit_q4, int64_t *edge_us) {
+    int64_t centre = t0 + ((((int64_t)bit_index << 5) + 16) * bit_q4 >> 9);
+    int64_t spread = bit_q4 / (5 << 4);
+    int votes = 0;
+    votes += wait_and_sample(centre - spread, t0, 1, edge_us);
+    votes += wait_and_sample(centre, t0, 1, edge_us);
+    votes += wait_and_sample(centre + spread, t0, 1, edge_us);
+    if (votes == 1 || votes == 2) s_uart_stats.vote_disagreements++;
+    return votes >= 2;
+}
+
+// Line levels are inverted: idle is low, the start bit is high and a 1 data bit is low.
+// All sample points are scheduled from the start-bit edge, so delays do not accumulate.
+static int sw_read_byte(uint32_t timeout_ms) {
+    int64_t start = esp_timer_get_time();
+    int64_t timeout_us = timeout_ms * 1000;
+    while (gpio_get_level((gpio_num_t)s_rx_pin) == 0) {
+        if (esp_timer_get_time() - start > timeout_us) return -1;
+    }
+    int64_t t0 = esp_timer_get_time();
+    uint32_t bit_q4 = s_bit_q4;
+    int64_t edge_us = -1;
+
+    if (!sample_bit(t0, 0, bit_q4, &edge_us)) return -1; // Glitch, not a start bit
+
+    uint8_t byte = 0;
+    int ones = 0;
+    int first_low = -1;  // Index of the first bit whose level is low
+    for (int i = 0; i < S21_CHAR_DATA_BITS; i++) {
+        int level = sample_bit(t0, i + 1, bit_q4, &edge_us);
+        if (level == 0) {
+            byte |= (1 << i);
+            ones++;
+            if (first_low < 0) first_low = i + 1;
+        }
+    }
+    int parity_level = sample_bit(t0, S21_CHAR_DATA_BITS + 1, bit_q4, &edge_us);
+    if (parity_level == 0 && first_low < 0) first_low = S21_CHAR_DATA_BITS + 1;
+    int stop_level = sample_bit(t0, S21_CHAR_DATA_BITS + 2, bit_q4, &edge_us);
+
+    s_uart_stats.bytes++;
+    bool parity_ok = ((ones + (parity_level == 0)) % 2) == 0;
+    if (!parity_ok) s_uart_stats.parity_errors++;
+    if (stop_level != 0) s_uart_stats.framing_errors++;
+
+    // The first falling edge ends the run of high bits that began with the start bit, so
+    // it lands exactly first_low bit periods after t0. Use it to refine the bit period.
+    if (parity_ok && stop_level == 0 && first_low > 0 && edge_us > 0) {
+        uint32_t measured_q4 = (uint32_t)((edge_us << 4) / first_low);
+        uint32_t limit = bit_q4 * S21_BIT_MEASURE_LIMIT_PCT / 100;
+        if (measured_q4 + limit >= bit_q4 && measured_q4 <= bit_q4 + limit) {
+            int32_t next = (int32_t)bit_q4 + (((int32_t)measured_q4 - (int32_t)bit_q4) >> S21_BIT_TRACK_SHIFT);
+            int32_t span = S21_BIT_Q4_NOMINAL * S21_BIT_TRACK_LIMIT_PCT / 100;
+            if (next < S21_BIT_Q4_NOMINAL - span) next = S21_BIT_Q4_NOMINAL - span;
+            if (next > S21_BIT_Q4_NOMINAL + span) next = S21_BIT_Q4_NOMINAL + span;
+            s_bit_q4 = (uint32_t)next;
+        }
+    }
+
+    // Let the stop bit finish before looking for the next start edge
+    wait_and_sample(t0 + ((int64_t)(S21_CHAR_DATA_BITS + 3) * bit_q4 >> 4), t0, 0, &edge_us);
+    return byte;
+}
+
+static esp_err_t sw_uart_init(int tx_pin, int rx_pin) {
+    gpio_config_t tx_conf = {};
+    tx_conf.pin_bit_mask = (1ULL << tx_pin);
+    tx_conf.mode = GPIO_MODE_OUTPUT;
+    tx_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    esp_err_t err = gpio_config(&tx_conf);
+    if (err != ESP_OK) return err;
+    gpio_set_level((gpio_num_t)tx_pin, 0); 
+    gpio_config_t rx_conf = {};
+    rx_conf.pin_bit_mask = (1ULL << rx_pin);
+    rx_conf.mode = GPIO_MODE_INPUT;
+    rx_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    return gpio_config(&rx_conf);
+}
+
+// The peripheral does the framing and parity check itself; characters with a parity
+// error are dropped by the driver and show up as a bad frame checksum.
+static esp_err_t hw_uart_init(int tx_pin, int rx_pin) {
+    uart_config_t cfg = {};
+    cfg.baud_rate = S21_UART_BAUD;
+    cfg.data_bits = UART_DATA_8_BITS;
+    cfg.parity = UART_PARITY_EVEN;
+    cfg.stop_bits = UART_STOP_BITS_2;
+    cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    cfg.source_clk = UART_SCLK_DEFAULT;
+    esp_err_t err = uart_driver_install(S21_UART_NUM, S21_UART_RX_BUF, 0, 0, NULL, 0);
+    if (err == ESP_OK) err = uart_param_config(S21_UART_NUM, &cfg);
+    if (err == ESP_OK) err = uart_set_pin(S21_UART_NUM, tx_pin, rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (err == ESP_OK) err = uart_set_line_inverse(S21_UART_NUM, UART_SIGNAL_TXD_INV | UART_SIGNAL_RXD_INV);
+    return err;
+}
+
+// The simulated unit answers with the same timing as a real one, so waits block the same way
+static int sim_read_byte(uint32_t timeout_ms) {
+    int64_t until = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        int64_t next;
+        int byte = s21_sim_read(now, &next);
+        if (byte >= 0) {
+            s_uart_stats.bytes++;
+            return byte;
+        }
+        if (now >= until) return -1;
+        int64_t wake = next < until ? next : until;
+        TickType_t ticks = pdMS_TO_TICKS((wake - now + 999) / 1000);
+        vTaskDelay(ticks > 0 ? ticks : 1);
+    }
+}
+
+esp_err_t s21_port_uart_init(int tx_pin, int rx_pin, s21_transport_t transport) {
+    s_transport = transport;
+    s_tx_pin = tx_pin;
+    s_rx_pin = rx_pin;
+    memset(&s_uart_stats, 0, sizeof(s_uart_stats));
+    if (transport == S21_TRANSPORT_UART) return hw_uart_init(tx_pin, rx_pin);
+    if (transport == S21_TRANSPORT_SIM) {
+        s21_sim_reset(nullptr, (uint32_t)esp_timer_get_time(), esp_timer_get_time());
+        return ESP_OK;
+    }
+    return sw_uart_init(tx_pin, rx_pin);
+}
+
+void s21_port_uart_write(uint8_t byte) {
+    if (s_transport == S21_TRANSPORT_UART) {
+        uart_write_bytes(S21_UART_NUM, &byte, 1);
+        return;
+    }
+    if (s_transport == S21_TRANSPORT_SIM) {
+        s21_sim_write(byte, esp_timer_get_time());
+        return;
+    }
+    sw_write_byte(byte);
+}
+
+int s21_port_uart_read(uint32_t timeout_ms) {
+    if (s_transport == S21_TRANSPORT_SIM) return sim_read_byte(timeout_ms);
+    if (s_transport != S21_TRANSPORT_UART) return sw_read_byte(timeout_ms);
+    uint8_t byte;
+    if (uart_read_bytes(S21_UART_NUM, &byte, 1, pdMS_TO_TICKS(timeout_ms)) != 1) return -1;
+    s_uart_stats.bytes++;
+    return byte;
+}
+
+void s21_port_uart_get_stats(s21_uart_stats_t *stats) {
+    *stats = s_uart_stats;
+    stats->bit_period_us = (s_transport == S21_TRANSPORT_BITBANG) ? s_bit_q4 / 16.0f : 1e6f / S21_UART_BAUD;
+}
+
+uint32_t s21_port_uart_get_bit_q4(void) {
+    return s_transport == S21_TRANSPORT_BITBANG ? s_bit_q4 : 0;
+}
+
+void s21_port_uart_set_bit_q4(uint32_t bit_q4) {
+    uint32_t span = S21_BIT_Q4_NOMINAL * S21_BIT_TRACK_LIMIT_PCT / 100;
+    if (bit_q4 < S21_BIT_Q4_NOMINAL - span || bit_q4 > S21_BIT_Q4_NOMINAL + span) return;
+    s_bit_q4 = bit_q4;
+}
+
+int64_t s21_port_time_us(void) {
+    return esp_timer_get_time();
+}
+
+void s21_port_delay_ms(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+static StaticQueue_t s_queue_bufs[S21_PORT_MAX_QUEUES];
+static int s_queue_count = 0;
+
+s21_port_queue_t s21_port_queue_create(size_t depth, size_t item_size, uint8_t *storage) {
+    if (s_queue_count >= S21_PORT_MAX_QUEUES) return nullptr;
+    QueueHandle_t queue = xQueueCreateStatic(depth, item_size, storage, &s_queue_bufs[s_queue_count++]);
+    return (s21_port_queue_t)queue;
+}
+
+bool s21_port_queue_send(s21_port_queue_t queue, const void *item) {
+    return xQueueSend((QueueHandle_t)queue, item, 0) == pdTRUE;
+}
+
+bool s21_port_queue_send_front(s21_port_queue_t queue, const void *item) {
+    return xQueueSendToFront((QueueHandle_t)queue, item, 0) == pdTRUE;
+}
+
+bool s21_port_queue_receive(s21_port_queue_t queue, void *item, uint32_t timeout_ms) {
+    TickType_t wait = pdMS_TO_TICKS(timeout_ms);
+    if (wait == 0 && timeout_ms > 0) wait = 1;
+    return xQueueReceive((QueueHandle_t)queue, item, wait) == pdTRUE;
+}
+
+static portMUX_TYPE s_state_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void s21_port_lock(void) {
+    taskENTER_CRITICAL(&s_state_lock);
+}
+
+void s21_port_unlock(void) {
+    taskEXIT_CRITICAL(&s_state_lock);
+}
+
+esp_err_t s21_port_storage_read(const char *key, void *buf, size_t *len) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(S21_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_get_blob(handle, key, buf, len);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t s21_port_storage_write(const char *key, const void *buf, size_t len) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(S21_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(handle, key, buf, len);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t s21_port_storage_erase(const char *key) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(S21_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_erase_key(handle, key);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+}
+
+uint32_t s21_port_heap_free(void) {
+    return heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t s21_port_heap_min_free(void) {
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t s21_port_stack_free(void) {
+    return uxTaskGetStackHighWaterMark(NULL);
+}
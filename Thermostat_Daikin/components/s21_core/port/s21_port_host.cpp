@@ -0,0 +1,203 @@
+#include "s21_port_host.h"
+#include "s21_sim.h"
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Host implementation of s21_port.h; see s21_port_host.h
+
+#define HOST_MAX_QUEUES      2
+#define HOST_STORAGE_KEYS    8
+#define HOST_STORAGE_KEY_LEN 16
+#define HOST_STORAGE_MAX_LEN 256
+
+static int64_t s_now_us = 0;
+static s21_host_tick_cb_t s_tick_cb = nullptr;
+static s21_uart_stats_t s_uart_stats;
+
+void s21_host_set_tick(s21_host_tick_cb_t cb) {
+    s_tick_cb = cb;
+}
+
+void s21_host_advance_us(int64_t us) {
+    const int64_t step = (int64_t)S21_HOST_TICK_MS * 1000;
+    while (us > 0) {
+        int64_t d = us < step ? us : step;
+        s_now_us += d;
+        us -= d;
+        if (s_tick_cb) s_tick_cb(s_now_us);
+    }
+}
+
+int64_t s21_port_time_us(void) {
+    return s_now_us;
+}
+
+void s21_port_delay_ms(uint32_t ms) {
+    s21_host_advance_us((int64_t)ms * 1000);
+}
+
+esp_err_t s21_port_uart_init(int tx_pin, int rx_pin, s21_transport_t transport) {
+    memset(&s_uart_stats, 0, sizeof(s_uart_stats));
+    s_uart_stats.bit_period_us = 1e6f / 2400;
+    s21_sim_reset(nullptr, 1, s_now_us);
+    return ESP_OK;
+}
+
+void s21_port_uart_write(uint8_t byte) {
+    s21_sim_write(byte, s_now_us);
+    s21_host_advance_us(S21_SIM_CHAR_US);
+}
+
+int s21_port_uart_read(uint32_t timeout_ms) {
+    int64_t until = s_now_us + (int64_t)timeout_ms * 1000;
+    while (true) {
+        int64_t next;
+        int byte = s21_sim_read(s_now_us, &next);
+        if (byte >= 0) {
+            s_uart_stats.bytes++;
+            return byte;
+        }
+        if (s_now_us >= until) return -1;
+        s21_host_advance_us((next < until ? next : until) - s_now_us);
+    }
+}
+
+void s21_port_uart_get_stats(s21_uart_stats_t *stats) {
+    *stats = s_uart_stats;
+}
+
+// The simulated unit runs at exactly 2400 baud
+uint32_t s21_port_uart_get_bit_q4(void) {
+    return 0;
+}
+
+void s21_port_uart_set_bit_q4(uint32_t bit_q4) {}
+
+struct s21_port_queue {
+    size_t depth;
+    size_t item_size;
+    uint8_t *storage;
+    size_t head;
+    size_t count;
+};
+
+static struct s21_port_queue s_queues[HOST_MAX_QUEUES];
+static int s_queue_count = 0;
+
+s21_port_queue_t s21_port_queue_create(size_t depth, size_t item_size, uint8_t *storage) {
+    if (s_queue_count >= HOST_MAX_QUEUES) return nullptr;
+    s21_port_queue_t queue = &s_queues[s_queue_count++];
+    queue->depth = depth;
+    queue->item_size = item_size;
+    queue->storage = storage;
+    queue->head = 0;
+    queue->count = 0;
+    return queue;
+}
+
+bool s21_port_queue_send(s21_port_queue_t queue, const void *item) {
+    if (queue->count == queue->depth) return false;
+    size_t tail = (queue->head + queue->count) % queue->depth;
+    memcpy(&queue->storage[tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    return true;
+}
+
+bool s21_port_queue_send_front(s21_port_queue_t queue, const void *item) {
+    if (queue->count == queue->depth) return false;
+    queue->head = (queue->head + queue->depth - 1) % queue->depth;
+    memcpy(&queue->storage[queue->head * queue->item_size], item, queue->item_size);
+    queue->count++;
+    return true;
+}
+
+// Nothing else runs while the driver waits, so time moves on until the tick callback
+// has submitted something or the wait is over
+bool s21_port_queue_receive(s21_port_queue_t queue, void *item, uint32_t timeout_ms) {
+    int64_t until = s_now_us + (int64_t)timeout_ms * 1000;
+    while (queue->count == 0) {
+        if (s_now_us >= until) return false;
+        int64_t step = (int64_t)S21_HOST_TICK_MS * 1000;
+        s21_host_advance_us(until - s_now_us < step ? until - s_now_us : step);
+    }
+    memcpy(item, &queue->storage[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->depth;
+    queue->count--;
+    return true;
+}
+
+void s21_port_lock(void) {}
+void s21_port_unlock(void) {}
+
+typedef struct {
+    char key[HOST_STORAGE_KEY_LEN];
+    uint8_t data[HOST_STORAGE_MAX_LEN];
+    size_t len;
+} host_blob_t;
+
+static host_blob_t s_blobs[HOST_STORAGE_KEYS];
+
+static host_blob_t *find_blob(const char *key) {
+    for (int i = 0; i < HOST_STORAGE_KEYS; i++) {
+        if (s_blobs[i].key[0] && strcmp(s_blobs[i].key, key) == 0) return &s_blobs[i];
+    }
+    return nullptr;
+}
+
+esp_err_t s21_port_storage_read(const char *key, void *buf, size_t *len) {
+    host_blob_t *blob = find_blob(key);
+    if (!blob) return ESP_ERR_NOT_FOUND;
+    if (*len < blob->len) return ESP_ERR_INVALID_SIZE;
+    memcpy(buf, blob->data, blob->len);
+    *len = blob->len;
+    return ESP_OK;
+}
+
+esp_err_t s21_port_storage_write(const char *key, const void *buf, size_t len) {
+    if (len > HOST_STORAGE_MAX_LEN || strlen(key) >= HOST_STORAGE_KEY_LEN) return ESP_ERR_INVALID_SIZE;
+    host_blob_t *blob = find_blob(key);
+    for (int i = 0; !blob && i < HOST_STORAGE_KEYS; i++) {
+        if (!s_blobs[i].key[0]) {
+            blob = &s_blobs[i];
+            strcpy(blob->key, key);
+        }
+    }
+    if (!blob) return ESP_ERR_NO_MEM;
+    memcpy(blob->data, buf, len);
+    blob->len = len;
+    return ESP_OK;
+}
+
+esp_err_t s21_port_storage_erase(const char *key) {
+    host_blob_t *blob = find_blob(key);
+    if (blob) memset(blob, 0, sizeof(*blob));
+    return ESP_OK;
+}
+
+void s21_host_storage_clear(void) {
+    memset(s_blobs, 0, sizeof(s_blobs));
+}
+
+// Heap figures come from the C library where it can tell; growth shows up as less free
+static uint32_t s_heap_min_free = UINT32_MAX;
+
+uint32_t s21_port_heap_free(void) {
+    uint32_t free_bytes = 0;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    free_bytes = (uint32_t)(UINT32_MAX - info.uordblks);
+#endif
+    if (free_bytes < s_heap_min_free) s_heap_min_free = free_bytes;
+    return free_bytes;
+}
+
+uint32_t s21_port_heap_min_free(void) {
+    s21_port_heap_free();
+    return s_heap_min_free;
+}
+
+uint32_t s21_port_stack_free(void) {
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "report_windows.h"
+#include <string.h>
+
+ReportWindows::ReportWindows(uint32_t min_window_ms, uint32_t max_window_ms)
+    : m_min_window_ms(min_window_ms), m_max_window_ms(max_window_ms) {
+    Clear();
+}
+
+void ReportWindows::Clear() {
+    for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS; i++) {
+        m_windows[i].deadline_us = -1;
+        m_windows[i].count = 0;
+    }
+}
+
+ReportWindows::Window *ReportWindows::Find(uint32_t subscription) {
+    for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS; i++) {
+        if (m_windows[i].deadline_us >= 0 && m_windows[i].subscription == subscription) return &m_windows[i];
+    }
+    return nullptr;
+}
+
+int ReportWindows::Add(uint32_t subscription, uint16_t min_interval_s, const report_path_t &path, int64_t now_us) {
+    Window *w = Find(subscription);
+    if (!w) {
+        for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS && !w; i++) {
+            if (m_windows[i].deadline_us < 0) w = &m_windows[i];
+        }
+        if (!w) return REPORT_FULL;
+        uint32_t window_ms = (uint32_t)min_interval_s * 1000;
+        if (window_ms < m_min_window_ms) window_ms = m_min_window_ms;
+        if (window_ms > m_max_window_ms) window_ms = m_max_window_ms;
+        w->subscription = subscription;
+        w->deadline_us = now_us + (int64_t)window_ms * 1000;
+        w->count = 0;
+    }
+    for (int i = 0; i < w->count; i++) {
+        if (report_path_equal(&w->pending[i], &path)) return REPORT_COALESCED;
+    }
+    if (w->count == REPORT_MAX_PENDING) return REPORT_FULL;
+    w->pending[w->count++] = path;
+    return REPORT_QUEUED;
+}
+
+int64_t ReportWindows::NextDeadline() const {
+    int64_t next = -1;
+    for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS; i++) {
+        int64_t d = m_windows[i].deadline_us;
+        if (d >= 0 && (next < 0 || d < next)) next = d;
+    }
+    return next;
+}
+
+int ReportWindows::Close(Window *w, report_path_t *out) {
+    int n = w->count;
+    memcpy(out, w->pending, n * sizeof(w->pending[0]));
+    w->deadline_us = -1;
+    w->count = 0;
+    return n;
+}
+
+int ReportWindows::TakeDue(int64_t now_us, uint32_t *subscription, report_path_t *out) {
+    Window *due = nullptr;
+    for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS; i++) {
+        Window *w = &m_windows[i];
+        if (w->deadline_us < 0 || w->deadline_us > now_us) continue;
+        if (!due || w->deadline_us < due->deadline_us) due = w;
+    }
+    if (!due) return -1;
+    *subscription = due->subscription;
+    return Close(due, out);
+}
+
+int ReportWindows::Take(uint32_t subscription, report_path_t *out) {
+    Window *w = Find(subscription);
+    return w ? Close(w, out) : 0;
+}
+
+void ReportWindows::Reported(const report_path_t &path) {
+    for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS; i++) {
+        Window *w = &m_windows[i];
+        if (w->deadline_us < 0) continue;
+        for (int j = 0; j < w->count; j++) {
+            if (!report_path_equal(&w->pending[j], &path)) continue;
+            w->pending[j] = w->pending[--w->count];
+            break;
+        }
+        if (w->count == 0) w->deadline_us = -1;
+    }
+}
+
+int ReportWindows::OpenWindows() const {
+    int n = 0;
+    for (int i = 0; i < REPORT_MAX_SUBSCRIPTIONS; i++) {
+        if (m_windows[i].deadline_us >= 0) n++;
+    }
+    return n;
+}
@@ -0,0 +1,233 @@
+#include "s21_config.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "S21_CONFIG";
+
+// Key the capability map was stored under before the config blob
+#define S21_LEGACY_KEY_CAPS "caps"
+
+// Cached copy and what storage holds, guarded by s21_port_lock()
+static s21_config_t s_config;
+static s21_config_t s_stored;
+static bool s_dirty;
+static int64_t s_first_change_us;
+static int64_t s_last_change_us;
+static s21_config_stats_t s_stats;
+static bool s_loaded;
+
+// Bytes past the current layout, stored by newer firmware and written back unchanged
+static uint8_t s_tail[S21_CONFIG_MAX_LEN - sizeof(s21_config_t)];
+static size_t s_tail_len;
+// Blob as read or written; only the loading and the servicing task touch it
+alignas(s21_config_t) static uint8_t s_buf[S21_CONFIG_MAX_LEN];
+
+static void config_defaults(s21_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->version = S21_CONFIG_VERSION;
+    config->length = sizeof(*config);
+}
+
+// Bring a blob up to S21_CONFIG_VERSION, one version at a time, each step rewriting buf in
+// place and updating len if it changes the size. Version 1 is the first blob, so there is no
+// step yet; what came before it is read from the old keys by config_load_legacy().
+static bool config_migrate(uint8_t *buf, size_t *len) {
+    while (buf[0] < S21_CONFIG_VERSION) {
+        switch (buf[0]) {
+            default:
+                return false;
+        }
+        buf[0]++;
+    }
+    ((s21_config_t *)buf)->length = (uint16_t)*len;
+    return true;
+}
+
+static esp_err_t config_decode(size_t len, bool *migrated) {
+    if (len < 4 || ((s21_config_t *)s_buf)->length != len) return ESP_ERR_INVALID_SIZE;
+    // A newer version has changed what some field means; better to start over than guess
+    if (s_buf[0] > S21_CONFIG_VERSION) return ESP_ERR_INVALID_VERSION;
+    *migrated = s_buf[0] < S21_CONFIG_VERSION;
+    if (!config_migrate(s_buf, &len)) return ESP_ERR_INVALID_VERSION;
+
+    size_t known = len < sizeof(s21_config_t) ? len : sizeof(s21_config_t);
+    memcpy(&s_config, s_buf, known);
+    s_tail_len = len - known;
+    memcpy(s_tail, s_buf + known, s_tail_len);
+    s_config.version = S21_CONFIG_VERSION;
+    s_config.length = (uint16_t)(sizeof(s21_config_t) + s_tail_len);
+    return ESP_OK;
+}
+
+static bool config_load_legacy(void) {
+    s21_caps_t caps;
+    size_t len = sizeof(caps);
+    if (s21_port_storage_read(S21_LEGACY_KEY_CAPS, &caps, &len) != ESP_OK || len != sizeof(caps)) return false;
+    s_config.caps = caps;
+    s_config.flags |= S21_CONFIG_HAS_CAPS;
+    return true;
+}
+
+esp_err_t s21_config_load(void) {
+    if (s_loaded) return ESP_OK;
+    s_loaded = true;
+    config_defaults(&s_config);
+    config_defaults(&s_stored);
+    s_tail_len = 0;
+
+    size_t len = sizeof(s_buf);
+    bool migrated = false;
+    bool legacy = false;
+    esp_err_t err = s21_port_storage_read(S21_STORAGE_KEY_CONFIG, s_buf, &len);
+    if (err == ESP_OK) {
+        err = config_decode(len, &migrated);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Stored config v%u unusable (%d), using defaults", s_buf[0], err);
+            config_defaults(&s_config);
+            s_tail_len = 0;
+        }
+    } else {
+        legacy = config_load_legacy();
+    }
+
+    if (err == ESP_OK && !migrated) {
+        s_stored = s_config;
+        ESP_LOGI(TAG, "Loaded config v%u, %u bytes, flags 0x%lx", s_config.version, s_config.length,
+                 (unsigned long)s_config.flags);
+        return ESP_OK;
+    }
+    // Write the migrated or imported blob straight away, so the old form is read only once
+    if (migrated || legacy) {
+        s_dirty = true;
+        err = s21_config_flush();
+        if (err == ESP_OK && legacy) s21_port_storage_erase(S21_LEGACY_KEY_CAPS);
+        ESP_LOGI(TAG, "%s config to v%u: %d", legacy ? "Imported" : "Migrated", S21_CONFIG_VERSION, err);
+    }
+    return ESP_OK;
+}
+
+s21_config_t s21_config_get(void) {
+    s21_port_lock();
+    s21_config_t config = s_config;
+    s21_port_unlock();
+    return config;
+}
+
+// With s21_port_lock() held, after changing s_config
+static void config_commit(const s21_config_t *before) {
+    if (memcmp(before, &s_config, sizeof(s_config)) == 0) return;
+    int64_t now = s21_port_time_us();
+    bool dirty = memcmp(&s_config, &s_stored, sizeof(s_config)) != 0;
+    if (dirty && !s_dirty) s_first_change_us = now;
+    s_dirty = dirty;
+    s_last_change_us = now;
+    s_stats.changes++;
+}
+
+void s21_config_set_caps(const s21_caps_t *caps) {
+    s21_port_lock();
+    s21_config_t before = s_config;
+    if (caps) {
+        s_config.caps = *caps;
+        s_config.flags |= S21_CONFIG_HAS_CAPS;
+    } else {
+        memset(&s_config.caps, 0, sizeof(s_config.caps));
+        s_config.flags &= ~S21_CONFIG_HAS_CAPS;
+    }
+    config_commit(&before);
+    s21_port_unlock();
+}
+
+void s21_config_set_poll_interval(uint32_t ms) {
+    s21_port_lock();
+    s21_config_t before = s_config;
+    s_config.poll_interval_ms = ms;
+    config_commit(&before);
+    s21_port_unlock();
+}
+
+// The estimate moves a little with every character; only drift past the slack is kept
+void s21_config_set_bit_q4(uint32_t bit_q4) {
+    s21_port_lock();
+    s21_config_t before = s_config;
+    uint32_t diff = bit_q4 > s_config.bit_q4 ? bit_q4 - s_config.bit_q4 : s_config.bit_q4 - bit_q4;
+    if (!(s_config.flags & S21_CONFIG_HAS_BIT_PERIOD) || diff > S21_CONFIG_BIT_Q4_SLACK) {
+        s_config.bit_q4 = bit_q4;
+        s_config.flags |= S21_CONFIG_HAS_BIT_PERIOD;
+    }
+    config_commit(&before);
+    s21_port_unlock();
+}
+
+void s21_config_set_state(const ac_state_t *state) {
+    s21_port_lock();
+    s21_config_t before = s_config;
+    s_config.power = state->power;
+    s_config.mode = s21_encode_mode(state->mode);
+    s_config.fan_speed = s21_encode_fan(state->fan_speed);
+    s_config.target_temp = (int16_t)lroundf(state->target_temp * 100.0f);
+    s_config.flags |= S21_CONFIG_HAS_STATE;
+    config_commit(&before);
+    s21_port_unlock();
+}
+
+void s21_config_set_filter_base(uint16_t hours) {
+    s21_port_lock();
+    s21_config_t before = s_config;
+    s_config.filter_base_hours = hours;
+    s_config.flags |= S21_CONFIG_HAS_FILTER;
+    config_commit(&before);
+    s21_port_unlock();
+}
+
+void s21_config_service(int64_t now_us) {
+    s21_port_lock();
+    bool due = s_dirty && (now_us - s_last_change_us >= (int64_t)S21_CONFIG_QUIET_MS * 1000 ||
+                           now_us - s_first_change_us >= (int64_t)S21_CONFIG_MAX_DELAY_MS * 1000);
+    s21_port_unlock();
+    if (due) s21_config_flush();
+}
+
+esp_err_t s21_config_flush(void) {
+    s21_port_lock();
+    s21_config_t config = s_config;
+    bool dirty = s_dirty;
+    s21_port_unlock();
+    if (!dirty) return ESP_OK;
+
+    memcpy(s_buf, &config, sizeof(config));
+    memcpy(s_buf + sizeof(config), s_tail, s_tail_len);
+    esp_err_t err = s21_port_storage_write(S21_STORAGE_KEY_CONFIG, s_buf, config.length);
+
+    s21_port_lock();
+    if (err == ESP_OK) {
+        s_stored = config;
+        s_stats.writes++;
+        s_dirty = memcmp(&s_config, &s_stored, sizeof(s_config)) != 0;
+    } else {
+        s_stats.write_errors++;
+    }
+    // Changes made during the write, or a failed write, wait for another quiet period
+    s_first_change_us = s_last_change_us = s21_port_time_us();
+    s21_port_unlock();
+    if (err != ESP_OK) ESP_LOGW(TAG, "Config write failed: %d", err);
+    return err;
+}
+
+esp_err_t s21_config_reset(void) {
+    s21_port_lock();
+    config_defaults(&s_config);
+    s_stored = s_config;
+    s_tail_len = 0;
+    s_dirty = false;
+    s21_port_unlock();
+    return s21_port_storage_erase(S21_STORAGE_KEY_CONFIG);
+}
+
+s21_config_stats_t s21_config_get_stats(void) {
+    s21_port_lock();
+    s21_config_stats_t stats = s_stats;
+    stats.dirty = s_dirty;
+    s21_port_unlock();
+    return stats;
+}
@@ -0,0 +1,807 @@
+#include "s21_driver.h"
+#include "s21_port.h"
+#include "s21_config.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "S21_DRIVER";
+// Time allowed for the first reply byte after a query, and after an ACK or NAK
+#define S21_REPLY_TIMEOUT_MS 800
+#define S21_ACK_TIMEOUT_MS   500
+// Largest gap allowed between two bytes of the same frame
+#define S21_BYTE_TIMEOUT_MS  100
+// Gap between two queries of a poll cycle, and between discovery probes
+#define S21_QUERY_GAP_MS     500
+#define S21_PROBE_GAP_MS     100
+
+// Query command for each s21_reg_t, in enum order
+static const char s_reg_cmds[S21_REG_COUNT][2] = {
+    {'F', '1'}, {'F', '2'}, {'F', '5'}, {'F', '6'}, {'F', '7'}, {'F', '8'}, {'F', '9'},
+    {'F', 'K'}, {'R', 'H'}, {'R', 'a'}, {'R', 'I'}, {'R', 'L'}, {'R', 'd'}, {'R', 'W'},
+    {'R', 'F'}, {'R', 'M'},
+};
+
+// What the driver polled before discovery existed; used when the unit is not answering
+#define S21_DEFAULT_REGS ((1UL << S21_REG_STATUS) | (1UL << S21_REG_ROOM_TEMP))
+
+// Registers polled every cycle, and how often (in cycles)
+typedef struct {
+    s21_reg_t reg;
+    uint8_t every;
+} s21_poll_entry_t;
+
+static const s21_poll_entry_t s_poll_table[] = {
+    { S21_REG_STATUS,       1 },
+    { S21_REG_ROOM_TEMP,    1 },
+    { S21_REG_OUTSIDE_TEMP, 15 },
+    { S21_REG_COMPRESSOR,   3 },
+};
+
+// Maintenance registers change slowly. One of them is read every S21_MAINT_EVERY cycles,
+// at the end of a cycle and only if no control write is waiting.
+#define S21_MAINT_EVERY 5
+static const s21_reg_t s_maint_regs[] = { S21_REG_ERROR, S21_REG_FILTER, S21_REG_RUNTIME };
+
+DaikinS21::DaikinS21() {
+    m_dirty = false;
+    m_status_read = false;
+    m_callback = nullptr;
+    m_state.power = false;
+    m_state.mode = FAIKIN_MODE_AUTO;
+    m_state.target_temp = 22.0;
+    m_state.fan_speed = FAIKIN_FAN_AUTO;
+    m_state.current_temp = 21.0;
+    m_state.outside_temp = NAN;
+    m_state.compressor_hz = -1;
+    m_poll_cycle = 0;
+    memset(&m_maint, 0, sizeof(m_maint));
+    m_maint_callback = nullptr;
+    m_maint_next = 0;
+    memset(&m_caps, 0, sizeof(m_caps));
+    m_caps.version = S21_CAPS_VERSION;
+    m_caps.protocol_major = 2;
+    m_caps.regs = S21_DEFAULT_REGS;
+    memset(&m_mem_stats, 0, sizeof(m_mem_stats));
+    memset(&m_link_stats, 0, sizeof(m_link_stats));
+    m_shared_state = m_state;
+    m_demand.limit_pct = S21_DEMAND_MAX_PCT;
+    m_demand.econo = false;
+    m_demand_dirty = false;
+    m_demand_waiting = false;
+    m_shared_demand = m_demand;
+    m_queue = nullptr;
+    m_inflight_count = 0;
+    m_refresh = false;
+    m_last_bus_us = 0;
+    m_last_ack_us = 0;
+    m_connected = false;
+    m_silent_queries = 0;
+    m_link_up_us = 0;
+    m_link_down_us = 0;
+    m_trace_pending_count = 0;
+    m_trace_confirm_count = 0;
+}
+
+esp_err_t DaikinS21::Init(int tx_pin, int rx_pin, s21_transport_t transport) {
+    esp_err_t err = s21_port_uart_init(tx_pin, rx_pin, transport);
+    if (err != ESP_OK) return err;
+    if (!m_queue) m_queue = s21_port_queue_create(S21_CMD_QUEUE_DEPTH, sizeof(s21_cmd_t), m_queue_storage);
+    if (!m_queue) return ESP_ERR_NO_MEM;
+
+    // Start from the timing and state of the last run until the unit says otherwise
+    s21_config_load();
+    s21_config_t config = s21_config_get();
+    if (config.flags & S21_CONFIG_HAS_BIT_PERIOD) s21_port_uart_set_bit_q4(config.bit_q4);
+    if (config.flags & S21_CONFIG_HAS_STATE) {
+        m_state.power = config.power != 0;
+        m_state.mode = (uint8_t)s21_decode_mode(config.mode);
+        m_state.fan_speed = (uint8_t)s21_decode_fan(config.fan_speed);
+        m_state.target_temp = config.target_temp / 100.0f;
+        s21_port_lock();
+        m_shared_state = m_state;
+        s21_port_unlock();
+    }
+    s21_port_delay_ms(2000); 
+    return ESP_OK;
+}
+
+esp_err_t DaikinS21::SendPacket(uint8_t cmd1, uint8_t cmd2, uint8_t *payload, int len) {
+    const char cmd[2] = { (char)cmd1, (char)cmd2 };
+    return SendFrame(cmd, 2, payload, len);
+}
+
+// Send a command with a 2-character (v2) or 4-character (v3) code
+esp_err_t DaikinS21::SendFrame(const char *cmd, int cmd_len, const uint8_t *payload, int len) {
+    if (len < 0 || len > S21_MAX_PAYLOAD_LEN) return ESP_ERR_INVALID_SIZE;
+    if (cmd_len != 2 && cmd_len != 4) return ESP_ERR_INVALID_ARG;
+
+    uint8_t *buf = m_tx_buf;
+    buf[0] = STX;
+    memcpy(&buf[1], cmd, cmd_len);
+    if (len > 0) memcpy(&buf[1 + cmd_len], payload, len);
+    int frame_len = len + cmd_len + S21_FRAMING_LEN;
+    buf[frame_len - 2] = s21_checksum(buf, frame_len);
+    buf[frame_len - 1] = ETX;
+
+    // A corrupt reply is NAKed and, if the unit does not repeat it, the query is re-sent
+    // straight away instead of waiting for the next poll cycle. A query lost altogether is
+    // re-sent once, so a unit that misses every other query still answers each of them.
+    int retries_left = S21_MAX_RETRIES;
+    bool resent_silent = false;
+    esp_err_t err;
+    while (true) {
+        for (int i = 0; i < frame_len; i++) s21_port_uart_write(buf[i]);
+        err = ReadReply(retries_left);
+        if (err == ESP_ERR_TIMEOUT && !resent_silent) {
+            resent_silent = true;
+        } else if (err != ESP_ERR_INVALID_CRC || retries_left-- <= 0) {
+            break;
+        }
+        m_link_stats.retries++;
+    }
+    if (err == ESP_ERR_TIMEOUT) {
+        m_link_stats.timeouts++;
+        if (m_silent_queries < UINT8_MAX) m_silent_queries++;
+    } else {
+        m_silent_queries = 0;
+    }
+    m_last_bus_us = s21_port_time_us();
+    return err;
+}
+
+// Feed reply bytes into the parser as they arrive. Returns ESP_OK once the query is ACKed
+// (with or without a reply frame), ESP_FAIL on NAK, ESP_ERR_TIMEOUT if the unit stays
+// silent and ESP_ERR_INVALID_CRC if the reply was corrupt and should be asked for again.
+esp_err_t DaikinS21::ReadReply(int &retries_left) {
+    bool acked = false;
+    bool nacked = false;
+    uint32_t timeout_ms = S21_REPLY_TIMEOUT_MS;
+    m_parser.Reset();
+
+    while (true) {
+        int val = s21_port_uart_read(timeout_ms);
+        s21_parse_result_t res;
+        if (val >= 0) {
+            res = m_parser.Feed((uint8_t)val);
+        } else if (m_parser.InFrame()) {
+            // Truncated frame, recover the same way as from a bad checksum
+            m_parser.Reset();
+            res = S21_PARSE_BAD_FRAME;
+        } else if (nacked) {
+            // The unit did not repeat the frame we NAKed
+            return ESP_ERR_INVALID_CRC;
+        } else {
+            return acked ? ESP_OK : ESP_ERR_TIMEOUT;
+        }
+
+        switch (res) {
+        case S21_PARSE_NONE:
+            if (m_parser.InFrame()) timeout_ms = S21_BYTE_TIMEOUT_MS;
+            break;
+        case S21_PARSE_ACK:
+            acked = true;
+            m_last_ack_us = s21_port_time_us();
+            timeout_ms = S21_ACK_TIMEOUT_MS;
+            break;
+        case S21_PARSE_NAK:
+            return ESP_FAIL;
+        case S21_PARSE_FRAME:
+            s21_port_uart_write(ACK);
+            HandleFrame(m_parser.Frame(), m_parser.FrameLen());
+            return ESP_OK;
+        case S21_PARSE_BAD_FRAME:
+        case S21_PARSE_OVERFLOW:
+            if (retries_left-- <= 0) return ESP_ERR_INVALID_CRC;
+            s21_port_uart_write(NAK);
+            m_link_stats.naks_sent++;
+            nacked = true;
+            timeout_ms = S21_REPLY_TIMEOUT_MS;
+            break;
+        }
+    }
+}
+
+void DaikinS21::HandleFrame(const uint8_t *frame, int len) {
+    if (!m_connected) LinkUp();
+    const uint8_t *payload = &frame[S21_PAYLOAD_OFFSET];
+    int payload_len = len - S21_MIN_PKT_LEN;
+
+    // DEBUG DUMP (Keep this to verify mode byte)
+    if (frame[1] == 'G' && frame[2] == '1') {
+        ESP_LOG_BUFFER_HEX_LEVEL("S21 G1 RAW", frame, len, ESP_LOG_DEBUG);
+    }
+
+    if ((frame[1] == 'G' || frame[1] == 'H') && frame[2] == '1') {
+         ParseStatusG1(payload, payload_len);
+    }
+    else if (frame[1] == 'S' && frame[2] == 'H') {
+         ParseSensorsSH(payload, payload_len);
+    }
+    else if (frame[1] == 'S' && frame[2] == 'a') {
+         ParseSensorsSa(payload, payload_len);
+    }
+    else if (frame[1] == 'G' && frame[2] == '8') {
+         ParseProtocolG8(payload, payload_len);
+    }
+    else if (frame[1] == 'S' && frame[2] == 'd') {
+         ParseCompressorSd(payload, payload_len);
+    }
+    else if (frame[1] == 'S' && frame[2] == 'W') {
+         ParseErrorSW(payload, payload_len);
+    }
+    else if (frame[1] == 'S' && frame[2] == 'F') {
+         ParseFilterSF(payload, payload_len);
+    }
+    else if (frame[1] == 'S' && frame[2] == 'M') {
+         ParseRuntimeSM(payload, payload_len);
+    }
+}
+
+void DaikinS21::ParseStatusG1(const uint8_t *payload, int len) {
+    if (len < 4) return;
+    // A D1 write is still pending; the unit's old values would undo it
+    if (m_dirty) return;
+    
+    // Decode Mode: Byte 1
+    uint8_t raw_mode = payload[1];
+    uint8_t mode = (uint8_t)s21_decode_mode(raw_mode);
+    
+    bool pwr = (payload[0] == '1');
+    float t = s21_decode_target_temp(payload[2]);
+
+    // Check if something changed
+    bool changed = (m_state.power != pwr || m_state.mode != mode || m_state.target_temp != t);
+
+    // The first status read after a D1 write tells whether the unit took the values
+    if (m_trace_confirm_count > 0) {
+        bool temp_ok = (mode == FAIKIN_MODE_FAN || mode == FAIKIN_MODE_DRY) || fabs(m_state.target_temp - t) < 0.3;
+        bool applied = m_state.power == pwr && (!pwr || m_state.mode == mode) && temp_ok;
+        for (uint8_t i = 0; i < m_trace_confirm_count; i++) {
+            if (applied) s21_trace_stamp(m_trace_confirm[i], S21_TRACE_CONFIRM);
+            s21_trace_end(m_trace_confirm[i], applied ? ESP_OK : ESP_ERR_INVALID_RESPONSE);
+        }
+        m_trace_confirm_count = 0;
+    }
+    
+    if (changed) {
+        ESP_LOGI(TAG, "Status Change Detected! Pwr:%d Mode:%d (Raw:%02X)", pwr, mode, raw_mode);
+    }
+
+    m_state.power = pwr;
+    m_state.mode = mode;
+    m_state.target_temp = t;
+
+    // The first read is always notified: until then readers were shown the stored state, and
+    // whoever set them up from it is waiting to hear the unit's own
+    bool first = !m_status_read;
+    m_status_read = true;
+    if (changed || first) NotifyState();
+}
+
+void DaikinS21::ParseSensorsSH(const uint8_t *payload, int len) {
+    if (len < 4) return;
+    float room = s21_decode_float_sensor(payload);
+    if (room > 0.0 && room < 50.0) {
+        if (fabs(m_state.current_temp - room) > 0.1) {
+             ESP_LOGI(TAG, "Room Temp Update (SH): %.1f", room);
+             m_state.current_temp = room;
+             NotifyState();
+        }
+    }
+}
+
+void DaikinS21::ParseSensorsSa(const uint8_t *payload, int len) {
+    if (len < 4) return;
+    float outside = s21_decode_float_sensor(payload);
+    if (outside < -50.0 || outside > 70.0) return;
+    if (isnan(m_state.outside_temp) || fabs(m_state.outside_temp - outside) >= 0.5) {
+        ESP_LOGI(TAG, "Outside Temp Update (Sa): %.1f", outside);
+        m_state.outside_temp = outside;
+        NotifyState();
+    }
+}
+
+// Sd: compressor frequency in Hz, reversed decimal digits like the temperatures
+void DaikinS21::ParseCompressorSd(const uint8_t *payload, int len) {
+    if (len < 4) return;
+    int hz = s21_decode_int_sensor(payload);
+    if (hz < 0 || hz > 999) return;
+    // Only running or not matters to the state; the frequency itself moves all the time
+    bool was_running = m_state.compressor_hz > 0;
+    bool was_known = m_state.compressor_hz >= 0;
+    m_state.compressor_hz = (int16_t)hz;
+    if (!was_known || was_running != (hz > 0)) NotifyState();
+}
+
+// G8 carries the protocol version as ASCII digits, the major version in the second byte
+void DaikinS21::ParseProtocolG8(const uint8_t *payload, int len) {
+    if (len < 2 || payload[1] < '0' || payload[1] > '9') return;
+    m_caps.protocol_major = payload[1] - '0';
+}
+
+// SW: two-character error code, "00" when the unit is fine
+void DaikinS21::ParseErrorSW(const uint8_t *payload, int len) {
+    if (len < 2) return;
+    char code[3] = { (char)payload[0], (char)payload[1], 0 };
+    if (code[0] == '0' && code[1] == '0') code[0] = 0;
+    if (strcmp(code, m_maint.error_code) == 0) return;
+    if (code[0]) ESP_LOGW(TAG, "Unit error code %s", code);
+    else ESP_LOGI(TAG, "Unit error %s cleared", m_maint.error_code);
+    memcpy(m_maint.error_code, code, sizeof(code));
+    if (m_maint_callback) m_maint_callback(&m_maint);
+}
+
+// SF: filter hours, 4 hex digits
+void DaikinS21::ParseFilterSF(const uint8_t *payload, int len) {
+    if (len < 4) return;
+    uint16_t hours = s21_decode_hex_sensor(payload);
+    // The unit's own sign follows its counter; ours restarts at a Matter ResetCondition
+    uint16_t used = s21_filter_used_hours(hours, s21_config_get().filter_base_hours);
+    bool sign = used >= S21_FILTER_LIFE_HOURS;
+    if (m_maint.filter_known && hours == m_maint.filter_hours && sign == m_maint.filter_sign) return;
+    m_maint.filter_known = true;
+    m_maint.filter_hours = hours;
+    m_maint.filter_sign = sign;
+    if (m_maint_callback) m_maint_callback(&m_maint);
+}
+
+s21_fault_class_t s21_fault_class(const char *code) {
+    if (!code || !code[0]) return S21_FAULT_NONE;
+    static const char *const over_temp[] = { "A5", "E3", "E5", "F3", "F6", "L4" };
+    for (size_t i = 0; i < sizeof(over_temp) / sizeof(over_temp[0]); i++) {
+        if (strcmp(code, over_temp[i]) == 0) return S21_FAULT_OVER_TEMP;
+    }
+    if (strcmp(code, "P4") == 0) return S21_FAULT_SENSOR;
+    if (strcmp(code, "P1") == 0 || strcmp(code, "U2") == 0) return S21_FAULT_POWER;
+    switch (code[0]) {
+    case 'C':
+    case 'H':
+    case 'J':
+        return S21_FAULT_SENSOR;
+    case 'L':
+        return S21_FAULT_POWER;
+    default:
+        return S21_FAULT_OTHER;
+    }
+}
+
+// SM: compressor run hours, 4 hex digits
+void DaikinS21::ParseRuntimeSM(const uint8_t *payload, int len) {
+    if (len < 4) return;
+    uint16_t hours = s21_decode_hex_sensor(payload);
+    if (hours == m_maint.compressor_hours) return;
+    m_maint.compressor_hours = hours;
+    if (m_maint_callback) m_maint_callback(&m_maint);
+}
+
+void DaikinS21::ParseSensorsGH(const uint8_t *p, int l) {}
+void DaikinS21::ParseSensorsG9(const uint8_t *p, int l) {}
+
+esp_err_t DaikinS21::SendControlD1() {
+    uint8_t payload[4];
+    payload[0] = m_state.power ? '1' : '0';
+    payload[1] = s21_encode_mode(m_state.mode);
+    if (m_state.mode == FAIKIN_MODE_FAN || m_state.mode == FAIKIN_MODE_DRY)
+        payload[2] = AC_MIN_TEMP_VALUE;
+    else
+        payload[2] = (uint8_t)s21_encode_target_temp(m_state.target_temp);
+
+    payload[3] = s21_encode_fan(m_state.fan_speed);
+    for (uint8_t i = 0; i < m_trace_pending_count; i++) s21_trace_stamp(m_trace_pending[i], S21_TRACE_TX);
+    esp_err_t err = SendPacket('D', '1', payload, 4);
+    // A NAK means the unit refused the values, so only a lost or corrupt reply is retried
+    if (err == ESP_OK || err == ESP_FAIL) {
+        m_dirty = false;
+        CompleteInflight(err);
+        for (uint8_t i = 0; i < m_trace_pending_count; i++) {
+            uint16_t id = m_trace_pending[i];
+            if (err != ESP_OK) {
+                s21_trace_end(id, err);
+                continue;
+            }
+            s21_trace_stamp_at(id, S21_TRACE_ACK, m_last_ack_us);
+            if (m_trace_confirm_count < S21_CMD_QUEUE_DEPTH) m_trace_confirm[m_trace_confirm_count++] = id;
+        }
+        m_trace_pending_count = 0;
+    }
+    return err;
+}
+
+// D7 carries the demand limit in its first byte, counted down from 100 % and offset from '0',
+// and econo mode in its second
+esp_err_t DaikinS21::SendDemandD7() {
+    uint8_t payload[4];
+    payload[0] = '0' + (S21_DEMAND_MAX_PCT - m_demand.limit_pct);
+    payload[1] = m_demand.econo ? '2' : '0';
+    payload[2] = '0';
+    payload[3] = '0';
+    esp_err_t err = SendPacket('D', '7', payload, 4);
+    if (err == ESP_OK || err == ESP_FAIL) {
+        m_demand_dirty = false;
+        CompleteDemand(err);
+    }
+    return err;
+}
+
+esp_err_t DaikinS21::QueryRegister(s21_reg_t reg) {
+    return SendPacket(s_reg_cmds[reg][0], s_reg_cmds[reg][1], NULL, 0);
+}
+
+// Stop polling a register the unit NAKs, and remember that across reboots
+void DaikinS21::DropRegister(s21_reg_t reg) {
+    if (reg == S21_REG_STATUS || !HasRegister(reg)) return;
+    if (s21_port_time_us() - m_link_up_us < (int64_t)S21_LINK_SETTLE_MS * 1000) return;
+    ESP_LOGW(TAG, "Unit NAKed %c%c, no longer polling it", s_reg_cmds[reg][0], s_reg_cmds[reg][1]);
+    m_caps.regs &= ~(1UL << reg);
+    SaveCapabilities();
+    if (reg == S21_REG_COMPRESSOR && m_state.compressor_hz >= 0) {
+        m_state.compressor_hz = -1;
+        NotifyState();
+    }
+}
+
+esp_err_t DaikinS21::LoadCapabilities() {
+    s21_config_t config = s21_config_get();
+    if (!(config.flags & S21_CONFIG_HAS_CAPS)) return ESP_ERR_NOT_FOUND;
+    if (config.caps.version != S21_CAPS_VERSION) return ESP_ERR_INVALID_VERSION;
+    m_caps = config.caps;
+    return ESP_OK;
+}
+
+// Discovery is rare and a lost map means probing again, so it is written straight away
+esp_err_t DaikinS21::SaveCapabilities() {
+    s21_config_set_caps(&m_caps);
+    return s21_config_flush();
+}
+
+esp_err_t DaikinS21::ResetCapabilities() {
+    s21_config_set_caps(nullptr);
+    return s21_config_flush();
+}
+
+esp_err_t DaikinS21::DiscoverCapabilities() {
+    esp_err_t err = ProbeCapabilities();
+    // Lift any cap the unit was left with before a reboot
+    if (err == ESP_OK && HasRegister(S21_REG_ECONO)) m_demand_dirty = true;
+    // Probing reads the status before the caller has had a chance to take notifications, so
+    // the first poll's read is still the one that gets notified
+    m_status_read = false;
+    return err;
+}
+
+esp_err_t DaikinS21::ProbeCapabilities() {
+    if (LoadCapabilities() == ESP_OK) {
+        ESP_LOGI(TAG, "Using cached capabilities: v%d%s, regs 0x%08lx", m_caps.protocol_major,
+                 m_caps.v3 ? " (v3)" : "", (unsigned long)m_caps.regs);
+        return ESP_OK;
+    }
+
+    // Nothing else is worth probing until the unit answers the basic status query
+    if (QueryRegister(S21_REG_STATUS) != ESP_OK) {
+        ESP_LOGW(TAG, "Unit not answering, using default capabilities");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t regs = 1UL << S21_REG_STATUS;
+    for (int reg = S21_REG_STATUS + 1; reg < S21_REG_COUNT; reg++) {
+        s21_port_delay_ms(S21_PROBE_GAP_MS);
+        // A NAK or silence both mean the unit does not know the register
+        if (QueryRegister((s21_reg_t)reg) == ESP_OK) regs |= 1UL << reg;
+    }
+    m_caps.regs = regs;
+
+    if (m_caps.protocol_major >= 3) {
+        s21_port_delay_ms(S21_PROBE_GAP_MS);
+        m_caps.v3 = (SendFrame("FY00", 4, NULL, 0) == ESP_OK);
+    }
+
+    ESP_LOGI(TAG, "Discovered capabilities: v%d%s, regs 0x%08lx", m_caps.protocol_major,
+             m_caps.v3 ? " (v3)" : "", (unsigned long)m_caps.regs);
+    SaveCapabilities();
+    return ESP_OK;
+}
+
+// Declare the link lost once the unit stops answering, e.g. after a brown-out. Polling the
+// full register table then would spend most of each cycle on timeouts.
+void DaikinS21::CheckLink() {
+    if (!m_connected || m_silent_queries < S21_LINK_LOST_QUERIES) return;
+    m_connected = false;
+    m_link_down_us = m_last_ack_us;
+    m_link_stats.link_losses++;
+    ESP_LOGW(TAG, "Unit stopped answering, probing until it is back");
+}
+
+// First frame since start-up or a loss. Read the status straight away, so the state is
+// current within one exchange; a control write still pending goes out first.
+void DaikinS21::LinkUp() {
+    int64_t now = s21_port_time_us();
+    if (m_link_down_us != 0) {
+        uint32_t outage_ms = (uint32_t)((now - m_link_down_us) / 1000);
+        m_link_stats.last_outage_ms = outage_ms;
+        if (outage_ms > m_link_stats.max_outage_ms) m_link_stats.max_outage_ms = outage_ms;
+        ESP_LOGI(TAG, "Unit answering again after %lu ms", (unsigned long)outage_ms);
+        m_link_down_us = 0;
+    }
+    m_connected = true;
+    m_link_up_us = now;
+    m_refresh = true;
+    // A unit back from a power cut runs uncapped
+    if (m_demand.limit_pct != S21_DEMAND_MAX_PCT || m_demand.econo) m_demand_dirty = true;
+}
+
+void DaikinS21::Poll() {
+    CheckLink();
+    if (!m_connected) {
+        Gap();
+        SendPacket('F', '8', NULL, 0);
+        Gap();
+        SendPacket('F', '1', NULL, 0); 
+        return; 
+    }
+    FlushCommands();
+
+    for (size_t i = 0; i < sizeof(s_poll_table) / sizeof(s_poll_table[0]); i++) {
+        const s21_poll_entry_t *entry = &s_poll_table[i];
+        if (m_poll_cycle % entry->every != 0 || !HasRegister(entry->reg)) continue;
+        Gap();
+        FlushCommands();
+        if (QueryRegister(entry->reg) == ESP_FAIL) DropRegister(entry->reg);
+    }
+    if (m_poll_cycle % S21_MAINT_EVERY == 0) PollMaintenance();
+    m_poll_cycle++;
+    uint32_t bit_q4 = s21_port_uart_get_bit_q4();
+    if (bit_q4) s21_config_set_bit_q4(bit_q4);
+}
+
+// Read the next supported maintenance register, after any control traffic that is waiting
+void DaikinS21::PollMaintenance() {
+    const int count = sizeof(s_maint_regs) / sizeof(s_maint_regs[0]);
+    for (int i = 0; i < count; i++) {
+        s21_reg_t reg = s_maint_regs[m_maint_next];
+        m_maint_next = (m_maint_next + 1) % count;
+        if (!HasRegister(reg)) continue;
+        Gap();
+        FlushCommands();
+        if (QueryRegister(reg) == ESP_FAIL) DropRegister(reg);
+        return;
+    }
+}
+
+void DaikinS21::Idle(uint32_t ms) {
+    int64_t until_us = s21_port_time_us() + (int64_t)ms * 1000;
+    while (WaitCommands(until_us, true)) FlushCommands();
+}
+
+// Take commands off the queue until until_us. With wake_on_work, returns true as soon as
+// there is something to send and the bus gap allows it; returns false once until_us passes.
+bool DaikinS21::WaitCommands(int64_t until_us, bool wake_on_work) {
+    while (true) {
+        ExpireInflight();
+        int64_t now = s21_port_time_us();
+        int64_t end = until_us;
+        bool work = wake_on_work && (m_dirty || m_refresh || m_demand_dirty);
+        if (work) {
+            int64_t ready = m_last_bus_us + (int64_t)S21_QUERY_GAP_MS * 1000;
+            if (ready <= now) return true;
+            if (ready < end) end = ready;
+        }
+        if (now >= end) return work && end < until_us;
+        uint32_t wait_ms = (uint32_t)((end - now + 999) / 1000);
+        s21_cmd_t cmd;
+        if (!m_queue) s21_port_delay_ms(wait_ms);
+        else if (s21_port_queue_receive(m_queue, &cmd, wait_ms)) AcceptCommand(&cmd);
+    }
+}
+
+// Keep the bus quiet between two exchanges, queueing any commands that arrive meanwhile
+void DaikinS21::Gap() {
+    WaitCommands(m_last_bus_us + (int64_t)S21_QUERY_GAP_MS * 1000, false);
+}
+
+// Send whatever the queued commands asked for
+void DaikinS21::FlushCommands() {
+    if (m_demand_dirty) {
+        Gap();
+        SendDemandD7();
+    }
+    if (m_dirty) {
+        Gap();
+        SendControlD1();
+    }
+    if (m_refresh) {
+        m_refresh = false;
+        Gap();
+        QueryRegister(S21_REG_STATUS);
+    }
+}
+
+void DaikinS21::AcceptCommand(const s21_cmd_t *cmd) {
+    if (cmd->type == S21_CMD_REFRESH) {
+        m_refresh = true;
+        if (cmd->done) cmd->done(ESP_OK, cmd->ctx);
+        return;
+    }
+    if (cmd->type == S21_CMD_DEMAND) {
+        AcceptDemand(cmd);
+        return;
+    }
+    uint16_t trace_id = cmd->control.trace_id;
+    s21_trace_stamp(trace_id, S21_TRACE_DEQUEUE);
+    MergeControl(&cmd->control);
+    // Submit() showed these values to readers, but a state notification since may have put
+    // the unit's old ones back; with no change left to notify, they would stay there
+    s21_port_lock();
+    m_shared_state = m_state;
+    s21_port_unlock();
+    if (trace_id && !m_dirty) {
+        s21_trace_end(trace_id, ESP_OK);
+    } else if (trace_id && m_trace_pending_count < S21_CMD_QUEUE_DEPTH) {
+        m_trace_pending[m_trace_pending_count++] = trace_id;
+    }
+    if (!cmd->done) return;
+    if (!m_dirty) {
+        // Nothing the unit does not already have
+        cmd->done(ESP_OK, cmd->ctx);
+    } else if (m_inflight_count < S21_CMD_QUEUE_DEPTH) {
+        m_inflight[m_inflight_count++] = *cmd;
+    } else {
+        // The change still goes out; only its completion cannot be tracked
+        cmd->done(ESP_ERR_NO_MEM, cmd->ctx);
+    }
+}
+
+void DaikinS21::AcceptDemand(const s21_cmd_t *cmd) {
+    if (!HasRegister(S21_REG_ECONO)) {
+        if (cmd->done) cmd->done(ESP_ERR_NOT_SUPPORTED, cmd->ctx);
+        return;
+    }
+    // Replaced before it went out
+    CompleteDemand(ESP_ERR_INVALID_STATE);
+    if (cmd->demand.limit_pct != m_demand.limit_pct || cmd->demand.econo != m_demand.econo) {
+        m_demand = cmd->demand;
+        m_demand_dirty = true;
+    }
+    if (!cmd->done) return;
+    if (!m_demand_dirty) {
+        cmd->done(ESP_OK, cmd->ctx);
+        return;
+    }
+    m_demand_cmd = *cmd;
+    m_demand_waiting = true;
+}
+
+void DaikinS21::CompleteDemand(esp_err_t result) {
+    if (!m_demand_waiting) return;
+    m_demand_waiting = false;
+    m_demand_cmd.done(result, m_demand_cmd.ctx);
+}
+
+void DaikinS21::CompleteInflight(esp_err_t result) {
+    uint8_t count = m_inflight_count;
+    m_inflight_count = 0;
+    for (uint8_t i = 0; i < count; i++) m_inflight[i].done(result, m_inflight[i].ctx);
+}
+
+void DaikinS21::ExpireInflight() {
+    int64_t now = s21_port_time_us();
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < m_inflight_count; i++) {
+        if (m_inflight[i].deadline_us <= now) {
+            ESP_LOGW(TAG, "Control command timed out before the unit accepted it");
+            m_inflight[i].done(ESP_ERR_TIMEOUT, m_inflight[i].ctx);
+            s21_trace_end(m_inflight[i].control.trace_id, ESP_ERR_TIMEOUT);
+        } else {
+            m_inflight[kept++] = m_inflight[i];
+        }
+    }
+    m_inflight_count = kept;
+    if (m_demand_waiting && m_demand_cmd.deadline_us <= now) {
+        ESP_LOGW(TAG, "Demand limit timed out before the unit accepted it");
+        CompleteDemand(ESP_ERR_TIMEOUT);
+    }
+}
+
+void DaikinS21::UpdateMemStats(uint32_t heap_before) {
+    uint32_t heap_after = s21_port_heap_free();
+    m_mem_stats.stack_hwm_bytes = s21_port_stack_free();
+    m_mem_stats.heap_free_bytes = heap_after;
+    m_mem_stats.heap_min_free_bytes = s21_port_heap_min_free();
+    m_mem_stats.heap_delta_bytes = (int32_t)heap_after - (int32_t)heap_before;
+    if (m_mem_stats.heap_delta_bytes != 0) m_mem_stats.heap_delta_cycles++;
+    m_mem_stats.poll_cycles++;
+}
+
+s21_link_stats_t DaikinS21::GetLinkStats() const {
+    s21_link_stats_t stats = m_link_stats;
+    stats.parser = m_parser.GetStats();
+    s21_port_uart_get_stats(&stats.uart);
+    return stats;
+}
+
+// Setters
+esp_err_t DaikinS21::SetPower(bool on) { s21_control_t c = {}; c.fields = S21_CTRL_POWER; c.power = on; return ApplyControl(&c); }
+esp_err_t DaikinS21::SetMode(uint8_t mode) { s21_control_t c = {}; c.fields = S21_CTRL_MODE; c.mode = mode; return ApplyControl(&c); }
+esp_err_t DaikinS21::SetTemp(float temp) { s21_control_t c = {}; c.fields = S21_CTRL_TEMP; c.target_temp = temp; return ApplyControl(&c); }
+esp_err_t DaikinS21::SetFan(uint8_t fan) { s21_control_t c = {}; c.fields = S21_CTRL_FAN; c.fan_speed = fan; return ApplyControl(&c); }
+
+esp_err_t DaikinS21::ApplyControl(const s21_control_t *ctrl, s21_cmd_done_cb_t done, void *ctx, uint32_t timeout_ms) {
+    s21_cmd_t cmd = {};
+    cmd.type = S21_CMD_CONTROL;
+    cmd.control = *ctrl;
+    cmd.deadline_us = s21_port_time_us() + (int64_t)timeout_ms * 1000;
+    cmd.done = done;
+    cmd.ctx = ctx;
+    return Submit(&cmd);
+}
+
+esp_err_t DaikinS21::ApplyDemand(const s21_demand_t *demand, s21_cmd_done_cb_t done, void *ctx, uint32_t timeout_ms) {
+    if (demand->limit_pct < S21_DEMAND_MIN_PCT || demand->limit_pct > S21_DEMAND_MAX_PCT) return ESP_ERR_INVALID_ARG;
+    s21_cmd_t cmd = {};
+    cmd.type = S21_CMD_DEMAND;
+    cmd.demand = *demand;
+    cmd.urgent = true;
+    cmd.deadline_us = s21_port_time_us() + (int64_t)timeout_ms * 1000;
+    cmd.done = done;
+    cmd.ctx = ctx;
+    return Submit(&cmd);
+}
+
+esp_err_t DaikinS21::Submit(const s21_cmd_t *cmd) {
+    if (!m_queue) return ESP_ERR_INVALID_STATE;
+    if (cmd->type == S21_CMD_CONTROL) s21_trace_stamp(cmd->control.trace_id, S21_TRACE_ENQUEUE);
+    bool queued = cmd->urgent ? s21_port_queue_send_front(m_queue, cmd) : s21_port_queue_send(m_queue, cmd);
+    if (!queued) {
+        if (cmd->type == S21_CMD_CONTROL) s21_trace_end(cmd->control.trace_id, ESP_ERR_NO_MEM);
+        ESP_LOGW(TAG, "Command queue full, dropping command");
+        return ESP_ERR_NO_MEM;
+    }
+    // Show the requested values to readers straight away; the next status read confirms them
+    if (cmd->type == S21_CMD_CONTROL) {
+        const s21_control_t *c = &cmd->control;
+        s21_port_lock();
+        if (c->fields & S21_CTRL_POWER) m_shared_state.power = c->power;
+        if (c->fields & S21_CTRL_MODE) m_shared_state.mode = c->mode;
+        if (c->fields & S21_CTRL_TEMP) m_shared_state.target_temp = c->target_temp;
+        if (c->fields & S21_CTRL_FAN) m_shared_state.fan_speed = c->fan_speed;
+        s21_port_unlock();
+    } else if (cmd->type == S21_CMD_DEMAND) {
+        s21_port_lock();
+        m_shared_demand = cmd->demand;
+        s21_port_unlock();
+    }
+    return ESP_OK;
+}
+
+// Driver task only
+void DaikinS21::MergeControl(const s21_control_t *ctrl) {
+    if ((ctrl->fields & S21_CTRL_POWER) && m_state.power != ctrl->power) { m_state.power = ctrl->power; m_dirty = true; }
+    if ((ctrl->fields & S21_CTRL_MODE) && m_state.mode != ctrl->mode) { m_state.mode = ctrl->mode; m_dirty = true; }
+    if ((ctrl->fields & S21_CTRL_TEMP) && fabs(m_state.target_temp - ctrl->target_temp) > 0.1) { m_state.target_temp = ctrl->target_temp; m_dirty = true; }
+    if (ctrl->fields & S21_CTRL_FAN) { m_state.fan_speed = ctrl->fan_speed; m_dirty = true; }
+}
+
+ac_state_t DaikinS21::GetState() const {
+    s21_port_lock();
+    ac_state_t state = m_shared_state;
+    s21_port_unlock();
+    return state;
+}
+
+s21_demand_t DaikinS21::GetDemand() const {
+    s21_port_lock();
+    s21_demand_t demand = m_shared_demand;
+    s21_port_unlock();
+    return demand;
+}
+
+// Publish m_state to other tasks, then tell the application
+void DaikinS21::NotifyState() {
+    s21_port_lock();
+    m_shared_state = m_state;
+    s21_port_unlock();
+    s21_config_set_state(&m_state);
+    if (m_callback) m_callback(&m_state);
+}
+
+void DaikinS21::SetStateCallback(s21_state_change_cb_t cb) { m_callback = cb; }
+void DaikinS21::SetMaintCallback(s21_maint_change_cb_t cb) { m_maint_callback = cb; }
\ No newline at end of file
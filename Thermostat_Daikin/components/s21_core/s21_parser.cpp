@@ -0,0 +1,51 @@
+#include "s21_parser.h"
+#include <string.h>
+
+S21Parser::S21Parser() {
+    memset(&m_stats, 0, sizeof(m_stats));
+    Reset();
+}
+
+void S21Parser::Reset() {
+    m_len = 0;
+    m_in_frame = false;
+    m_overflow = false;
+}
+
+s21_parse_result_t S21Parser::Feed(uint8_t byte) {
+    if (byte == STX) {
+        if (m_in_frame) m_stats.resyncs++;
+        m_buf[0] = STX;
+        m_len = 1;
+        m_in_frame = true;
+        m_overflow = false;
+        return S21_PARSE_NONE;
+    }
+
+    if (!m_in_frame) {
+        if (byte == ACK) return S21_PARSE_ACK;
+        if (byte == NAK) return S21_PARSE_NAK;
+        m_stats.noise++;
+        return S21_PARSE_NONE;
+    }
+
+    if (m_len < S21_MAX_PKT_LEN) {
+        m_buf[m_len++] = byte;
+    } else {
+        m_overflow = true;
+    }
+    if (byte != ETX) return S21_PARSE_NONE;
+
+    m_in_frame = false;
+    if (m_overflow) {
+        m_stats.overflows++;
+        m_len = 0;
+        return S21_PARSE_OVERFLOW;
+    }
+    if (m_len < S21_MIN_PKT_LEN || s21_checksum(m_buf, m_len) != m_buf[m_len - 2]) {
+        m_stats.bad_frames++;
+        return S21_PARSE_BAD_FRAME;
+    }
+    m_stats.frames++;
+    return S21_PARSE_FRAME;
+}
@@ -0,0 +1,185 @@
+#include "s21_peer.h"
+#include <string.h>
+#include <math.h>
+
+// Header: magic "SP", version, type, unit ID, sequence number, tag
+#define PEER_MAGIC0 'S'
+#define PEER_MAGIC1 'P'
+#define PEER_MAC_OFFSET  12
+#define PEER_HEADER_LEN  (PEER_MAC_OFFSET + S21_PEER_MAC_LEN)
+#define PEER_STATE_LEN   (PEER_HEADER_LEN + 10)
+#define PEER_CONTROL_LEN (PEER_HEADER_LEN + 8)
+
+// State flags
+#define PEER_FLAG_POWER   0x01
+#define PEER_FLAG_OUTSIDE 0x02 // outside_temp is valid
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+static void sip_round(uint64_t v[4]) {
+    v[0] += v[1]; v[1] = rotl(v[1], 13); v[1] ^= v[0]; v[0] = rotl(v[0], 32);
+    v[2] += v[3]; v[3] = rotl(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = rotl(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = rotl(v[1], 17); v[1] ^= v[2]; v[2] = rotl(v[2], 32);
+}
+
+uint64_t s21_peer_siphash(const uint8_t key[S21_PEER_KEY_LEN], const uint8_t *data, size_t len) {
+    uint64_t k0 = get_u64(key), k1 = get_u64(&key[8]);
+    uint64_t v[4] = { k0 ^ 0x736f6d6570736575ULL, k1 ^ 0x646f72616e646f6dULL,
+                      k0 ^ 0x6c7967656e657261ULL, k1 ^ 0x7465646279746573ULL };
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t m = get_u64(&data[i]);
+        v[3] ^= m;
+        sip_round(v);
+        sip_round(v);
+        v[0] ^= m;
+    }
+    uint64_t m = (uint64_t)len << 56;
+    for (size_t j = 0; i + j < len; j++) m |= (uint64_t)data[i + j] << (8 * j);
+    v[3] ^= m;
+    sip_round(v);
+    sip_round(v);
+    v[0] ^= m;
+    v[2] ^= 0xff;
+    for (int r = 0; r < 4; r++) sip_round(v);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// Tag of a datagram, over everything but the tag itself
+static uint64_t peer_mac(const uint8_t key[S21_PEER_KEY_LEN], const uint8_t *buf, size_t len) {
+    uint8_t copy[S21_PEER_MAX_MSG_LEN];
+    if (len > sizeof(copy)) len = sizeof(copy);
+    memcpy(copy, buf, len);
+    memset(&copy[PEER_MAC_OFFSET], 0, S21_PEER_MAC_LEN);
+    return s21_peer_siphash(key, copy, len);
+}
+
+static int16_t to_c100(float c) {
+    float v = roundf(c * 100.0f);
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < INT16_MIN + 1) return INT16_MIN + 1;
+    return (int16_t)v;
+}
+
+static float from_c100(uint16_t raw) {
+    return (int16_t)raw / 100.0f;
+}
+
+size_t s21_peer_encode(const s21_peer_msg_t *msg, const uint8_t key[S21_PEER_KEY_LEN], uint8_t *buf, size_t len) {
+    size_t need = (msg->type == S21_PEER_MSG_STATE) ? PEER_STATE_LEN : PEER_CONTROL_LEN;
+    if (len < need) return 0;
+    buf[0] = PEER_MAGIC0;
+    buf[1] = PEER_MAGIC1;
+    buf[2] = S21_PEER_VERSION;
+    buf[3] = (uint8_t)msg->type;
+    memcpy(&buf[4], msg->unit_id, S21_PEER_UNIT_ID_LEN);
+    put_u16(&buf[10], msg->seq);
+    uint8_t *p = &buf[PEER_HEADER_LEN];
+
+    if (msg->type == S21_PEER_MSG_STATE) {
+        const ac_state_t *s = &msg->state;
+        bool outside = !isnan(s->outside_temp);
+        p[0] = (s->power ? PEER_FLAG_POWER : 0) | (outside ? PEER_FLAG_OUTSIDE : 0);
+        p[1] = s->mode;
+        p[2] = s->fan_speed;
+        p[3] = 0;
+        put_u16(&p[4], (uint16_t)to_c100(s->target_temp));
+        put_u16(&p[6], (uint16_t)to_c100(s->current_temp));
+        put_u16(&p[8], (uint16_t)(outside ? to_c100(s->outside_temp) : 0));
+    } else {
+        const s21_control_t *c = &msg->control;
+        p[0] = c->fields;
+        p[1] = c->power ? 1 : 0;
+        p[2] = c->mode;
+        p[3] = c->fan_speed;
+        put_u16(&p[4], (uint16_t)to_c100(c->target_temp));
+        put_u16(&p[6], msg->ack_seq);
+    }
+    uint64_t mac = peer_mac(key, buf, need);
+    for (int i = 0; i < S21_PEER_MAC_LEN; i++) buf[PEER_MAC_OFFSET + i] = (uint8_t)(mac >> (8 * i));
+    return need;
+}
+
+esp_err_t s21_peer_decode(const uint8_t *buf, size_t len, const uint8_t key[S21_PEER_KEY_LEN], s21_peer_msg_t *msg) {
+    if (len < PEER_HEADER_LEN || buf[0] != PEER_MAGIC0 || buf[1] != PEER_MAGIC1) return ESP_ERR_INVALID_RESPONSE;
+    if (buf[2] != S21_PEER_VERSION) return ESP_ERR_INVALID_VERSION;
+    // Longer than any sender builds, so it was not signed by one
+    if (len > S21_PEER_MAX_MSG_LEN) return ESP_ERR_INVALID_SIZE;
+    // Compare the whole tag whatever the first difference, so its timing tells nothing
+    uint64_t diff = peer_mac(key, buf, len) ^ get_u64(&buf[PEER_MAC_OFFSET]);
+    if (diff != 0) return ESP_ERR_INVALID_CRC;
+    memset(msg, 0, sizeof(*msg));
+    msg->type = (s21_peer_msg_type_t)buf[3];
+    memcpy(msg->unit_id, &buf[4], S21_PEER_UNIT_ID_LEN);
+    msg->seq = get_u16(&buf[10]);
+    const uint8_t *p = &buf[PEER_HEADER_LEN];
+
+    if (msg->type == S21_PEER_MSG_STATE) {
+        if (len < PEER_STATE_LEN) return ESP_ERR_INVALID_SIZE;
+        ac_state_t *s = &msg->state;
+        s->power = (p[0] & PEER_FLAG_POWER) != 0;
+        s->mode = p[1];
+        s->fan_speed = p[2];
+        s->target_temp = from_c100(get_u16(&p[4]));
+        s->current_temp = from_c100(get_u16(&p[6]));
+        s->outside_temp = (p[0] & PEER_FLAG_OUTSIDE) ? from_c100(get_u16(&p[8])) : NAN;
+        s->compressor_hz = -1;
+        return ESP_OK;
+    }
+    if (msg->type == S21_PEER_MSG_CONTROL) {
+        if (len < PEER_CONTROL_LEN) return ESP_ERR_INVALID_SIZE;
+        s21_control_t *c = &msg->control;
+        c->fields = p[0];
+        c->power = p[1] != 0;
+        c->mode = p[2];
+        c->fan_speed = p[3];
+        c->target_temp = from_c100(get_u16(&p[4]));
+        msg->ack_seq = get_u16(&p[6]);
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool s21_peer_seq_newer(uint16_t seq, uint16_t last) {
+    return (int16_t)(seq - last) > 0;
+}
+
+esp_err_t s21_peer_guard_check(s21_peer_guard_t *guard, const s21_peer_msg_t *msg,
+                               const uint8_t addr[S21_PEER_ADDR_LEN], uint16_t publish_seq, int64_t now_us) {
+    if (guard->has_bridge && now_us - guard->bridge_seen_us >= (int64_t)S21_PEER_BRIDGE_FORGET_S * 1000000) {
+        guard->has_bridge = false;
+    }
+    if (guard->has_bridge && memcmp(addr, guard->bridge_addr, S21_PEER_ADDR_LEN) != 0) return ESP_ERR_INVALID_STATE;
+    // Echoes a state from before the window, from an earlier boot, or one not sent yet
+    if ((uint16_t)(publish_seq - msg->ack_seq) >= S21_PEER_ACK_WINDOW) return ESP_ERR_INVALID_RESPONSE;
+    if (guard->has_last) {
+        bool newer = s21_peer_seq_newer(msg->ack_seq, guard->last_ack_seq) ||
+                     (msg->ack_seq == guard->last_ack_seq && s21_peer_seq_newer(msg->seq, guard->last_seq));
+        if (!newer) return ESP_ERR_INVALID_RESPONSE;
+    }
+    guard->has_bridge = true;
+    memcpy(guard->bridge_addr, addr, S21_PEER_ADDR_LEN);
+    guard->bridge_seen_us = now_us;
+    guard->has_last = true;
+    guard->last_ack_seq = msg->ack_seq;
+    guard->last_seq = msg->seq;
+    return ESP_OK;
+}
@@ -0,0 +1,371 @@
+#include "s21_sim.h"
+#include <string.h>
+#include <math.h>
+#include "daikin_s21.h"
+#include "s21_parser.h"
+
+// Room temperature moves towards the setpoint this fast while the unit runs
+#define SIM_ROOM_STEP_C      0.1f
+#define SIM_ROOM_STEP_US     (60LL * 1000000)
+#define SIM_OUTSIDE_TEMP     12.0f
+#define SIM_FILTER_HOURS     120
+#define SIM_COMPRESSOR_HOURS 3456
+#define SIM_COMPRESSOR_MIN_HZ 20
+#define SIM_COMPRESSOR_MAX_HZ 90
+
+static s21_sim_faults_t s_faults;
+static s21_sim_stats_t s_stats;
+static uint32_t s_rng;
+static int64_t s_epoch_us;       // Outage periods count from here
+static uint32_t s_outage_seen;   // Outage periods the unit has come back from
+static ac_state_t s_unit;
+static s21_demand_t s_demand;
+static int64_t s_room_us;        // When the room temperature last moved
+static char s_error_code[3];     // RW reply, "00" for none
+static int s_compressor_hz;      // Rd reply, or S21_SIM_COMPRESSOR_AUTO / _NONE
+static uint16_t s_filter_hours;
+static uint32_t s_query_count;
+
+// Frame being received from the driver
+static uint8_t s_rx[S21_MAX_PKT_LEN];
+static int s_rx_len;
+static bool s_rx_in_frame;
+
+// Bytes on their way to the driver; byte i arrives at s_tx_start_us + i * S21_SIM_CHAR_US
+static uint8_t s_tx[S21_MAX_PKT_LEN + 1];
+static int s_tx_len;
+static int s_tx_pos;
+static int64_t s_tx_start_us;
+// Last reply frame, repeated when the driver NAKs it
+static uint8_t s_last[S21_MAX_PKT_LEN];
+static int s_last_len;
+
+// xorshift32; good enough to spread faults, and repeatable from the seed
+static uint32_t sim_random(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static bool sim_chance(uint8_t pct) {
+    return pct > 0 && sim_random() % 100 < pct;
+}
+
+static void unit_defaults(int64_t now_us) {
+    s_unit.power = false;
+    s_unit.mode = FAIKIN_MODE_COOL;
+    s_unit.target_temp = 24.0f;
+    s_unit.current_temp = 26.0f;
+    s_unit.outside_temp = SIM_OUTSIDE_TEMP;
+    s_unit.fan_speed = FAIKIN_FAN_AUTO;
+    s_demand.limit_pct = S21_DEMAND_MAX_PCT;
+    s_demand.econo = false;
+    s_room_us = now_us;
+    memcpy(s_error_code, "00", sizeof(s_error_code));
+    s_filter_hours = SIM_FILTER_HOURS;
+    s_compressor_hz = S21_SIM_COMPRESSOR_AUTO;
+}
+
+void s21_sim_reset(const s21_sim_faults_t *faults, uint32_t seed, int64_t now_us) {
+    s21_sim_set_faults(faults);
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_rng = seed ? seed : 1;
+    s_epoch_us = now_us;
+    s_outage_seen = 0;
+    s_query_count = 0;
+    s_rx_len = 0;
+    s_rx_in_frame = false;
+    s_tx_len = s_tx_pos = 0;
+    s_last_len = 0;
+    unit_defaults(now_us);
+}
+
+void s21_sim_set_faults(const s21_sim_faults_t *faults) {
+    if (faults) s_faults = *faults;
+    else memset(&s_faults, 0, sizeof(s_faults));
+}
+
+typedef struct {
+    const char *name;
+    s21_sim_faults_t faults;
+} sim_profile_t;
+
+static const sim_profile_t s_profiles[] = {
+    { "clean",       { 0, 0, 0, 0, 0, 0, 0 } },
+    { "lost-ack",    { 20, 0, 0, 0, 0, 0, 0 } },
+    { "truncated",   { 0, 20, 0, 0, 0, 0, 0 } },
+    { "checksum",    { 0, 0, 20, 0, 0, 0, 0 } },
+    { "every-other", { 0, 0, 0, 2, 0, 0, 0 } },
+    { "brownout",    { 0, 0, 0, 0, 600, 45, 5 } },
+    { "mixed",       { 5, 5, 5, 0, 1800, 30, 5 } },
+};
+
+bool s21_sim_profile(const char *name, s21_sim_faults_t *faults) {
+    for (size_t i = 0; i < sizeof(s_profiles) / sizeof(s_profiles[0]); i++) {
+        if (strcmp(name, s_profiles[i].name) == 0) {
+            *faults = s_profiles[i].faults;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Position in the brown-out cycle: outages end each period, and the unit boots at its start
+static int64_t outage_phase_us(int64_t now_us, uint32_t *period) {
+    int64_t every_us = (int64_t)s_faults.outage_every_s * 1000000;
+    int64_t since = now_us - s_epoch_us;
+    if (since < 0) since = 0;
+    *period = (uint32_t)(since / every_us);
+    return since % every_us;
+}
+
+bool s21_sim_in_outage(int64_t now_us) {
+    if (s_faults.outage_every_s == 0 || s_faults.outage_s >= s_faults.outage_every_s) return false;
+    uint32_t period;
+    int64_t phase = outage_phase_us(now_us, &period);
+    return phase >= (int64_t)(s_faults.outage_every_s - s_faults.outage_s) * 1000000;
+}
+
+// Called with each query outside an outage. Returns true while the unit is still booting.
+static bool sim_booting(int64_t now_us) {
+    if (s_faults.outage_every_s == 0 || s_faults.outage_s >= s_faults.outage_every_s) return false;
+    uint32_t period;
+    int64_t phase = outage_phase_us(now_us, &period);
+    if (period > s_outage_seen) {
+        // First query since the power came back: the unit has forgotten its settings
+        s_outage_seen = period;
+        s_stats.outages++;
+        unit_defaults(now_us);
+    }
+    return period > 0 && phase < (int64_t)s_faults.boot_nak_s * 1000000;
+}
+
+static void move_room(int64_t now_us) {
+    while (now_us - s_room_us >= SIM_ROOM_STEP_US) {
+        s_room_us += SIM_ROOM_STEP_US;
+        if (!s_unit.power) continue;
+        float diff = s_unit.target_temp - s_unit.current_temp;
+        if (fabsf(diff) >= SIM_ROOM_STEP_C) s_unit.current_temp += diff > 0 ? SIM_ROOM_STEP_C : -SIM_ROOM_STEP_C;
+    }
+}
+
+static void queue_bytes(const uint8_t *bytes, int len, int64_t now_us) {
+    if (len > (int)sizeof(s_tx)) len = sizeof(s_tx);
+    memcpy(s_tx, bytes, len);
+    s_tx_len = len;
+    s_tx_pos = 0;
+    s_tx_start_us = now_us + (int64_t)S21_SIM_REPLY_DELAY_MS * 1000;
+}
+
+static void queue_nak(int64_t now_us) {
+    uint8_t nak = NAK;
+    queue_bytes(&nak, 1, now_us);
+}
+
+// Sensor values travel as reversed decimal digits with the sign last, e.g. 23.5 as "532+"
+static void encode_float_sensor(float value, uint8_t *out) {
+    int v = (int)lroundf(value * 10.0f);
+    out[3] = v < 0 ? '-' : '+';
+    if (v < 0) v = -v;
+    out[0] = '0' + v % 10;
+    out[1] = '0' + (v / 10) % 10;
+    out[2] = '0' + (v / 100) % 10;
+}
+
+static void encode_int_sensor(int value, uint8_t *out) {
+    out[3] = value < 0 ? '-' : '+';
+    if (value < 0) value = -value;
+    out[0] = '0' + value % 10;
+    out[1] = '0' + (value / 10) % 10;
+    out[2] = '0' + (value / 100) % 10;
+}
+
+// The compressor runs while the room is short of the setpoint, faster the further off it is
+static int compressor_hz(void) {
+    if (s_compressor_hz != S21_SIM_COMPRESSOR_AUTO) return s_compressor_hz;
+    float diff = s_unit.target_temp - s_unit.current_temp;
+    bool running = s_unit.power && ((s_unit.mode == FAIKIN_MODE_HEAT && diff >= SIM_ROOM_STEP_C) ||
+                                    (s_unit.mode == FAIKIN_MODE_COOL && -diff >= SIM_ROOM_STEP_C));
+    if (!running) return 0;
+    int hz = SIM_COMPRESSOR_MIN_HZ + (int)(fabsf(diff) * 10.0f);
+    return hz > SIM_COMPRESSOR_MAX_HZ ? SIM_COMPRESSOR_MAX_HZ : hz;
+}
+
+static void encode_hex_sensor(uint16_t value, uint8_t *out) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (int i = 0; i < 4; i++) out[i] = digits[(value >> (4 * i)) & 0xF];
+}
+
+static void apply_d1(const uint8_t *p) {
+    s_unit.power = p[0] == '1';
+    s_unit.mode = (uint8_t)s21_decode_mode(p[1]);
+    if (s_unit.mode != FAIKIN_MODE_FAN && s_unit.mode != FAIKIN_MODE_DRY) {
+        s_unit.target_temp = s21_decode_target_temp(p[2]);
+    }
+    s_unit.fan_speed = (uint8_t)s21_decode_fan(p[3]);
+    s_stats.writes++;
+}
+
+static void apply_d7(const uint8_t *p) {
+    int limit = S21_DEMAND_MAX_PCT - (p[0] - '0');
+    if (limit >= S21_DEMAND_MIN_PCT && limit <= S21_DEMAND_MAX_PCT) s_demand.limit_pct = (uint8_t)limit;
+    s_demand.econo = p[1] == '2';
+}
+
+static void handle_query(int64_t now_us) {
+    s_stats.queries++;
+    if (s_rx_len < S21_MIN_PKT_LEN || s21_checksum(s_rx, s_rx_len) != s_rx[s_rx_len - 2]) {
+        s_stats.bad_queries++;
+        queue_nak(now_us);
+        return;
+    }
+    if (sim_booting(now_us)) {
+        s_stats.boot_naks++;
+        queue_nak(now_us);
+        return;
+    }
+    s_query_count++;
+    if (s_faults.answer_every > 1 && s_query_count % s_faults.answer_every != 0) {
+        s_stats.skipped++;
+        return;
+    }
+    if (sim_chance(s_faults.drop_pct)) {
+        s_stats.dropped++;
+        return;
+    }
+    move_room(now_us);
+
+    const uint8_t *payload = &s_rx[S21_PAYLOAD_OFFSET];
+    int payload_len = s_rx_len - S21_MIN_PKT_LEN;
+    uint8_t reply[4];
+    int reply_len = 4;
+    uint8_t c0 = s_rx[S21_CMD0_OFFSET], c1 = s_rx[S21_CMD1_OFFSET];
+    if (c0 == 'D' && c1 == '1' && payload_len >= 4) {
+        apply_d1(payload);
+        reply_len = 0;
+    } else if (c0 == 'D' && c1 == '7' && payload_len >= 2) {
+        apply_d7(payload);
+        reply_len = 0;
+    } else if (c0 == 'F' && c1 == '1') {
+        reply[0] = s_unit.power ? '1' : '0';
+        reply[1] = s21_encode_mode(s_unit.mode);
+        reply[2] = (uint8_t)s21_encode_target_temp(s_unit.target_temp);
+        reply[3] = s21_encode_fan(s_unit.fan_speed);
+    } else if (c0 == 'F' && c1 == '7') {
+        reply[0] = (uint8_t)('0' + S21_DEMAND_MAX_PCT - s_demand.limit_pct);
+        reply[1] = s_demand.econo ? '2' : '0';
+        reply[2] = '0';
+        reply[3] = '0';
+    } else if (c0 == 'F' && c1 == '8') {
+        memcpy(reply, "0200", 4);
+    } else if (c0 == 'R' && c1 == 'H') {
+        encode_float_sensor(s_unit.current_temp, reply);
+    } else if (c0 == 'R' && c1 == 'a') {
+        encode_float_sensor(s_unit.outside_temp, reply);
+    } else if (c0 == 'R' && c1 == 'd' && s_compressor_hz != S21_SIM_COMPRESSOR_NONE) {
+        encode_int_sensor(compressor_hz(), reply);
+    } else if (c0 == 'R' && c1 == 'W') {
+        memcpy(reply, s_error_code, 2);
+        memcpy(&reply[2], "00", 2);
+    } else if (c0 == 'R' && c1 == 'F') {
+        encode_hex_sensor(s_filter_hours, reply);
+    } else if (c0 == 'R' && c1 == 'M') {
+        encode_hex_sensor(SIM_COMPRESSOR_HOURS, reply);
+    } else {
+        // Registers a basic v2 unit does not have
+        queue_nak(now_us);
+        return;
+    }
+
+    uint8_t out[S21_MAX_PKT_LEN + 1];
+    int len = 0;
+    out[len++] = ACK;
+    if (reply_len > 0) {
+        uint8_t *frame = &out[len];
+        frame[0] = STX;
+        frame[1] = (uint8_t)(c0 + 1); // F1 -> G1, RH -> SH
+        frame[2] = c1;
+        memcpy(&frame[3], reply, reply_len);
+        int frame_len = reply_len + S21_MIN_PKT_LEN;
+        frame[frame_len - 2] = s21_checksum(frame, frame_len);
+        frame[frame_len - 1] = ETX;
+        memcpy(s_last, frame, frame_len);
+        s_last_len = frame_len;
+        if (sim_chance(s_faults.truncate_pct)) {
+            s_stats.truncated++;
+            frame_len -= 2;
+        } else if (sim_chance(s_faults.bad_checksum_pct)) {
+            s_stats.bad_checksums++;
+            frame[frame_len - 2] ^= 0x40;
+        }
+        len += frame_len;
+    }
+    queue_bytes(out, len, now_us);
+}
+
+void s21_sim_write(uint8_t byte, int64_t now_us) {
+    if (s21_sim_in_outage(now_us)) {
+        s_rx_in_frame = false;
+        return;
+    }
+    if (byte == STX) {
+        s_rx[0] = STX;
+        s_rx_len = 1;
+        s_rx_in_frame = true;
+        return;
+    }
+    if (!s_rx_in_frame) {
+        // The driver NAKs a corrupt reply and the unit sends it again
+        if (byte == NAK && s_last_len > 0) queue_bytes(s_last, s_last_len, now_us);
+        return;
+    }
+    if (s_rx_len < S21_MAX_PKT_LEN) s_rx[s_rx_len++] = byte;
+    if (byte != ETX) return;
+    s_rx_in_frame = false;
+    handle_query(now_us);
+}
+
+int s21_sim_read(int64_t now_us, int64_t *next_us) {
+    *next_us = INT64_MAX;
+    if (s21_sim_in_outage(now_us)) {
+        s_tx_len = s_tx_pos = 0;
+        return -1;
+    }
+    if (s_tx_pos >= s_tx_len) return -1;
+    int64_t ready = s_tx_start_us + (int64_t)s_tx_pos * S21_SIM_CHAR_US;
+    if (ready > now_us) {
+        *next_us = ready;
+        return -1;
+    }
+    return s_tx[s_tx_pos++];
+}
+
+ac_state_t s21_sim_get_unit(void) {
+    return s_unit;
+}
+
+s21_demand_t s21_sim_get_demand(void) {
+    return s_demand;
+}
+
+void s21_sim_set_error(const char *code) {
+    if (code && code[0] && code[1]) memcpy(s_error_code, code, 2);
+    else memcpy(s_error_code, "00", 2);
+}
+
+void s21_sim_set_compressor(int hz) {
+    s_compressor_hz = hz;
+}
+
+void s21_sim_set_filter_hours(uint16_t hours) {
+    s_filter_hours = hours;
+}
+
+void s21_sim_set_room_temp(float temp) {
+    s_unit.current_temp = temp;
+}
+
+s21_sim_stats_t s21_sim_get_stats(void) {
+    return s_stats;
+}
@@ -0,0 +1,167 @@
+#include "s21_stats.h"
+#include <math.h>
+#include <string.h>
+#include "faikin_enums.h"
+
+#define BUCKET_MS ((uint32_t)S21_STATS_BUCKET_S * 1000)
+#define MAX_GAP_US ((int64_t)S21_STATS_MAX_GAP_S * 1000000)
+
+// Bucket in progress. Sums of 0.01 C x ms reach about 1.8e10 per bucket, hence 64 bits.
+typedef struct {
+    uint32_t mode_ms[S21_STATS_MODE_COUNT];
+    uint32_t off_ms;
+    uint32_t active_ms;
+    uint32_t outside_ms;
+    uint16_t setpoint_changes;
+    uint16_t power_ons;
+    int64_t room_sum;
+    int64_t target_sum;
+    int64_t outside_sum;
+} stats_acc_t;
+
+// The state held since the previous sample, reduced to what is accumulated
+typedef struct {
+    bool valid;
+    bool on;
+    bool active;
+    bool outside_valid;
+    uint8_t mode;       // s21_stats_mode_t
+    int16_t room;       // 0.01 C
+    int16_t target;
+    int16_t outside;
+} stats_prev_t;
+
+static stats_acc_t s_acc;
+static uint32_t s_acc_ms;    // Time covered by s_acc
+static s21_stats_totals_t s_totals;
+static stats_prev_t s_prev;
+static int64_t s_prev_us;
+static s21_stats_rollup_cb_t s_rollup_cb;
+
+static uint8_t stats_mode(uint8_t mode) {
+    switch (mode) {
+        case FAIKIN_MODE_COOL: return S21_STATS_MODE_COOL;
+        case FAIKIN_MODE_HEAT: return S21_STATS_MODE_HEAT;
+        case FAIKIN_MODE_DRY: return S21_STATS_MODE_DRY;
+        case FAIKIN_MODE_FAN: return S21_STATS_MODE_FAN;
+        default: return S21_STATS_MODE_AUTO;
+    }
+}
+
+static int16_t centi(float c) { return (int16_t)lroundf(c * 100.0f); }
+
+static int16_t average(int64_t sum, uint32_t ms) {
+    return ms ? (int16_t)(sum / (int64_t)ms) : S21_STATS_NO_TEMP;
+}
+
+// Add ms of the previous state to the bucket
+static void accumulate(uint32_t ms) {
+    if (s_prev.on) {
+        s_acc.mode_ms[s_prev.mode] += ms;
+        s_acc.target_sum += (int64_t)s_prev.target * ms;
+        if (s_prev.active) s_acc.active_ms += ms;
+    } else {
+        s_acc.off_ms += ms;
+    }
+    s_acc.room_sum += (int64_t)s_prev.room * ms;
+    if (s_prev.outside_valid) {
+        s_acc.outside_ms += ms;
+        s_acc.outside_sum += (int64_t)s_prev.outside * ms;
+    }
+    s_acc_ms += ms;
+}
+
+// Seconds and averages of the bucket in progress. Caller holds the lock.
+static void summarize(s21_stats_bucket_t *out) {
+    uint32_t on_ms = 0;
+    for (int i = 0; i < S21_STATS_MODE_COUNT; i++) {
+        out->mode_s[i] = (uint16_t)(s_acc.mode_ms[i] / 1000);
+        on_ms += s_acc.mode_ms[i];
+    }
+    out->off_s = (uint16_t)(s_acc.off_ms / 1000);
+    out->active_s = (uint16_t)(s_acc.active_ms / 1000);
+    out->setpoint_changes = s_acc.setpoint_changes;
+    out->power_ons = s_acc.power_ons;
+    out->room_avg = average(s_acc.room_sum, s_acc_ms);
+    out->target_avg = average(s_acc.target_sum, on_ms);
+    out->outside_avg = average(s_acc.outside_sum, s_acc.outside_ms);
+}
+
+// Close the bucket into out, add it to the totals and start the next one. Caller holds the lock.
+static void rollup(s21_stats_bucket_t *out) {
+    summarize(out);
+    for (int i = 0; i < S21_STATS_MODE_COUNT; i++) s_totals.mode_s[i] += out->mode_s[i];
+    s_totals.active_s += out->active_s;
+    s_totals.setpoint_changes += out->setpoint_changes;
+    s_totals.power_ons += out->power_ons;
+    s_totals.buckets++;
+
+    memset(&s_acc, 0, sizeof(s_acc));
+    s_acc_ms = 0;
+}
+
+void s21_stats_init(const s21_stats_totals_t *totals, s21_stats_rollup_cb_t cb) {
+    s21_port_lock();
+    memset(&s_acc, 0, sizeof(s_acc));
+    s_acc_ms = 0;
+    if (totals) s_totals = *totals;
+    else memset(&s_totals, 0, sizeof(s_totals));
+    memset(&s_prev, 0, sizeof(s_prev));
+    s_rollup_cb = cb;
+    s21_port_unlock();
+}
+
+void s21_stats_sample(const ac_state_t *state, int64_t now_us) {
+    stats_prev_t cur;
+    cur.valid = true;
+    cur.on = state->power;
+    cur.mode = stats_mode(state->mode);
+    cur.room = centi(state->current_temp);
+    cur.target = centi(state->target_temp);
+    cur.outside_valid = !isnan(state->outside_temp);
+    cur.outside = cur.outside_valid ? centi(state->outside_temp) : 0;
+    // Same rule as the Thermostat RunningState attribute
+    cur.active = s21_state_active(state);
+
+    s21_stats_bucket_t bucket = {};
+    s21_stats_totals_t totals = {};
+    bool rolled = false;
+    s21_port_lock();
+    if (s_prev.valid) {
+        int64_t gap_us = now_us - s_prev_us;
+        if (gap_us > 0 && gap_us <= MAX_GAP_US) {
+            // A gap is far shorter than a bucket, so it ends at most one
+            uint32_t ms = (uint32_t)(gap_us / 1000);
+            if (s_acc_ms + ms >= BUCKET_MS) {
+                uint32_t head = BUCKET_MS - s_acc_ms;
+                accumulate(head);
+                rollup(&bucket);
+                totals = s_totals;
+                rolled = true;
+                ms -= head;
+            }
+            accumulate(ms);
+        }
+        if (cur.on && !s_prev.on) s_acc.power_ons++;
+        if (cur.target != s_prev.target) s_acc.setpoint_changes++;
+    }
+    // Keep the sub-millisecond remainder for the next gap
+    s_prev_us = now_us - (s_prev.valid ? (now_us - s_prev_us) % 1000 : 0);
+    s_prev = cur;
+    s21_stats_rollup_cb_t cb = s_rollup_cb;
+    s21_port_unlock();
+
+    if (rolled && cb) cb(&bucket, &totals);
+}
+
+void s21_stats_get(s21_stats_bucket_t *current, uint32_t *current_s, s21_stats_totals_t *totals) {
+    s21_port_lock();
+    summarize(current);
+    *current_s = s_acc_ms / 1000;
+    *totals = s_totals;
+    s21_port_unlock();
+}
+
+uint16_t s21_stats_duty_permille(uint32_t active_s, uint32_t on_s) {
+    return on_s ? (uint16_t)(((uint64_t)active_s * 1000) / on_s) : 0;
+}
@@ -0,0 +1,150 @@
+#include "s21_trace.h"
+#include <string.h>
+
+// Spans live in a ring indexed by ID, so finding a span never needs a search. A slot whose
+// ID no longer matches has been reused by a newer span and stamps for it are dropped.
+static s21_trace_span_t s_spans[S21_TRACE_SPANS];
+static uint16_t s_next_id = 1;
+
+// Latency histograms, four buckets per power of two of milliseconds. Buckets 0-3 hold 0-3 ms
+// exactly; the last one also takes everything from about 65 s up.
+#define HIST_BUCKETS 64
+#define HIST_STAGES 2
+
+typedef struct {
+    uint32_t buckets[HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+} latency_hist_t;
+
+static latency_hist_t s_hist[HIST_STAGES];
+
+static int hist_index(s21_trace_stage_t stage) {
+    if (stage == S21_TRACE_ACK) return 0;
+    if (stage == S21_TRACE_CONFIRM) return 1;
+    return -1;
+}
+
+static int hist_bucket(uint32_t us) {
+    uint32_t ms = us / 1000;
+    if (ms < 4) return (int)ms;
+    int msb = 31 - __builtin_clz(ms);
+    int bucket = (msb - 1) * 4 + (int)((ms >> (msb - 2)) & 3);
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+// Upper edge of a bucket, in microseconds
+static uint32_t hist_upper_us(int bucket) {
+    if (bucket < 4) return (uint32_t)(bucket + 1) * 1000;
+    int msb = bucket / 4 + 1;
+    uint32_t ms = (uint32_t)(5 + bucket % 4) << (msb - 2);
+    return ms * 1000;
+}
+
+// Called with the lock held
+static void hist_add(s21_trace_stage_t stage, uint32_t us) {
+    int h = hist_index(stage);
+    if (h < 0) return;
+    latency_hist_t *hist = &s_hist[h];
+    hist->buckets[hist_bucket(us)]++;
+    hist->count++;
+    if (us > hist->max_us) hist->max_us = us;
+}
+
+static uint32_t hist_percentile(const latency_hist_t *hist, uint32_t permille) {
+    // Rank of the sample at the percentile, counting from 1
+    uint32_t rank = (uint32_t)(((uint64_t)hist->count * permille + 999) / 1000);
+    if (rank == 0) rank = 1;
+    uint32_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = hist_upper_us(i);
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+static const char *s_stage_names[S21_TRACE_STAGE_COUNT] = {
+    "pre", "enq", "deq", "tx", "ack", "g1",
+};
+
+uint16_t s21_trace_begin(uint32_t tag) {
+    int64_t now = s21_port_time_us();
+    s21_port_lock();
+    uint16_t id = s_next_id++;
+    if (s_next_id == 0) s_next_id = 1;
+    s21_trace_span_t *span = &s_spans[id % S21_TRACE_SPANS];
+    span->id = id;
+    span->tag = tag;
+    span->start_us = now;
+    for (int i = 0; i < S21_TRACE_STAGE_COUNT; i++) span->stage_us[i] = S21_TRACE_NONE;
+    span->stage_us[S21_TRACE_PRE_UPDATE] = 0;
+    span->result = ESP_OK;
+    span->done = false;
+    s21_port_unlock();
+    return id;
+}
+
+void s21_trace_stamp_at(uint16_t id, s21_trace_stage_t stage, int64_t t_us) {
+    if (id == 0 || stage >= S21_TRACE_STAGE_COUNT) return;
+    s21_port_lock();
+    s21_trace_span_t *span = &s_spans[id % S21_TRACE_SPANS];
+    // Keep the first time a stage is reached; a retried write does not move TX
+    if (span->id == id && !span->done && span->stage_us[stage] == S21_TRACE_NONE) {
+        int64_t offset = t_us - span->start_us;
+        span->stage_us[stage] = offset < 0 ? 0 : (uint32_t)offset;
+        hist_add(stage, span->stage_us[stage]);
+    }
+    s21_port_unlock();
+}
+
+void s21_trace_stamp(uint16_t id, s21_trace_stage_t stage) {
+    if (id == 0) return;
+    s21_trace_stamp_at(id, stage, s21_port_time_us());
+}
+
+void s21_trace_end(uint16_t id, esp_err_t result) {
+    if (id == 0) return;
+    s21_port_lock();
+    s21_trace_span_t *span = &s_spans[id % S21_TRACE_SPANS];
+    if (span->id == id && !span->done) {
+        span->result = result;
+        span->done = true;
+    }
+    s21_port_unlock();
+}
+
+bool s21_trace_get(size_t index, s21_trace_span_t *out) {
+    if (index >= S21_TRACE_SPANS) return false;
+    s21_port_lock();
+    // The slot after the newest span holds the oldest one
+    *out = s_spans[(s_next_id + index) % S21_TRACE_SPANS];
+    s21_port_unlock();
+    return true;
+}
+
+void s21_trace_clear(void) {
+    s21_port_lock();
+    memset(s_spans, 0, sizeof(s_spans));
+    memset(s_hist, 0, sizeof(s_hist));
+    s21_port_unlock();
+}
+
+const char *s21_trace_stage_name(s21_trace_stage_t stage) {
+    return stage < S21_TRACE_STAGE_COUNT ? s_stage_names[stage] : "?";
+}
+
+bool s21_trace_latency(s21_trace_stage_t stage, s21_trace_latency_t *out) {
+    int h = hist_index(stage);
+    if (h < 0) return false;
+    s21_port_lock();
+    const latency_hist_t *hist = &s_hist[h];
+    out->count = hist->count;
+    out->max_us = hist->max_us;
+    out->p50_us = hist->count ? hist_percentile(hist, 500) : 0;
+    out->p99_us = hist->count ? hist_percentile(hist, 990) : 0;
+    s21_port_unlock();
+    return true;
+}
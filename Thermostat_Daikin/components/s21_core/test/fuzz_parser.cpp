@@ -0,0 +1,198 @@
+#include "s21_parser.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fuzz target for S21Parser. Built with -fsanitize=fuzzer it is a libFuzzer target
+// (S21_CORE_FUZZ with clang); otherwise main() below replays the corpus in corpus/parser
+// and inputs generated from it: every truncation, every checksum sum including the promoted
+// ones, garbage inserted between STX and ETX, and random mutations.
+//
+// Whatever the input, every reported frame is well formed with a valid checksum, the
+// counters match the results, and a good frame sent afterwards parses.
+
+static void fuzz_fail(const char *what) {
+    fprintf(stderr, "fuzz_parser: %s\n", what);
+    abort();
+}
+
+#define FUZZ_CHECK(cond) do { if (!(cond)) fuzz_fail(#cond); } while (0)
+
+// A status reply as the unit sends it, to follow every input
+static const uint8_t s_good_frame[] = { STX, 'G', '1', '1', '3', '@', 'A', 0, ETX };
+
+static void check_frame(const S21Parser &parser) {
+    const uint8_t *frame = parser.Frame();
+    int len = parser.FrameLen();
+    FUZZ_CHECK(len >= S21_MIN_PKT_LEN && len <= S21_MAX_PKT_LEN);
+    FUZZ_CHECK(frame[0] == STX && frame[len - 1] == ETX);
+    for (int i = 1; i < len - 1; i++) FUZZ_CHECK(frame[i] != STX && frame[i] != ETX);
+    FUZZ_CHECK(s21_checksum((uint8_t *)frame, len) == frame[len - 2]);
+    FUZZ_CHECK(parser.PayloadLen() == len - S21_MIN_PKT_LEN);
+    FUZZ_CHECK(parser.Payload() == &frame[S21_PAYLOAD_OFFSET]);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    S21Parser parser;
+    uint32_t frames = 0, bad_frames = 0, overflows = 0;
+    for (size_t i = 0; i < size; i++) {
+        bool was_in_frame = parser.InFrame();
+        switch (parser.Feed(data[i])) {
+        case S21_PARSE_FRAME:
+            check_frame(parser);
+            frames++;
+            break;
+        case S21_PARSE_BAD_FRAME:
+            bad_frames++;
+            break;
+        case S21_PARSE_OVERFLOW:
+            overflows++;
+            break;
+        case S21_PARSE_ACK:
+            FUZZ_CHECK(data[i] == ACK && !was_in_frame);
+            break;
+        case S21_PARSE_NAK:
+            FUZZ_CHECK(data[i] == NAK && !was_in_frame);
+            break;
+        case S21_PARSE_NONE:
+            break;
+        }
+        FUZZ_CHECK(parser.InFrame() == (data[i] == STX || (was_in_frame && data[i] != ETX)));
+    }
+    s21_parser_stats_t stats = parser.GetStats();
+    FUZZ_CHECK(stats.frames == frames && stats.bad_frames == bad_frames && stats.overflows == overflows);
+
+    uint8_t good[sizeof(s_good_frame)];
+    memcpy(good, s_good_frame, sizeof(good));
+    good[sizeof(good) - 2] = s21_checksum(good, sizeof(good));
+    s21_parse_result_t result = S21_PARSE_NONE;
+    for (size_t i = 0; i < sizeof(good); i++) result = parser.Feed(good[i]);
+    FUZZ_CHECK(result == S21_PARSE_FRAME);
+    FUZZ_CHECK(parser.FrameLen() == (int)sizeof(good));
+    return 0;
+}
+
+#ifndef S21_FUZZ_LIBFUZZER
+
+#define REPLAY_MAX_INPUT 512
+#define REPLAY_MUTATIONS 20000
+
+static uint32_t s_rng = 1;
+static unsigned long s_runs = 0;
+
+static uint32_t replay_random(void) {
+    s_rng = s_rng * 1103515245 + 12345;
+    return s_rng >> 8;
+}
+
+static void run(const uint8_t *data, size_t size) {
+    LLVMFuzzerTestOneInput(data, size);
+    s_runs++;
+}
+
+// Inputs derived from one corpus entry
+static void replay_derived(const uint8_t *data, size_t size) {
+    uint8_t buf[REPLAY_MAX_INPUT + 1];
+
+    // Every truncation
+    for (size_t len = 0; len < size; len++) run(data, len);
+
+    // Every checksum value in place of the last frame's, promoted or not
+    for (size_t i = size; i >= 2; i--) {
+        if (data[i - 1] != ETX) continue;
+        memcpy(buf, data, size);
+        for (int c = 0; c < 256; c++) {
+            buf[i - 2] = (uint8_t)c;
+            run(buf, size);
+        }
+        break;
+    }
+
+    // Garbage, framing bytes included, inserted at every position
+    static const uint8_t garbage[] = { 0x00, STX, ETX, ACK, NAK, 0x7f, 0xff };
+    for (size_t pos = 0; pos <= size && size < REPLAY_MAX_INPUT; pos++) {
+        for (size_t g = 0; g < sizeof(garbage); g++) {
+            memcpy(buf, data, pos);
+            buf[pos] = garbage[g];
+            memcpy(&buf[pos + 1], &data[pos], size - pos);
+            run(buf, size + 1);
+        }
+    }
+
+    // Random flips, insertions and deletions
+    for (int m = 0; m < REPLAY_MUTATIONS / 16; m++) {
+        size_t len = size;
+        memcpy(buf, data, size);
+        int edits = 1 + replay_random() % 4;
+        for (int e = 0; e < edits; e++) {
+            size_t pos = len ? replay_random() % len : 0;
+            switch (replay_random() % 3) {
+            case 0:
+                if (len) buf[pos] ^= (uint8_t)(1 << (replay_random() % 8));
+                break;
+            case 1:
+                if (len < REPLAY_MAX_INPUT) {
+                    memmove(&buf[pos + 1], &buf[pos], len - pos);
+                    buf[pos] = (uint8_t)replay_random();
+                    len++;
+                }
+                break;
+            default:
+                if (len) {
+                    memmove(&buf[pos], &buf[pos + 1], len - pos - 1);
+                    len--;
+                }
+                break;
+            }
+        }
+        run(buf, len);
+    }
+}
+
+static int replay_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "fuzz_parser: cannot open %s\n", path);
+        return 1;
+    }
+    uint8_t data[REPLAY_MAX_INPUT];
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    run(data, size);
+    replay_derived(data, size);
+    return 0;
+}
+
+// fuzz_parser <corpus file or directory>...
+int main(int argc, char **argv) {
+    int files = 0;
+    for (int i = 1; i < argc; i++) {
+        DIR *dir = opendir(argv[i]);
+        if (!dir) {
+            if (replay_file(argv[i])) return 1;
+            files++;
+            continue;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_name[0] == '.') continue;
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", argv[i], entry->d_name);
+            if (replay_file(path)) {
+                closedir(dir);
+                return 1;
+            }
+            files++;
+        }
+        closedir(dir);
+    }
+    if (files == 0) {
+        fprintf(stderr, "fuzz_parser: empty corpus\n");
+        return 1;
+    }
+    printf("fuzz_parser: %d corpus files, %lu inputs\n", files, s_runs);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "s21_test.h"
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define S21_TEST_MAX_CASES 32
+
+typedef struct {
+    const char *name;
+    s21_test_fn_t fn;
+} test_case_t;
+
+static test_case_t s_cases[S21_TEST_MAX_CASES];
+static int s_case_count = 0;
+static int s_failures = 0;
+
+void s21_test_register(const char *name, s21_test_fn_t fn) {
+    if (s_case_count == S21_TEST_MAX_CASES) {
+        fprintf(stderr, "Too many test cases, %s not registered\n", name);
+        s_failures++;
+        return;
+    }
+    s_cases[s_case_count++] = { name, fn };
+}
+
+void s21_test_fail(const char *file, int line, const char *expr) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    s_failures++;
+}
+
+void s21_test_fail_eq(const char *file, int line, const char *a, const char *b, long long va, long long vb) {
+    fprintf(stderr, "%s:%d: check failed: %s == %s (%lld vs %lld)\n", file, line, a, b, va, vb);
+    s_failures++;
+}
+
+int s21_test_failures(void) {
+    return s_failures;
+}
+
+static int run_case(const test_case_t *test) {
+    test->fn();
+    printf("%s: %s\n", test->name, s_failures ? "FAILED" : "ok");
+    return s_failures ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        for (int i = 0; i < s_case_count; i++) {
+            if (strcmp(argv[1], s_cases[i].name) == 0) return run_case(&s_cases[i]);
+        }
+        fprintf(stderr, "No test case %s\n", argv[1]);
+        return 2;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < s_case_count; i++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) _exit(run_case(&s_cases[i]));
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            if (pid < 0 || !WIFEXITED(status)) printf("%s: crashed\n", s_cases[i].name);
+            failed++;
+        }
+    }
+    printf("%d of %d cases failed\n", failed, s_case_count);
+    return failed ? 1 : 0;
+}
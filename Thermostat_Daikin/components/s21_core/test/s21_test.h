@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdio.h>
+
+// Minimal runner for the host tests. A test file defines its cases with S21_TEST(name) and
+// links s21_test.cpp, which supplies main(). "test_x <case>" runs one case; without arguments
+// every case runs, each in a child process, because the core keeps its state in file statics
+// and a case must start from a clean process. ctest registers each case on its own.
+//
+// A failed check is reported and counted, and the case carries on; the process exits
+// non-zero if any check failed.
+
+typedef void (*s21_test_fn_t)(void);
+
+void s21_test_register(const char *name, s21_test_fn_t fn);
+void s21_test_fail(const char *file, int line, const char *expr);
+void s21_test_fail_eq(const char *file, int line, const char *a, const char *b, long long va, long long vb);
+// Checks failed so far in this process
+int s21_test_failures(void);
+
+struct S21TestRegistrar {
+    S21TestRegistrar(const char *name, s21_test_fn_t fn) { s21_test_register(name, fn); }
+};
+
+#define S21_TEST(name)                                                  \
+    static void test_##name(void);                                      \
+    static S21TestRegistrar s_test_reg_##name(#name, test_##name);      \
+    static void test_##name(void)
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) s21_test_fail(__FILE__, __LINE__, #cond);          \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+    do {                                                                \
+        long long va_ = (long long)(a), vb_ = (long long)(b);           \
+        if (va_ != vb_) s21_test_fail_eq(__FILE__, __LINE__, #a, #b, va_, vb_); \
+    } while (0)
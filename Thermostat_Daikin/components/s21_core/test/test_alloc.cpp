@@ -0,0 +1,115 @@
+#include "s21_test.h"
+#include "s21_driver.h"
+#include "s21_port_host.h"
+#include "s21_sim.h"
+#include "s21_stats.h"
+#include "s21_config.h"
+#include <stddef.h>
+
+// The poll task's work never touches the heap. malloc and friends are replaced for this
+// program and count every call made while a poll cycle runs, so even an allocation freed
+// again in the same cycle fails the test; a free heap figure would not show that. Built
+// without sanitizers, which replace malloc themselves.
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool s_counting;
+static unsigned s_allocs;
+static unsigned s_frees;
+
+extern "C" void *malloc(size_t size) {
+    if (s_counting) s_allocs++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    if (s_counting) s_allocs++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    if (s_counting) s_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) {
+    if (s_counting && ptr) s_frees++;
+    __libc_free(ptr);
+}
+
+#define ALLOC_POLL_CYCLES 2000
+
+static DaikinS21 s_s21;
+static int64_t s_next_cmd_us;
+static uint32_t s_rng = 7;
+
+// Commands arrive from "other tasks" while the driver waits, as they do on the device
+static void submit_commands(int64_t now_us) {
+    if (now_us < s_next_cmd_us) return;
+    s_next_cmd_us = now_us + 45 * 1000000LL;
+    s_rng = s_rng * 1103515245 + 12345;
+    s21_control_t c = {};
+    c.fields = S21_CTRL_POWER | S21_CTRL_MODE | S21_CTRL_TEMP | S21_CTRL_FAN;
+    c.power = (s_rng >> 8) % 4 != 0;
+    c.mode = (s_rng >> 10) % 2 ? FAIKIN_MODE_COOL : FAIKIN_MODE_HEAT;
+    c.target_temp = 18 + ((s_rng >> 12) % 20) * 0.5f;
+    c.fan_speed = FAIKIN_FAN_AUTO;
+    c.trace_id = s21_trace_begin(1);
+    s_s21.ApplyControl(&c);
+    if ((s_rng >> 16) % 3 == 0) {
+        s21_demand_t demand = { (uint8_t)(S21_DEMAND_MIN_PCT + (s_rng >> 18) % 71), false };
+        s_s21.ApplyDemand(&demand);
+    }
+}
+
+// N cycles of the poll task loop, counting from the second: set-up may allocate
+static void run_cycles(const char *profile) {
+    // The hooks are live
+    s_counting = true;
+    void *volatile probe = malloc(16);
+    free(probe);
+    s_counting = false;
+    CHECK_EQ(s_allocs, 1);
+    CHECK_EQ(s_frees, 1);
+    s_allocs = s_frees = 0;
+
+    s21_sim_faults_t faults;
+    CHECK(s21_sim_profile(profile, &faults));
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    s21_sim_reset(&faults, 42, s21_port_time_us());
+    s_s21.DiscoverCapabilities();
+    s21_stats_init(nullptr, nullptr);
+    s21_host_set_tick(submit_commands);
+
+    for (int i = 0; i <= ALLOC_POLL_CYCLES; i++) {
+        s_counting = i > 0;
+        uint32_t heap_before = s21_port_heap_free();
+        s_s21.Poll();
+        s_s21.UpdateMemStats(heap_before);
+        ac_state_t state = s_s21.GetState();
+        s21_stats_sample(&state, s21_port_time_us());
+        s21_config_service(s21_port_time_us());
+        s_s21.Idle(2000);
+        s_counting = false;
+    }
+    s21_host_set_tick(nullptr);
+
+    printf("%s: %d cycles, %u allocations, %u frees, %lu D1 writes\n", profile, ALLOC_POLL_CYCLES, s_allocs,
+           s_frees, (unsigned long)s21_sim_get_stats().writes);
+    CHECK_EQ(s_allocs, 0);
+    CHECK_EQ(s_frees, 0);
+    CHECK(s21_sim_get_stats().writes > 0);
+    CHECK_EQ(s_s21.GetMemStats().heap_delta_cycles, 0);
+}
+
+S21_TEST(poll_cycles) {
+    run_cycles("clean");
+}
+
+// Retries, NAKs, resyncs and link losses take the same paths without the heap
+S21_TEST(poll_cycles_faults) {
+    run_cycles("mixed");
+}
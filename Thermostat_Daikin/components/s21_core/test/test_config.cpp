@@ -0,0 +1,178 @@
+#include "s21_test.h"
+#include "s21_config.h"
+#include "s21_port_host.h"
+#include <stddef.h>
+#include <string.h>
+
+// The config blob against the in-memory host storage: import from the old capability key,
+// write-behind, blobs longer or shorter than this layout, newer versions, and how the state
+// is stored
+
+#define LEGACY_KEY_CAPS "caps"
+
+static uint8_t s_buf[S21_CONFIG_MAX_LEN];
+
+static size_t read_blob(void) {
+    size_t len = sizeof(s_buf);
+    if (s21_port_storage_read(S21_STORAGE_KEY_CONFIG, s_buf, &len) != ESP_OK) return 0;
+    return len;
+}
+
+static void write_blob(const s21_config_t *config, size_t len) {
+    memcpy(s_buf, config, len < sizeof(*config) ? len : sizeof(*config));
+    CHECK_EQ(s21_port_storage_write(S21_STORAGE_KEY_CONFIG, s_buf, len), ESP_OK);
+}
+
+static void service_after(int ms) {
+    s21_host_advance_us((int64_t)ms * 1000);
+    s21_config_service(s21_port_time_us());
+}
+
+// The capability map stored before the blob existed is folded in once and its key erased
+S21_TEST(legacy) {
+    s21_caps_t caps = {};
+    caps.version = S21_CAPS_VERSION;
+    caps.protocol_major = 2;
+    caps.regs = 0x1234;
+    CHECK_EQ(s21_port_storage_write(LEGACY_KEY_CAPS, &caps, sizeof(caps)), ESP_OK);
+
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    s21_config_t config = s21_config_get();
+    CHECK_EQ(config.caps.regs, 0x1234);
+    CHECK(config.flags & S21_CONFIG_HAS_CAPS);
+    size_t len = sizeof(caps);
+    CHECK(s21_port_storage_read(LEGACY_KEY_CAPS, &caps, &len) != ESP_OK);
+    CHECK_EQ(read_blob(), sizeof(s21_config_t));
+    CHECK_EQ(((s21_config_t *)s_buf)->version, S21_CONFIG_VERSION);
+    CHECK_EQ(((s21_config_t *)s_buf)->caps.regs, 0x1234);
+    CHECK_EQ(s21_config_get_stats().writes, 1);
+}
+
+// A burst of changes costs one write once it goes quiet, a steady stream is written at least
+// every S21_CONFIG_MAX_DELAY_MS, and a change undone before the write costs nothing
+S21_TEST(debounce) {
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    ac_state_t state = {};
+    state.mode = FAIKIN_MODE_HEAT;
+    for (int i = 0; i < 100; i++) {
+        state.target_temp = 20.0f + (i % 5);
+        s21_config_set_state(&state);
+        service_after(100);
+    }
+    s21_config_stats_t stats = s21_config_get_stats();
+    CHECK_EQ(stats.changes, 100);
+    CHECK_EQ(stats.writes, 0);
+    CHECK(stats.dirty);
+    service_after(S21_CONFIG_QUIET_MS);
+    stats = s21_config_get_stats();
+    CHECK_EQ(stats.writes, 1);
+    CHECK(!stats.dirty);
+
+    // A new value every second never goes quiet, so only the maximum delay writes it
+    for (int i = 0; i < 130; i++) {
+        state.target_temp = 16.0f + i * 0.1f;
+        s21_config_set_state(&state);
+        service_after(1000);
+    }
+    stats = s21_config_get_stats();
+    CHECK_EQ(stats.writes, 3);
+
+    s21_config_flush();
+    uint32_t writes = s21_config_get_stats().writes;
+    ac_state_t off = state;
+    off.power = !state.power;
+    s21_config_set_state(&off);
+    CHECK(s21_config_get_stats().dirty);
+    s21_config_set_state(&state);
+    CHECK(!s21_config_get_stats().dirty);
+    service_after(S21_CONFIG_MAX_DELAY_MS);
+    CHECK_EQ(s21_config_get_stats().writes, writes);
+
+    // Bit period drift within the slack is not worth a write
+    s21_config_set_bit_q4(6667);
+    s21_config_flush();
+    s21_config_set_bit_q4(6667 + S21_CONFIG_BIT_Q4_SLACK);
+    CHECK(!s21_config_get_stats().dirty);
+    s21_config_set_bit_q4(6667 + S21_CONFIG_BIT_Q4_SLACK + 1);
+    CHECK(s21_config_get_stats().dirty);
+}
+
+// A longer blob of this version, from newer firmware, keeps its tail through a write-back
+S21_TEST(tail) {
+    s21_config_t config = {};
+    config.version = S21_CONFIG_VERSION;
+    config.length = sizeof(config) + 8;
+    config.flags = S21_CONFIG_HAS_FILTER;
+    config.filter_base_hours = 77;
+    memset(s_buf + sizeof(config), 0xab, 8);
+    write_blob(&config, config.length);
+
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    CHECK_EQ(s21_config_get().filter_base_hours, 77);
+    CHECK_EQ(s21_config_get().length, sizeof(config) + 8);
+    s21_config_set_poll_interval(1234);
+    CHECK_EQ(s21_config_flush(), ESP_OK);
+
+    memset(s_buf, 0, sizeof(s_buf));
+    CHECK_EQ(read_blob(), sizeof(config) + 8);
+    CHECK_EQ(((s21_config_t *)s_buf)->poll_interval_ms, 1234);
+    for (size_t i = 0; i < 8; i++) CHECK_EQ(s_buf[sizeof(config) + i], 0xab);
+}
+
+// A shorter blob gets defaults for the fields it lacks
+S21_TEST(short_blob) {
+    s21_config_t config = {};
+    config.version = S21_CONFIG_VERSION;
+    config.length = offsetof(s21_config_t, poll_interval_ms);
+    config.flags = S21_CONFIG_HAS_CAPS;
+    config.caps.regs = 5;
+    config.poll_interval_ms = 999;
+    write_blob(&config, config.length);
+
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    s21_config_t loaded = s21_config_get();
+    CHECK_EQ(loaded.caps.regs, 5);
+    CHECK_EQ(loaded.length, sizeof(loaded));
+    CHECK_EQ(loaded.poll_interval_ms, 0);
+    CHECK(!(loaded.flags & S21_CONFIG_HAS_STATE));
+}
+
+// A newer version is ignored rather than guessed at
+S21_TEST(newer) {
+    s21_config_t config = {};
+    config.version = S21_CONFIG_VERSION + 1;
+    config.length = sizeof(config);
+    config.flags = S21_CONFIG_HAS_CAPS;
+    config.caps.regs = 5;
+    write_blob(&config, sizeof(config));
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    CHECK_EQ(s21_config_get().caps.regs, 0);
+    CHECK_EQ(s21_config_get().version, S21_CONFIG_VERSION);
+    CHECK_EQ(s21_config_get_stats().writes, 0);
+}
+
+// The stored state keeps mode and fan as the unit's characters, and reads back the same
+S21_TEST(state_chars) {
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    ac_state_t state = {};
+    state.power = true;
+    state.mode = FAIKIN_MODE_HEAT;
+    state.fan_speed = FAIKIN_FAN_2;
+    state.target_temp = 21.5f;
+    s21_config_set_state(&state);
+    CHECK_EQ(s21_config_flush(), ESP_OK);
+
+    CHECK_EQ(read_blob(), sizeof(s21_config_t));
+    s21_config_t *stored = (s21_config_t *)s_buf;
+    CHECK(stored->flags & S21_CONFIG_HAS_STATE);
+    CHECK_EQ(stored->power, 1);
+    CHECK_EQ(stored->mode, AC_MODE_HEAT + '0');
+    CHECK_EQ(stored->fan_speed, AC_FAN_2);
+    CHECK_EQ(stored->target_temp, 2150);
+    CHECK_EQ(s21_decode_mode(stored->mode), FAIKIN_MODE_HEAT);
+    CHECK_EQ(s21_decode_fan(stored->fan_speed), FAIKIN_FAN_2);
+
+    // Setting the same state again is no change
+    s21_config_set_state(&state);
+    CHECK(!s21_config_get_stats().dirty);
+}
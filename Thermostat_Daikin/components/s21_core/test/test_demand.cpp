@@ -0,0 +1,195 @@
+#include "s21_test.h"
+#include "s21_driver.h"
+#include "s21_port_host.h"
+#include "s21_sim.h"
+#include <stdlib.h>
+
+// Demand limits against the simulated unit. The ramp is driven the way app_demand drives it:
+// the first step goes out at once, and each later one RAMP_STEP_S after the unit ACKed the
+// previous one. A step must reach the unit ahead of queued control writes.
+
+#define RAMP_STEP_PCT 10
+#define RAMP_STEP_S   5
+// Longest the unit may take to ACK a step on a clean bus, and under a fault profile. A step
+// waits for the query on the bus and the gap after it, then goes out ahead of anything else.
+#define ACK_CLEAN_MS  1500
+#define ACK_FAULTS_MS 5000
+#define MAX_STEPS 16
+
+static DaikinS21 s_s21;
+
+static void start(void) {
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    CHECK_EQ(s_s21.DiscoverCapabilities(), ESP_OK);
+    s_s21.Poll();
+    CHECK(s_s21.IsConnected());
+    CHECK(s_s21.HasRegister(S21_REG_ECONO));
+}
+
+static void cycle(void) {
+    s_s21.Poll();
+    s_s21.Idle(2000);
+}
+
+// Ramp state, as in app_demand
+static uint8_t s_target_pct = S21_DEMAND_MAX_PCT;
+static uint8_t s_applied_pct = S21_DEMAND_MAX_PCT;
+static uint8_t s_step_pct;
+static bool s_step_busy;
+static int64_t s_next_step_us; // 0 while no step is due
+static int64_t s_request_us;
+
+// What the unit had each time it ACKed a step, and when
+static uint8_t s_unit_pct[MAX_STEPS];
+static int64_t s_acked_us[MAX_STEPS];
+static uint32_t s_writes_at_ack[MAX_STEPS]; // D1 writes the unit had taken by then
+static int s_steps;
+static int s_failures;
+
+static void step(void);
+
+static void step_done(esp_err_t result, void *ctx) {
+    s_step_busy = false;
+    if (result != ESP_OK) {
+        s_failures++;
+    } else {
+        s_applied_pct = s_step_pct;
+        if (s_steps < MAX_STEPS) {
+            s_unit_pct[s_steps] = s21_sim_get_demand().limit_pct;
+            s_acked_us[s_steps] = s21_port_time_us();
+            s_writes_at_ack[s_steps] = s21_sim_get_stats().writes;
+            s_steps++;
+        }
+    }
+    if (s_applied_pct != s_target_pct) s_next_step_us = s21_port_time_us() + RAMP_STEP_S * 1000000LL;
+}
+
+static void step(void) {
+    if (s_step_busy || s_applied_pct == s_target_pct) return;
+    s21_demand_t demand = {};
+    demand.limit_pct = s21_demand_ramp_step(s_applied_pct, s_target_pct, RAMP_STEP_PCT);
+    s_step_pct = demand.limit_pct;
+    CHECK_EQ(s_s21.ApplyDemand(&demand, step_done, nullptr), ESP_OK);
+    s_step_busy = true;
+}
+
+static void step_tick(int64_t now_us) {
+    if (s_next_step_us && now_us >= s_next_step_us) {
+        s_next_step_us = 0;
+        step();
+    }
+}
+
+static void set_target(uint8_t pct) {
+    s_target_pct = pct;
+    s_request_us = s21_port_time_us();
+    s_next_step_us = 0;
+    s_steps = 0;
+    step();
+}
+
+// Poll until the ramp has settled, or for at most limit_s
+static void run_ramp(int limit_s) {
+    s21_host_set_tick(step_tick);
+    int64_t until = s21_port_time_us() + limit_s * 1000000LL;
+    while ((s_applied_pct != s_target_pct || s_step_busy) && s21_port_time_us() < until) cycle();
+}
+
+// Check the ACKed steps of a ramp from `from` to `to`, and that each step is ACKed within
+// ack_ms of being due
+static void check_ramp(uint8_t from, uint8_t to, int ack_ms) {
+    int expected = (abs(to - from) + RAMP_STEP_PCT - 1) / RAMP_STEP_PCT;
+    CHECK_EQ(s_steps, expected);
+    CHECK_EQ(s_applied_pct, to);
+    CHECK_EQ(s21_sim_get_demand().limit_pct, to);
+    uint8_t pct = from;
+    int64_t due = s_request_us;
+    for (int i = 0; i < s_steps; i++) {
+        pct = s21_demand_ramp_step(pct, to, RAMP_STEP_PCT);
+        CHECK_EQ(s_unit_pct[i], pct);
+        CHECK(s_acked_us[i] - due <= ack_ms * 1000LL);
+        due = s_acked_us[i] + RAMP_STEP_S * 1000000LL;
+    }
+    printf("%u%% -> %u%%: %d steps, first ACK %lld ms, settled %lld ms\n", from, to, s_steps,
+           s_steps ? (long long)(s_acked_us[0] - s_request_us) / 1000 : 0LL,
+           s_steps ? (long long)(s_acked_us[s_steps - 1] - s_request_us) / 1000 : 0LL);
+}
+
+// Steps land on the target without overshoot, in either direction
+S21_TEST(ramp_step) {
+    CHECK_EQ(s21_demand_ramp_step(100, 40, 10), 90);
+    CHECK_EQ(s21_demand_ramp_step(45, 40, 10), 40);
+    CHECK_EQ(s21_demand_ramp_step(50, 40, 10), 40);
+    CHECK_EQ(s21_demand_ramp_step(30, 100, 10), 40);
+    CHECK_EQ(s21_demand_ramp_step(95, 100, 10), 100);
+    CHECK_EQ(s21_demand_ramp_step(60, 60, 10), 60);
+    CHECK_EQ(s21_demand_ramp_step(S21_DEMAND_MAX_PCT, S21_DEMAND_MIN_PCT, 100), S21_DEMAND_MIN_PCT);
+}
+
+// A cap ramps down one step at a time and is lifted the same way; the unit holds each step
+// when it ACKs it, and the whole ramp takes no longer than its steps and their ACKs
+S21_TEST(ramp) {
+    start();
+    cycle();
+    set_target(35);
+    run_ramp(120);
+    check_ramp(100, 35, ACK_CLEAN_MS);
+    CHECK_EQ(s_failures, 0);
+    CHECK(s_acked_us[s_steps - 1] - s_request_us <= (s_steps - 1) * (RAMP_STEP_S * 1000000LL) + s_steps * ACK_CLEAN_MS * 1000LL);
+
+    // Between steps the unit keeps the last one, whatever else is polled
+    int64_t held_until = s21_port_time_us() + 60 * 1000000LL;
+    while (s21_port_time_us() < held_until) cycle();
+    CHECK_EQ(s21_sim_get_demand().limit_pct, 35);
+
+    set_target(S21_DEMAND_MAX_PCT);
+    run_ramp(120);
+    check_ramp(35, S21_DEMAND_MAX_PCT, ACK_CLEAN_MS);
+    CHECK_EQ(s_failures, 0);
+}
+
+// A new target mid-ramp turns it round from the last ACKed step
+S21_TEST(ramp_retarget) {
+    start();
+    cycle();
+    set_target(40);
+    s21_host_set_tick(step_tick);
+    while (s_steps < 2 || s_step_busy) cycle();
+    uint8_t from = s_applied_pct;
+    CHECK(from < S21_DEMAND_MAX_PCT && from > 40);
+    set_target(S21_DEMAND_MAX_PCT);
+    run_ramp(120);
+    check_ramp(from, S21_DEMAND_MAX_PCT, ACK_CLEAN_MS);
+    CHECK_EQ(s_failures, 0);
+}
+
+// With control writes queued first, each step still reaches the unit ahead of them, well
+// within the ACK bound, on a clean bus and under each fault profile
+S21_TEST(ack_timing) {
+    static const char *const profiles[] = { "clean", "lost-ack", "truncated", "checksum", "every-other" };
+    start();
+    for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+        s21_sim_faults_t faults;
+        CHECK(s21_sim_profile(profiles[p], &faults));
+        s21_sim_set_faults(&faults);
+        cycle();
+        int ack_ms = p == 0 ? ACK_CLEAN_MS : ACK_FAULTS_MS;
+
+        uint32_t writes = s21_sim_get_stats().writes;
+        for (int i = 0; i < 4; i++) {
+            s21_control_t c = {};
+            c.fields = S21_CTRL_TEMP;
+            c.target_temp = 20.0f + i;
+            CHECK_EQ(s_s21.ApplyControl(&c), ESP_OK);
+        }
+        uint8_t from = s_applied_pct;
+        set_target(from == S21_DEMAND_MAX_PCT ? 60 : S21_DEMAND_MAX_PCT);
+        run_ramp(120);
+        printf("%s: ", profiles[p]);
+        check_ramp(from, s_target_pct, ack_ms);
+        CHECK_EQ(s_failures, 0);
+        // The first step went out before the control write queued ahead of it
+        CHECK(s_steps > 0 && s_writes_at_ack[0] == writes);
+        CHECK(s21_sim_get_stats().writes > writes);
+    }
+}
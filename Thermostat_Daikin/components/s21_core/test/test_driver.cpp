@@ -0,0 +1,407 @@
+#include "s21_test.h"
+#include "s21_driver.h"
+#include "s21_port_host.h"
+#include "s21_sim.h"
+#include "s21_config.h"
+#include "s21_stats.h"
+#include <math.h>
+#include <string.h>
+
+// DaikinS21 against the simulated unit: how queued commands merge into D1 writes, the order
+// they complete in, a full queue, command timeouts, the maintenance registers and the
+// compressor frequency
+
+static DaikinS21 s_s21;
+
+static void start(void) {
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    CHECK_EQ(s_s21.DiscoverCapabilities(), ESP_OK);
+    s_s21.Poll();
+    CHECK(s_s21.IsConnected());
+}
+
+// A poll cycle the way the driver task runs it
+static void cycle(void) {
+    s_s21.Poll();
+    s_s21.Idle(2000);
+}
+
+#define MAX_DONE 16
+
+static esp_err_t s_results[MAX_DONE];
+static int s_order[MAX_DONE];
+static int s_done_count;
+
+static void record_done(esp_err_t result, void *ctx) {
+    if (s_done_count == MAX_DONE) return;
+    s_results[s_done_count] = result;
+    s_order[s_done_count] = (int)(intptr_t)ctx;
+    s_done_count++;
+}
+
+static s21_control_t control(uint8_t fields, bool power, uint8_t mode, float temp) {
+    s21_control_t c = {};
+    c.fields = fields;
+    c.power = power;
+    c.mode = mode;
+    c.target_temp = temp;
+    return c;
+}
+
+// Fields queued before the driver gets to them go out as a single D1
+S21_TEST(merge_one_write) {
+    start();
+    uint32_t writes = s21_sim_get_stats().writes;
+    s21_control_t c = control(S21_CTRL_POWER, true, 0, 0);
+    CHECK_EQ(s_s21.ApplyControl(&c, record_done, (void *)1), ESP_OK);
+    c = control(S21_CTRL_MODE, false, FAIKIN_MODE_HEAT, 0);
+    CHECK_EQ(s_s21.ApplyControl(&c, record_done, (void *)2), ESP_OK);
+    c = control(S21_CTRL_TEMP, false, 0, 23.5f);
+    CHECK_EQ(s_s21.ApplyControl(&c, record_done, (void *)3), ESP_OK);
+
+    // Readers see the requested values before the unit has them
+    ac_state_t state = s_s21.GetState();
+    CHECK(state.power);
+    CHECK_EQ(state.mode, FAIKIN_MODE_HEAT);
+
+    s_s21.Idle(2000);
+    CHECK_EQ(s21_sim_get_stats().writes, writes + 1);
+    CHECK_EQ(s_done_count, 3);
+    for (int i = 0; i < s_done_count; i++) {
+        CHECK_EQ(s_results[i], ESP_OK);
+        CHECK_EQ(s_order[i], i + 1);
+    }
+    ac_state_t unit = s21_sim_get_unit();
+    CHECK(unit.power);
+    CHECK_EQ(unit.mode, FAIKIN_MODE_HEAT);
+    CHECK(fabsf(unit.target_temp - 23.5f) < 0.3f);
+}
+
+S21_TEST(later_value_wins) {
+    start();
+    uint32_t writes = s21_sim_get_stats().writes;
+    CHECK_EQ(s_s21.SetPower(true), ESP_OK);
+    CHECK_EQ(s_s21.SetMode(FAIKIN_MODE_COOL), ESP_OK);
+    CHECK_EQ(s_s21.SetTemp(20.0f), ESP_OK);
+    CHECK_EQ(s_s21.SetTemp(24.0f), ESP_OK);
+    CHECK(fabsf(s_s21.GetState().target_temp - 24.0f) < 0.01f);
+    cycle();
+    CHECK_EQ(s21_sim_get_stats().writes, writes + 1);
+    CHECK(fabsf(s21_sim_get_unit().target_temp - 24.0f) < 0.3f);
+
+    // Setting what the unit already has sends nothing and completes at once
+    s21_control_t c = control(S21_CTRL_TEMP, false, 0, 24.0f);
+    CHECK_EQ(s_s21.ApplyControl(&c, record_done, nullptr), ESP_OK);
+    cycle();
+    CHECK_EQ(s21_sim_get_stats().writes, writes + 1);
+    CHECK_EQ(s_done_count, 1);
+    CHECK_EQ(s_results[0], ESP_OK);
+}
+
+// Submitting never blocks: once S21_CMD_QUEUE_DEPTH commands wait, the next one fails
+S21_TEST(queue_full) {
+    start();
+    for (int i = 0; i < S21_CMD_QUEUE_DEPTH; i++) CHECK_EQ(s_s21.SetTemp(20.0f + i), ESP_OK);
+    CHECK_EQ(s_s21.SetTemp(30.0f), ESP_ERR_NO_MEM);
+    // The refused value is not shown to readers
+    CHECK(fabsf(s_s21.GetState().target_temp - (20.0f + S21_CMD_QUEUE_DEPTH - 1)) < 0.01f);
+
+    cycle();
+    CHECK_EQ(s_s21.SetTemp(30.0f), ESP_OK);
+}
+
+// A demand limit is queued ahead of the control changes already waiting, and its D7 goes
+// out before their D1
+S21_TEST(urgent_first) {
+    start();
+    CHECK(s_s21.HasRegister(S21_REG_ECONO));
+    cycle();
+    s_done_count = 0;
+    s21_control_t c = control(S21_CTRL_POWER | S21_CTRL_TEMP, true, 0, 21.0f);
+    CHECK_EQ(s_s21.ApplyControl(&c, record_done, (void *)1), ESP_OK);
+    s21_cmd_t refresh = {};
+    refresh.type = S21_CMD_REFRESH;
+    refresh.done = record_done;
+    refresh.ctx = (void *)2;
+    CHECK_EQ(s_s21.Submit(&refresh), ESP_OK);
+    s21_demand_t demand = { 60, false };
+    CHECK_EQ(s_s21.ApplyDemand(&demand, record_done, (void *)3), ESP_OK);
+
+    s_s21.Idle(3000);
+    CHECK_EQ(s_done_count, 3);
+    int control_at = -1, demand_at = -1;
+    for (int i = 0; i < s_done_count; i++) {
+        CHECK_EQ(s_results[i], ESP_OK);
+        if (s_order[i] == 1) control_at = i;
+        if (s_order[i] == 3) demand_at = i;
+    }
+    CHECK(demand_at >= 0 && control_at > demand_at);
+    CHECK_EQ(s21_sim_get_demand().limit_pct, 60);
+    CHECK(s21_sim_get_unit().power);
+}
+
+// A write the unit never ACKs fails once its deadline passes
+S21_TEST(timeout) {
+    start();
+    s21_sim_faults_t faults = {};
+    faults.drop_pct = 100;
+    s21_sim_set_faults(&faults);
+    s21_control_t c = control(S21_CTRL_POWER, true, 0, 0);
+    CHECK_EQ(s_s21.ApplyControl(&c, record_done, nullptr, 3000), ESP_OK);
+    int64_t submitted = s21_port_time_us();
+    while (s_done_count == 0 && s21_port_time_us() - submitted < 30000000) cycle();
+    CHECK_EQ(s_done_count, 1);
+    CHECK_EQ(s_results[0], ESP_ERR_TIMEOUT);
+    CHECK(s21_port_time_us() - submitted >= 3000000);
+
+    // The change is not lost: it goes out once the unit answers again
+    s21_sim_faults_t clean = {};
+    s21_sim_set_faults(&clean);
+    for (int i = 0; i < 10 && !s21_sim_get_unit().power; i++) cycle();
+    CHECK(s21_sim_get_unit().power);
+}
+
+// A refresh reads the status at once instead of at the next poll
+S21_TEST(refresh) {
+    start();
+    cycle();
+    uint32_t queries = s21_sim_get_stats().queries;
+    s21_cmd_t refresh = {};
+    refresh.type = S21_CMD_REFRESH;
+    refresh.done = record_done;
+    CHECK_EQ(s_s21.Submit(&refresh), ESP_OK);
+    int64_t submitted = s21_port_time_us();
+    s_s21.Idle(2000);
+    CHECK_EQ(s_done_count, 1);
+    CHECK_EQ(s21_sim_get_stats().queries, queries + 1);
+    CHECK(s21_port_time_us() - submitted >= 2000000);
+}
+
+// Every maintenance register has been read at least once since the call
+static void read_maintenance(void) {
+    for (int i = 0; i < 20; i++) cycle();
+}
+
+// The filter sign counts from the base set at the last ResetCondition, not from the unit's
+// own counter
+S21_TEST(filter_sign_from_base) {
+    start();
+    s21_sim_set_filter_hours(S21_FILTER_LIFE_HOURS + 100);
+    read_maintenance();
+    CHECK_EQ(s_s21.GetMaint().filter_hours, S21_FILTER_LIFE_HOURS + 100);
+    CHECK(s_s21.GetMaint().filter_sign);
+
+    s21_config_set_filter_base(S21_FILTER_LIFE_HOURS);
+    read_maintenance();
+    CHECK(!s_s21.GetMaint().filter_sign);
+
+    s21_sim_set_filter_hours(2 * S21_FILTER_LIFE_HOURS);
+    read_maintenance();
+    CHECK(s_s21.GetMaint().filter_sign);
+
+    // Reset at the unit: its counter drops below the base and counts from zero again
+    s21_sim_set_filter_hours(10);
+    read_maintenance();
+    CHECK_EQ(s_s21.GetMaint().filter_hours, 10);
+    CHECK(!s_s21.GetMaint().filter_sign);
+    CHECK_EQ(s21_filter_used_hours(10, S21_FILTER_LIFE_HOURS), 10);
+    CHECK_EQ(s21_filter_used_hours(S21_FILTER_LIFE_HOURS + 5, S21_FILTER_LIFE_HOURS), 5);
+}
+
+#define MAX_MAINT 16
+
+static s21_maint_t s_maint_seen[MAX_MAINT];
+static int s_maint_count;
+
+static void record_maint(const s21_maint_t *maint) {
+    if (s_maint_count < MAX_MAINT) s_maint_seen[s_maint_count++] = *maint;
+}
+
+// RW is read before RF, so a unit with an error code reports it while the filter counter is
+// still unread; a zero counter then must not pass for a reset at the unit
+S21_TEST(error_before_filter) {
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    s21_config_set_filter_base(500);
+    s_s21.SetMaintCallback(record_maint);
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    s21_sim_set_error("U4");
+    s21_sim_set_filter_hours(800);
+    CHECK_EQ(s_s21.DiscoverCapabilities(), ESP_OK);
+    read_maintenance();
+
+    // Applied to every update in turn, as app_maintenance does, the base stands
+    CHECK(s_maint_count >= 2);
+    CHECK(strcmp(s_maint_seen[0].error_code, "U4") == 0);
+    CHECK(!s_maint_seen[0].filter_known);
+    uint16_t base = 500;
+    for (int i = 0; i < s_maint_count; i++) base = s21_filter_base_check(&s_maint_seen[i], base);
+    CHECK_EQ(base, 500);
+    s21_maint_t maint = s_s21.GetMaint();
+    CHECK(maint.filter_known);
+    CHECK_EQ(maint.filter_hours, 800);
+    CHECK_EQ(s21_filter_used_hours(maint.filter_hours, base), 300);
+
+    // A counter read below the base was reset at the unit
+    s21_sim_set_filter_hours(100);
+    read_maintenance();
+    maint = s_s21.GetMaint();
+    CHECK_EQ(maint.filter_hours, 100);
+    CHECK_EQ(s21_filter_base_check(&maint, base), 0);
+}
+
+// Error codes arrive through RW and fall into the fault classes Matter reports
+S21_TEST(fault_class) {
+    start();
+    CHECK_EQ(s_s21.GetMaint().error_code[0], 0);
+    s21_sim_set_error("E5");
+    read_maintenance();
+    CHECK(strcmp(s_s21.GetMaint().error_code, "E5") == 0);
+    CHECK_EQ(s21_fault_class(s_s21.GetMaint().error_code), S21_FAULT_OVER_TEMP);
+    s21_sim_set_error(nullptr);
+    read_maintenance();
+    CHECK_EQ(s_s21.GetMaint().error_code[0], 0);
+
+    CHECK_EQ(s21_fault_class(""), S21_FAULT_NONE);
+    CHECK_EQ(s21_fault_class(nullptr), S21_FAULT_NONE);
+    static const char *const sensor[] = { "C4", "C9", "H9", "J3", "P4" };
+    static const char *const over_temp[] = { "A5", "E3", "F3", "F6", "L4" };
+    static const char *const power[] = { "L5", "LC", "P1", "U2" };
+    static const char *const other[] = { "U4", "UA", "A1", "E7", "P9" };
+    for (const char *code : sensor) CHECK_EQ(s21_fault_class(code), S21_FAULT_SENSOR);
+    for (const char *code : over_temp) CHECK_EQ(s21_fault_class(code), S21_FAULT_OVER_TEMP);
+    for (const char *code : power) CHECK_EQ(s21_fault_class(code), S21_FAULT_POWER);
+    for (const char *code : other) CHECK_EQ(s21_fault_class(code), S21_FAULT_OTHER);
+}
+
+static uint32_t s_sampled_s; // Time active_seconds() sampled over
+
+// Runs poll cycles for at least seconds, sampling the statistics after each, and returns the
+// active seconds they counted
+static uint32_t active_seconds(int seconds) {
+    s21_stats_bucket_t bucket;
+    uint32_t bucket_s;
+    s21_stats_totals_t totals;
+    s21_stats_get(&bucket, &bucket_s, &totals);
+    uint32_t before = bucket.active_s, before_s = bucket_s;
+    int64_t until = s21_port_time_us() + (int64_t)seconds * 1000000;
+    while (s21_port_time_us() < until) {
+        cycle();
+        ac_state_t state = s_s21.GetState();
+        s21_stats_sample(&state, s21_port_time_us());
+    }
+    s21_stats_get(&bucket, &bucket_s, &totals);
+    s_sampled_s = bucket_s - before_s;
+    return bucket.active_s - before;
+}
+
+static void heat_to(float target, float room) {
+    s21_sim_set_room_temp(room);
+    s21_control_t c = control(S21_CTRL_POWER | S21_CTRL_MODE | S21_CTRL_TEMP, true, FAIKIN_MODE_HEAT, target);
+    CHECK_EQ(s_s21.ApplyControl(&c), ESP_OK);
+    active_seconds(15);
+}
+
+// With Rd, active time is the time the compressor runs, whatever the room temperature says
+S21_TEST(compressor_active) {
+    start();
+    s21_stats_init(nullptr, nullptr);
+    CHECK(s_s21.HasRegister(S21_REG_COMPRESSOR));
+    heat_to(24.0f, 18.0f);
+    ac_state_t state = s_s21.GetState();
+    CHECK(state.compressor_hz > 0);
+    CHECK(s21_state_active(&state));
+    uint32_t active = active_seconds(60);
+    CHECK(s_sampled_s >= 60 && active + 1 >= s_sampled_s);
+
+    // Short of the setpoint but the compressor rests, e.g. defrosting or cycling off
+    s21_sim_set_compressor(0);
+    active_seconds(15);
+    CHECK_EQ(s_s21.GetState().compressor_hz, 0);
+    CHECK(s_s21.GetState().current_temp < s_s21.GetState().target_temp);
+    CHECK(active_seconds(60) <= 2);
+
+    // Past the setpoint but still running down its minimum run time
+    s21_sim_set_room_temp(25.0f);
+    s21_sim_set_compressor(30);
+    active_seconds(15);
+    state = s_s21.GetState();
+    CHECK(state.current_temp > state.target_temp);
+    CHECK(s21_state_active(&state));
+    active = active_seconds(60);
+    CHECK(s_sampled_s >= 60 && active + 1 >= s_sampled_s);
+
+    // Off is never active
+    CHECK_EQ(s_s21.SetPower(false), ESP_OK);
+    active_seconds(15);
+    CHECK(active_seconds(60) <= 2);
+}
+
+// Without Rd the room against the setpoint stands in for the compressor
+S21_TEST(compressor_fallback) {
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    s21_sim_set_compressor(S21_SIM_COMPRESSOR_NONE);
+    CHECK_EQ(s_s21.DiscoverCapabilities(), ESP_OK);
+    s_s21.Poll();
+    CHECK(!s_s21.HasRegister(S21_REG_COMPRESSOR));
+    s21_stats_init(nullptr, nullptr);
+    uint32_t queries = s21_sim_get_stats().queries;
+    heat_to(24.0f, 18.0f);
+    CHECK_EQ(s_s21.GetState().compressor_hz, -1);
+    uint32_t active = active_seconds(60);
+    CHECK(s_sampled_s >= 60 && active + 1 >= s_sampled_s);
+    CHECK(s21_sim_get_stats().queries > queries);
+
+    s21_sim_set_room_temp(25.0f);
+    active_seconds(15);
+    CHECK(active_seconds(60) <= 2);
+}
+
+static ac_state_t s_notified[MAX_DONE];
+static int s_notified_count;
+
+static void record_state(const ac_state_t *state) {
+    if (s_notified_count < MAX_DONE) s_notified[s_notified_count++] = *state;
+}
+
+// The state stored before a reboot is shown until the first status read, and that read is
+// notified even when the unit's state matches it. In the app's order: no cached capabilities,
+// so discovery reads the status before the callback is set.
+S21_TEST(first_status) {
+    ac_state_t stored = {};
+    stored.power = false;
+    stored.mode = FAIKIN_MODE_COOL;
+    stored.target_temp = 24.0f;
+    stored.fan_speed = FAIKIN_FAN_AUTO;
+    CHECK_EQ(s21_config_load(), ESP_OK);
+    s21_config_set_state(&stored);
+    CHECK_EQ(s21_config_flush(), ESP_OK);
+    CHECK(!(s21_config_get().flags & S21_CONFIG_HAS_CAPS));
+
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    ac_state_t state = s_s21.GetState();
+    CHECK_EQ(state.mode, FAIKIN_MODE_COOL);
+    CHECK(fabsf(state.target_temp - 24.0f) < 0.01f);
+
+    // The unit has what was stored
+    ac_state_t unit = s21_sim_get_unit();
+    CHECK_EQ(unit.power, stored.power);
+    CHECK_EQ(unit.mode, stored.mode);
+    CHECK(fabsf(unit.target_temp - stored.target_temp) < 0.01f);
+    uint32_t queries = s21_sim_get_stats().queries;
+    CHECK_EQ(s_s21.DiscoverCapabilities(), ESP_OK);
+    CHECK(s21_sim_get_stats().queries > queries + 1);
+    CHECK(s21_config_get().flags & S21_CONFIG_HAS_CAPS);
+
+    // Discovery already read every sensor, so the first poll changes nothing; it is notified
+    // all the same, being the first status read the callback could see
+    s_s21.SetStateCallback(record_state);
+    s_s21.Poll();
+    CHECK_EQ(s_notified_count, 1);
+    CHECK_EQ(s_notified[0].mode, FAIKIN_MODE_COOL);
+    CHECK(fabsf(s_notified[0].current_temp - unit.current_temp) < 0.1f);
+
+    // Later reads of the same status stay quiet
+    cycle();
+    cycle();
+    CHECK_EQ(s_notified_count, 1);
+}
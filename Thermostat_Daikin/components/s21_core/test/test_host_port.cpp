@@ -0,0 +1,184 @@
+#include "s21_test.h"
+#include "s21_port_host.h"
+#include "s21_parser.h"
+#include "s21_sim.h"
+#include <string.h>
+
+// The host port the other tests run on: the virtual clock, its queues and storage, and the
+// timing of the simulated unit behind the UART functions
+
+static int s_ticks;
+static int64_t s_last_tick_us;
+static int64_t s_max_step_us;
+
+static void record_tick(int64_t now_us) {
+    if (now_us - s_last_tick_us > s_max_step_us) s_max_step_us = now_us - s_last_tick_us;
+    s_last_tick_us = now_us;
+    s_ticks++;
+}
+
+S21_TEST(clock_ticks) {
+    int64_t start = s21_port_time_us();
+    s_last_tick_us = start;
+    s21_host_set_tick(record_tick);
+    s21_host_advance_us(35000);
+    CHECK_EQ(s21_port_time_us(), start + 35000);
+    CHECK_EQ(s_ticks, 4);
+    CHECK_EQ(s_last_tick_us, start + 35000);
+    CHECK(s_max_step_us <= S21_HOST_TICK_MS * 1000);
+
+    // Nothing moves the clock but the port itself
+    int64_t now = s21_port_time_us();
+    CHECK_EQ(s21_port_time_us(), now);
+    s21_host_advance_us(0);
+    CHECK_EQ(s21_port_time_us(), now);
+    s21_host_set_tick(nullptr);
+}
+
+S21_TEST(delay) {
+    int64_t start = s21_port_time_us();
+    s_last_tick_us = start;
+    s21_host_set_tick(record_tick);
+    s21_port_delay_ms(250);
+    CHECK_EQ(s21_port_time_us(), start + 250000);
+    CHECK_EQ(s_ticks, 25);
+    s21_host_set_tick(nullptr);
+}
+
+static uint8_t s_storage[4 * sizeof(uint32_t)];
+
+S21_TEST(queue_wait) {
+    s21_port_queue_t queue = s21_port_queue_create(4, sizeof(uint32_t), s_storage);
+    CHECK(queue != nullptr);
+    uint32_t item = 0;
+    int64_t start = s21_port_time_us();
+    CHECK(!s21_port_queue_receive(queue, &item, 100));
+    CHECK_EQ(s21_port_time_us(), start + 100000);
+    CHECK(!s21_port_queue_receive(queue, &item, 0));
+    CHECK_EQ(s21_port_time_us(), start + 100000);
+}
+
+static s21_port_queue_t s_queue;
+static int64_t s_send_at_us;
+
+static void send_later(int64_t now_us) {
+    uint32_t item = 7;
+    if (s_send_at_us && now_us >= s_send_at_us) {
+        s21_port_queue_send(s_queue, &item);
+        s_send_at_us = 0;
+    }
+}
+
+// A wait ends on the tick after something was queued, not at its timeout
+S21_TEST(queue_wakes_on_submit) {
+    s_queue = s21_port_queue_create(4, sizeof(uint32_t), s_storage);
+    int64_t start = s21_port_time_us();
+    s_send_at_us = start + 30000;
+    s21_host_set_tick(send_later);
+    uint32_t item = 0;
+    CHECK(s21_port_queue_receive(s_queue, &item, 1000));
+    CHECK_EQ(item, 7);
+    CHECK_EQ(s21_port_time_us(), start + 30000);
+    s21_host_set_tick(nullptr);
+}
+
+S21_TEST(queue_order) {
+    s21_port_queue_t queue = s21_port_queue_create(4, sizeof(uint32_t), s_storage);
+    uint32_t items[] = { 1, 2, 3, 4, 5 };
+    CHECK(s21_port_queue_send(queue, &items[0]));
+    CHECK(s21_port_queue_send(queue, &items[1]));
+    CHECK(s21_port_queue_send_front(queue, &items[2]));
+    CHECK(s21_port_queue_send(queue, &items[3]));
+    // Full: neither end takes more
+    CHECK(!s21_port_queue_send(queue, &items[4]));
+    CHECK(!s21_port_queue_send_front(queue, &items[4]));
+
+    const uint32_t expect[] = { 3, 1, 2, 4 };
+    for (int i = 0; i < 4; i++) {
+        uint32_t item = 0;
+        CHECK(s21_port_queue_receive(queue, &item, 0));
+        CHECK_EQ(item, expect[i]);
+    }
+
+    // Wrapping around the storage keeps the order
+    for (int round = 0; round < 10; round++) {
+        CHECK(s21_port_queue_send(queue, &items[round % 5]));
+        CHECK(s21_port_queue_send_front(queue, &items[(round + 1) % 5]));
+        uint32_t a = 0, b = 0;
+        CHECK(s21_port_queue_receive(queue, &a, 0));
+        CHECK(s21_port_queue_receive(queue, &b, 0));
+        CHECK_EQ(a, items[(round + 1) % 5]);
+        CHECK_EQ(b, items[round % 5]);
+    }
+
+    // The port has room for the driver's queue and one more
+    CHECK(s21_port_queue_create(4, sizeof(uint32_t), s_storage) != nullptr);
+    CHECK(s21_port_queue_create(4, sizeof(uint32_t), s_storage) == nullptr);
+}
+
+S21_TEST(storage) {
+    const uint8_t blob[] = { 1, 2, 3, 4, 5 };
+    uint8_t buf[16];
+    size_t len = sizeof(buf);
+    CHECK_EQ(s21_port_storage_read("config", buf, &len), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(s21_port_storage_write("config", blob, sizeof(blob)), ESP_OK);
+    len = sizeof(buf);
+    CHECK_EQ(s21_port_storage_read("config", buf, &len), ESP_OK);
+    CHECK_EQ(len, sizeof(blob));
+    CHECK(memcmp(buf, blob, sizeof(blob)) == 0);
+
+    // Too small a buffer is refused rather than cut short
+    len = 2;
+    CHECK_EQ(s21_port_storage_read("config", buf, &len), ESP_ERR_INVALID_SIZE);
+
+    CHECK_EQ(s21_port_storage_erase("config"), ESP_OK);
+    CHECK_EQ(s21_port_storage_erase("config"), ESP_OK);
+    len = sizeof(buf);
+    CHECK_EQ(s21_port_storage_read("config", buf, &len), ESP_ERR_NOT_FOUND);
+
+    CHECK_EQ(s21_port_storage_write("a-key-far-too-long", blob, sizeof(blob)), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(s21_port_storage_write("stats", blob, sizeof(blob)), ESP_OK);
+    s21_host_storage_clear();
+    len = sizeof(buf);
+    CHECK_EQ(s21_port_storage_read("stats", buf, &len), ESP_ERR_NOT_FOUND);
+}
+
+// A query costs a character time per byte. The unit answers S21_SIM_REPLY_DELAY_MS after it
+// sees the ETX with an ACK and the reply frame, again a character time per byte.
+S21_TEST(sim_timing) {
+    CHECK_EQ(s21_port_uart_init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    uint8_t query[S21_MIN_PKT_LEN] = { STX, 'F', '1', 0, ETX };
+    query[3] = s21_checksum(query, sizeof(query));
+
+    int64_t start = s21_port_time_us();
+    for (size_t i = 0; i < sizeof(query); i++) s21_port_uart_write(query[i]);
+    int64_t sent = s21_port_time_us();
+    CHECK_EQ(sent - start, (int64_t)sizeof(query) * S21_SIM_CHAR_US);
+
+    CHECK_EQ(s21_port_uart_read(1000), ACK);
+    int64_t acked = s21_port_time_us();
+    int64_t etx = sent - S21_SIM_CHAR_US;
+    CHECK(acked - etx >= S21_SIM_REPLY_DELAY_MS * 1000);
+    CHECK(acked - etx <= S21_SIM_REPLY_DELAY_MS * 1000 + S21_HOST_TICK_MS * 1000);
+
+    S21Parser parser;
+    s21_parse_result_t result = S21_PARSE_NONE;
+    int bytes = 0;
+    while (result == S21_PARSE_NONE) {
+        int byte = s21_port_uart_read(100);
+        CHECK(byte >= 0);
+        if (byte < 0) break;
+        bytes++;
+        result = parser.Feed((uint8_t)byte);
+    }
+    CHECK_EQ(result, S21_PARSE_FRAME);
+    CHECK_EQ(parser.Frame()[1], 'G');
+    CHECK_EQ(parser.Frame()[2], '1');
+    CHECK_EQ(s21_port_time_us() - acked, (int64_t)bytes * S21_SIM_CHAR_US);
+
+    // Nothing more on the way: a read times out after exactly its timeout
+    int64_t before = s21_port_time_us();
+    CHECK_EQ(s21_port_uart_read(200), -1);
+    CHECK_EQ(s21_port_time_us() - before, 200000);
+    CHECK_EQ(s21_sim_get_stats().queries, 1);
+}
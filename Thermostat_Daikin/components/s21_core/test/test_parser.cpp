@@ -0,0 +1,186 @@
+#include "s21_test.h"
+#include "s21_parser.h"
+#include <string.h>
+
+// S21Parser against hand-built frames: framing, checksum promotion and recovery from the
+// faults the line produces (lost bytes, corrupt checksums, noise, runaway frames)
+
+// STX, the command and payload in body, checksum, ETX. Returns the frame length.
+static int build_frame(const char *body, uint8_t *frame) {
+    int len = (int)strlen(body);
+    frame[0] = STX;
+    memcpy(&frame[1], body, len);
+    frame[len + 2] = ETX;
+    frame[len + 1] = s21_checksum(frame, len + 3);
+    return len + 3;
+}
+
+// Feed every byte, returning the result for the last one; earlier bytes must need more
+static s21_parse_result_t feed_frame(S21Parser &parser, const uint8_t *frame, int len) {
+    for (int i = 0; i < len - 1; i++) CHECK_EQ(parser.Feed(frame[i]), S21_PARSE_NONE);
+    return parser.Feed(frame[len - 1]);
+}
+
+S21_TEST(frame) {
+    S21Parser parser;
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame("G11300", frame);
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+    CHECK(!parser.InFrame());
+    CHECK_EQ(parser.FrameLen(), len);
+    CHECK_EQ(parser.PayloadLen(), 4);
+    CHECK(memcmp(parser.Payload(), "1300", 4) == 0);
+    CHECK_EQ(parser.GetStats().frames, 1);
+
+    // A frame without payload is the shortest valid one
+    len = build_frame("G8", frame);
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+    CHECK_EQ(parser.PayloadLen(), 0);
+    CHECK_EQ(parser.GetStats().frames, 2);
+}
+
+S21_TEST(ack_nak) {
+    S21Parser parser;
+    CHECK_EQ(parser.Feed(ACK), S21_PARSE_ACK);
+    CHECK_EQ(parser.Feed(NAK), S21_PARSE_NAK);
+
+    // Inside a frame the same bytes are payload
+    CHECK_EQ(parser.Feed(STX), S21_PARSE_NONE);
+    CHECK_EQ(parser.Feed(ACK), S21_PARSE_NONE);
+    CHECK_EQ(parser.Feed(NAK), S21_PARSE_NONE);
+    CHECK(parser.InFrame());
+    CHECK_EQ(parser.GetStats().noise, 0);
+}
+
+// Every possible sum: the three framing bytes are promoted by 2, nothing else changes
+S21_TEST(checksum_promotion) {
+    uint8_t frame[S21_MIN_PKT_LEN + 1];
+    for (int sum = 0; sum < 256; sum++) {
+        // 'G' + '1' + payload == sum (mod 256)
+        frame[0] = STX;
+        frame[1] = 'G';
+        frame[2] = '1';
+        frame[3] = (uint8_t)(sum - 'G' - '1');
+        frame[5] = ETX;
+        uint8_t c = s21_checksum(frame, sizeof(frame));
+        if (sum == STX || sum == ETX || sum == ACK) {
+            CHECK_EQ(c, sum + 2);
+        } else {
+            CHECK_EQ(c, sum);
+        }
+        CHECK(c != STX && c != ETX && c != ACK);
+
+        // Every such frame parses, unless its payload byte is itself STX or ETX
+        if (frame[3] == STX || frame[3] == ETX) continue;
+        frame[4] = c;
+        S21Parser parser;
+        CHECK_EQ(feed_frame(parser, frame, sizeof(frame)), S21_PARSE_FRAME);
+    }
+}
+
+// "SH44" sums to 0x103: a literal ETX checksum would end the frame early, so it goes out as 5
+S21_TEST(promoted_frame) {
+    S21Parser parser;
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame("SH44", frame);
+    CHECK_EQ(frame[len - 2], ETX + 2);
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+    CHECK(memcmp(parser.Payload(), "44", 2) == 0);
+
+    // A sender that does not promote: the checksum byte terminates the frame, which fails
+    frame[len - 2] = ETX;
+    CHECK_EQ(feed_frame(parser, frame, len - 1), S21_PARSE_BAD_FRAME);
+    // and the real ETX after it is noise
+    CHECK_EQ(parser.Feed(ETX), S21_PARSE_NONE);
+    CHECK_EQ(parser.GetStats().noise, 1);
+    CHECK_EQ(parser.GetStats().bad_frames, 1);
+}
+
+S21_TEST(bad_checksum) {
+    S21Parser parser;
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame("SH+235", frame);
+    frame[len - 2] ^= 0x10;
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_BAD_FRAME);
+    CHECK_EQ(parser.GetStats().bad_frames, 1);
+    CHECK_EQ(parser.GetStats().frames, 0);
+
+    // A corrupt payload byte is caught the same way
+    len = build_frame("SH+235", frame);
+    frame[4] = '9';
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_BAD_FRAME);
+    CHECK_EQ(parser.GetStats().bad_frames, 2);
+}
+
+S21_TEST(truncated) {
+    S21Parser parser;
+    // Too short to hold a command and checksum
+    const uint8_t runt[] = { STX, 'G', ETX };
+    CHECK_EQ(feed_frame(parser, runt, sizeof(runt)), S21_PARSE_BAD_FRAME);
+    const uint8_t empty[] = { STX, ETX };
+    CHECK_EQ(feed_frame(parser, empty, sizeof(empty)), S21_PARSE_BAD_FRAME);
+    CHECK_EQ(parser.GetStats().bad_frames, 2);
+
+    // A frame cut off before its ETX is dropped when the next one starts
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame("G11300", frame);
+    for (int i = 0; i < len - 3; i++) parser.Feed(frame[i]);
+    CHECK(parser.InFrame());
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+    CHECK_EQ(parser.GetStats().resyncs, 1);
+
+    // Reset() forgets a partial frame
+    for (int i = 0; i < len - 1; i++) parser.Feed(frame[i]);
+    parser.Reset();
+    CHECK(!parser.InFrame());
+    CHECK_EQ(parser.Feed(ETX), S21_PARSE_NONE);
+    CHECK_EQ(parser.GetStats().frames, 1);
+}
+
+// Garbage between STX and ETX: every STX starts over, the last frame wins
+S21_TEST(resync) {
+    S21Parser parser;
+    const uint8_t garbage[] = { STX, 'G', 0x7f, 0x00, STX, 0xff, STX };
+    for (size_t i = 0; i < sizeof(garbage); i++) CHECK_EQ(parser.Feed(garbage[i]), S21_PARSE_NONE);
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame("Sa-050", frame);
+    CHECK_EQ(parser.Feed(frame[0]), S21_PARSE_NONE);
+    CHECK_EQ(feed_frame(parser, &frame[1], len - 1), S21_PARSE_FRAME);
+    CHECK(memcmp(parser.Payload(), "-050", 4) == 0);
+    CHECK_EQ(parser.GetStats().resyncs, 3);
+    CHECK_EQ(parser.GetStats().frames, 1);
+    CHECK_EQ(parser.GetStats().bad_frames, 0);
+}
+
+S21_TEST(overflow) {
+    S21Parser parser;
+    CHECK_EQ(parser.Feed(STX), S21_PARSE_NONE);
+    for (int i = 0; i < 2 * S21_MAX_PKT_LEN; i++) CHECK_EQ(parser.Feed('0' + i % 10), S21_PARSE_NONE);
+    CHECK_EQ(parser.Feed(ETX), S21_PARSE_OVERFLOW);
+    CHECK_EQ(parser.GetStats().overflows, 1);
+    CHECK(!parser.InFrame());
+
+    // The longest frame that fits still parses, and so does a normal one after the overflow
+    char body[S21_MAX_PKT_LEN];
+    memset(body, '5', sizeof(body));
+    body[0] = 'S';
+    body[1] = 'H';
+    body[S21_MAX_PKT_LEN - S21_FRAMING_LEN] = '\0';
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame(body, frame);
+    CHECK_EQ(len, S21_MAX_PKT_LEN);
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+    len = build_frame("G8", frame);
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+    CHECK_EQ(parser.GetStats().frames, 2);
+}
+
+S21_TEST(noise) {
+    S21Parser parser;
+    const uint8_t noise[] = { 0x00, 'G', ETX, 0xff, 0x80 };
+    for (size_t i = 0; i < sizeof(noise); i++) CHECK_EQ(parser.Feed(noise[i]), S21_PARSE_NONE);
+    CHECK_EQ(parser.GetStats().noise, sizeof(noise));
+    uint8_t frame[S21_MAX_PKT_LEN];
+    int len = build_frame("G8", frame);
+    CHECK_EQ(feed_frame(parser, frame, len), S21_PARSE_FRAME);
+}
@@ -0,0 +1,156 @@
+#include "s21_test.h"
+#include "s21_peer.h"
+#include <math.h>
+#include <string.h>
+
+// Peer messages: the SipHash tag, tampering and wrong keys, and the guard a unit puts in
+// front of control messages
+
+static const uint8_t s_key[S21_PEER_KEY_LEN] = { 0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+                                                 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+static const uint8_t s_bridge[S21_PEER_ADDR_LEN] = { 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0x14, 0xc9 };
+static const uint8_t s_other[S21_PEER_ADDR_LEN] = { 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0x14, 0xc9 };
+
+#define SECOND_US 1000000LL
+
+static s21_peer_msg_t control_msg(uint16_t seq, uint16_t ack_seq) {
+    s21_peer_msg_t msg = {};
+    msg.type = S21_PEER_MSG_CONTROL;
+    msg.seq = seq;
+    msg.ack_seq = ack_seq;
+    msg.control.fields = S21_CTRL_TEMP;
+    msg.control.target_temp = 22.5f;
+    return msg;
+}
+
+// The reference vector from the SipHash paper: key 00..0f, message 00..0e
+S21_TEST(siphash_vector) {
+    uint8_t key[S21_PEER_KEY_LEN], data[15];
+    for (int i = 0; i < S21_PEER_KEY_LEN; i++) key[i] = (uint8_t)i;
+    for (int i = 0; i < (int)sizeof(data); i++) data[i] = (uint8_t)i;
+    CHECK(s21_peer_siphash(key, data, sizeof(data)) == 0xa129ca6149be45e5ULL);
+    CHECK(s21_peer_siphash(key, data, 0) == 0x726fdb47dd0e0e31ULL);
+}
+
+S21_TEST(round_trip) {
+    s21_peer_msg_t msg = {};
+    msg.type = S21_PEER_MSG_STATE;
+    msg.seq = 0xfffe;
+    memcpy(msg.unit_id, "\x02S21\x00\x07", S21_PEER_UNIT_ID_LEN);
+    msg.state.power = true;
+    msg.state.mode = FAIKIN_MODE_HEAT;
+    msg.state.target_temp = 21.5f;
+    msg.state.current_temp = 19.25f;
+    msg.state.outside_temp = NAN;
+    uint8_t buf[S21_PEER_MAX_MSG_LEN];
+    size_t len = s21_peer_encode(&msg, s_key, buf, sizeof(buf));
+    CHECK(len > 0);
+    s21_peer_msg_t out;
+    CHECK_EQ(s21_peer_decode(buf, len, s_key, &out), ESP_OK);
+    CHECK_EQ(out.type, S21_PEER_MSG_STATE);
+    CHECK_EQ(out.seq, 0xfffe);
+    CHECK(memcmp(out.unit_id, msg.unit_id, S21_PEER_UNIT_ID_LEN) == 0);
+    CHECK(out.state.power);
+    CHECK_EQ(out.state.mode, FAIKIN_MODE_HEAT);
+    CHECK(out.state.target_temp == 21.5f);
+    CHECK(out.state.current_temp == 19.25f);
+    CHECK(isnan(out.state.outside_temp));
+
+    msg = control_msg(41, 1234);
+    len = s21_peer_encode(&msg, s_key, buf, sizeof(buf));
+    CHECK(len > 0);
+    CHECK_EQ(s21_peer_decode(buf, len, s_key, &out), ESP_OK);
+    CHECK_EQ(out.seq, 41);
+    CHECK_EQ(out.ack_seq, 1234);
+    CHECK_EQ(out.control.fields, S21_CTRL_TEMP);
+    CHECK(out.control.target_temp == 22.5f);
+    CHECK_EQ(s21_peer_encode(&msg, s_key, buf, len - 1), 0);
+}
+
+// Any changed bit, a wrong key, a truncated or padded datagram: all fail the tag
+S21_TEST(tamper) {
+    s21_peer_msg_t msg = control_msg(7, 100);
+    uint8_t buf[S21_PEER_MAX_MSG_LEN];
+    size_t len = s21_peer_encode(&msg, s_key, buf, sizeof(buf));
+    s21_peer_msg_t out;
+    for (size_t i = 4; i < len; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            buf[i] ^= (uint8_t)(1 << bit);
+            CHECK_EQ(s21_peer_decode(buf, len, s_key, &out), ESP_ERR_INVALID_CRC);
+            buf[i] ^= (uint8_t)(1 << bit);
+        }
+    }
+    CHECK_EQ(s21_peer_decode(buf, len - 1, s_key, &out), ESP_ERR_INVALID_CRC);
+    buf[len] = 0;
+    CHECK_EQ(s21_peer_decode(buf, len + 1, s_key, &out), ESP_ERR_INVALID_CRC);
+
+    uint8_t other_key[S21_PEER_KEY_LEN];
+    memcpy(other_key, s_key, sizeof(other_key));
+    other_key[15] ^= 1;
+    CHECK_EQ(s21_peer_decode(buf, len, other_key, &out), ESP_ERR_INVALID_CRC);
+    CHECK_EQ(s21_peer_decode(buf, len, s_key, &out), ESP_OK);
+
+    // Old senders and strangers are told apart before the tag
+    buf[2] = 1;
+    CHECK_EQ(s21_peer_decode(buf, len, s_key, &out), ESP_ERR_INVALID_VERSION);
+    buf[0] = 'X';
+    CHECK_EQ(s21_peer_decode(buf, len, s_key, &out), ESP_ERR_INVALID_RESPONSE);
+}
+
+// The first control pins the bridge's address; nobody else is heard until it goes quiet
+S21_TEST(guard_address) {
+    s21_peer_guard_t guard = {};
+    int64_t now = 1000 * SECOND_US;
+    s21_peer_msg_t msg = control_msg(1, 50);
+    CHECK_EQ(s21_peer_guard_check(&guard, &msg, s_bridge, 50, now), ESP_OK);
+    msg = control_msg(2, 50);
+    CHECK_EQ(s21_peer_guard_check(&guard, &msg, s_other, 50, now), ESP_ERR_INVALID_STATE);
+    CHECK_EQ(s21_peer_guard_check(&guard, &msg, s_bridge, 50, now), ESP_OK);
+
+    // Still pinned just before the bridge is forgotten, then the next sender is learned
+    now += (S21_PEER_BRIDGE_FORGET_S - 1) * SECOND_US;
+    msg = control_msg(3, 51);
+    CHECK_EQ(s21_peer_guard_check(&guard, &msg, s_other, 51, now), ESP_ERR_INVALID_STATE);
+    now += SECOND_US;
+    CHECK_EQ(s21_peer_guard_check(&guard, &msg, s_other, 51, now), ESP_OK);
+    CHECK(memcmp(guard.bridge_addr, s_other, S21_PEER_ADDR_LEN) == 0);
+    msg = control_msg(4, 51);
+    CHECK_EQ(s21_peer_guard_check(&guard, &msg, s_bridge, 51, now), ESP_ERR_INVALID_STATE);
+}
+
+// A control is applied once: the same, an older or a stale echo is dropped
+S21_TEST(guard_replay) {
+    s21_peer_guard_t guard = {};
+    int64_t now = SECOND_US;
+    uint16_t publish_seq = 0xfffd;
+    s21_peer_msg_t first = control_msg(10, publish_seq);
+    CHECK_EQ(s21_peer_guard_check(&guard, &first, s_bridge, publish_seq, now), ESP_OK);
+    CHECK_EQ(s21_peer_guard_check(&guard, &first, s_bridge, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+    s21_peer_msg_t older = control_msg(9, publish_seq);
+    CHECK_EQ(s21_peer_guard_check(&guard, &older, s_bridge, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+
+    // Two controls before the bridge sees the unit's next state share the echo
+    s21_peer_msg_t second = control_msg(11, publish_seq);
+    CHECK_EQ(s21_peer_guard_check(&guard, &second, s_bridge, publish_seq, now), ESP_OK);
+
+    // The unit publishes across the seq wrap; a newer echo wins whatever the bridge's seq
+    publish_seq += 4;
+    s21_peer_msg_t third = control_msg(3, (uint16_t)(publish_seq - 1));
+    CHECK_EQ(s21_peer_guard_check(&guard, &third, s_bridge, publish_seq, now), ESP_OK);
+    CHECK_EQ(s21_peer_guard_check(&guard, &second, s_bridge, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+
+    // Echoes outside the window: too old, or a state the unit has not sent
+    s21_peer_msg_t stale = control_msg(20, (uint16_t)(publish_seq - S21_PEER_ACK_WINDOW));
+    CHECK_EQ(s21_peer_guard_check(&guard, &stale, s_bridge, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+    s21_peer_msg_t ahead = control_msg(21, (uint16_t)(publish_seq + 1));
+    CHECK_EQ(s21_peer_guard_check(&guard, &ahead, s_bridge, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+    // Inside the window, but older than the echo last applied
+    s21_peer_msg_t edge = control_msg(22, (uint16_t)(publish_seq - S21_PEER_ACK_WINDOW + 1));
+    CHECK_EQ(s21_peer_guard_check(&guard, &edge, s_bridge, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+
+    // Forgetting the bridge's address does not forget what was applied
+    now += S21_PEER_BRIDGE_FORGET_S * SECOND_US;
+    CHECK_EQ(s21_peer_guard_check(&guard, &third, s_other, publish_seq, now), ESP_ERR_INVALID_RESPONSE);
+    s21_peer_msg_t fresh = control_msg(1, publish_seq);
+    CHECK_EQ(s21_peer_guard_check(&guard, &fresh, s_other, publish_seq, now), ESP_OK);
+}
@@ -0,0 +1,149 @@
+#include "s21_test.h"
+#include "report_windows.h"
+
+// ReportWindows driven the way app_reporting drives it: a change is queued for every
+// subscription covering it, each window closes on its own deadline, and at close the paths the
+// subscription still covers are reported, which wakes every subscription covering them.
+
+#define MIN_WINDOW_MS 200
+#define MAX_WINDOW_MS 5000
+#define MS_US 1000LL
+#define MAX_REPORTS 16
+
+enum { TEMP = 0, MODE, FAN, PATHS };
+
+typedef struct {
+    uint32_t id;
+    uint16_t min_interval_s;
+    uint8_t covers; // Bit per path
+    bool active;
+} subscription_t;
+
+typedef struct {
+    uint32_t subscription; // Whose window closed
+    uint32_t attribute_id;
+    int64_t at_us;
+} report_t;
+
+static ReportWindows s_windows(MIN_WINDOW_MS, MAX_WINDOW_MS);
+static subscription_t s_subs[2];
+static report_t s_reports[MAX_REPORTS];
+static int s_report_count;
+
+static report_path_t path(int attr) {
+    return { 1, 0x0201, (uint32_t)attr };
+}
+
+static subscription_t *find(uint32_t id) {
+    for (auto &s : s_subs) {
+        if (s.active && s.id == id) return &s;
+    }
+    return nullptr;
+}
+
+static void mark(int attr, int64_t now_us) {
+    for (auto &s : s_subs) {
+        if (s.active && (s.covers & (1 << attr))) CHECK(s_windows.Add(s.id, s.min_interval_s, path(attr), now_us) != REPORT_FULL);
+    }
+}
+
+static void flush(int64_t now_us) {
+    uint32_t id;
+    report_path_t due[REPORT_MAX_PENDING];
+    int n;
+    while ((n = s_windows.TakeDue(now_us, &id, due)) >= 0) {
+        subscription_t *s = find(id);
+        for (int i = 0; i < n; i++) {
+            if (!s || !(s->covers & (1 << due[i].attribute_id))) continue;
+            CHECK(s_report_count < MAX_REPORTS);
+            s_reports[s_report_count++] = { id, due[i].attribute_id, now_us };
+            s_windows.Reported(due[i]);
+        }
+    }
+}
+
+// Subscription 1 with a 1 s min-interval covers the temperature; subscription 2 with 4 s
+// covers temperature and mode. Each window lasts its own subscription's min-interval.
+S21_TEST(two_subscriptions) {
+    s_subs[0] = { 1, 1, 1 << TEMP, true };
+    s_subs[1] = { 2, 4, (1 << TEMP) | (1 << MODE), true };
+
+    mark(TEMP, 0);
+    mark(MODE, 0);
+    CHECK_EQ(s_windows.OpenWindows(), 2);
+    CHECK_EQ(s_windows.NextDeadline(), 1000 * MS_US);
+    flush(999 * MS_US);
+    CHECK_EQ(s_report_count, 0);
+
+    // The short window reports the temperature, which also wakes subscription 2 for it; the
+    // mode stays pending in subscription 2's window
+    flush(1000 * MS_US);
+    CHECK_EQ(s_report_count, 1);
+    CHECK_EQ(s_reports[0].subscription, 1);
+    CHECK_EQ(s_reports[0].attribute_id, TEMP);
+    CHECK_EQ(s_windows.OpenWindows(), 1);
+    CHECK_EQ(s_windows.NextDeadline(), 4000 * MS_US);
+
+    // A new change opens a new window for subscription 1 only
+    mark(TEMP, 2000 * MS_US);
+    CHECK_EQ(s_windows.NextDeadline(), 3000 * MS_US);
+    flush(3000 * MS_US);
+    CHECK_EQ(s_report_count, 2);
+    CHECK_EQ(s_reports[1].subscription, 1);
+    CHECK_EQ(s_windows.NextDeadline(), 4000 * MS_US);
+
+    flush(3999 * MS_US);
+    CHECK_EQ(s_report_count, 2);
+    flush(4000 * MS_US);
+    CHECK_EQ(s_report_count, 3);
+    CHECK_EQ(s_reports[2].subscription, 2);
+    CHECK_EQ(s_reports[2].attribute_id, MODE);
+    CHECK_EQ(s_windows.OpenWindows(), 0);
+    CHECK_EQ(s_windows.NextDeadline(), -1);
+}
+
+// A subscription that ends, or stops covering a path, before its window closes gets nothing;
+// the other subscription's window is untouched
+S21_TEST(ended) {
+    s_subs[0] = { 1, 1, (1 << TEMP) | (1 << FAN), true };
+    s_subs[1] = { 2, 3, 1 << TEMP, true };
+    mark(TEMP, 0);
+    mark(FAN, 0);
+    s_subs[0].covers = 1 << TEMP;
+    flush(1000 * MS_US);
+    CHECK_EQ(s_report_count, 1);
+    CHECK_EQ(s_reports[0].attribute_id, TEMP);
+
+    mark(TEMP, 1500 * MS_US);
+    s_subs[0].active = false;
+    flush(2500 * MS_US);
+    CHECK_EQ(s_report_count, 1);
+    CHECK_EQ(s_windows.NextDeadline(), 4500 * MS_US);
+    flush(4500 * MS_US);
+    CHECK_EQ(s_report_count, 2);
+    CHECK_EQ(s_reports[1].subscription, 2);
+}
+
+// Windows are clamped, and a repeated change is merged into the pending one
+S21_TEST(clamp_coalesce) {
+    CHECK_EQ(s_windows.Add(1, 0, path(TEMP), 0), REPORT_QUEUED);
+    CHECK_EQ(s_windows.Add(1, 0, path(TEMP), 50 * MS_US), REPORT_COALESCED);
+    CHECK_EQ(s_windows.NextDeadline(), MIN_WINDOW_MS * MS_US);
+    CHECK_EQ(s_windows.Add(2, 3600, path(TEMP), 0), REPORT_QUEUED);
+    report_path_t out[REPORT_MAX_PENDING];
+    CHECK_EQ(s_windows.Take(1, out), 1);
+    CHECK_EQ(s_windows.NextDeadline(), MAX_WINDOW_MS * MS_US);
+}
+
+// A full window or subscription table refuses the change rather than losing another one
+S21_TEST(full) {
+    for (int i = 0; i < REPORT_MAX_PENDING; i++) CHECK_EQ(s_windows.Add(1, 1, path(100 + i), 0), REPORT_QUEUED);
+    CHECK_EQ(s_windows.Add(1, 1, path(99), 0), REPORT_FULL);
+    for (uint32_t id = 2; id <= REPORT_MAX_SUBSCRIPTIONS; id++) CHECK_EQ(s_windows.Add(id, 1, path(TEMP), 0), REPORT_QUEUED);
+    CHECK_EQ(s_windows.Add(REPORT_MAX_SUBSCRIPTIONS + 1, 1, path(TEMP), 0), REPORT_FULL);
+
+    report_path_t out[REPORT_MAX_PENDING];
+    CHECK_EQ(s_windows.Take(1, out), REPORT_MAX_PENDING);
+    CHECK_EQ(out[REPORT_MAX_PENDING - 1].attribute_id, 100 + REPORT_MAX_PENDING - 1);
+    CHECK_EQ(s_windows.Add(REPORT_MAX_SUBSCRIPTIONS + 1, 1, path(TEMP), 0), REPORT_QUEUED);
+}
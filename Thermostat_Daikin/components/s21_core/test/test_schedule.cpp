@@ -0,0 +1,251 @@
+#include "s21_test.h"
+#include "s21_port_host.h"
+#include "thermostat_schedule.h"
+
+// ThermostatSchedule's cursor on the virtual clock, driven the way app_schedule drives it: a
+// resync seeks and applies the transition in effect, a one-shot timer fires the next one and
+// re-arms, and a firing that finds the cursor out of step resyncs. The clock starts on
+// Sunday 00:00 and has no DST or clock jumps, so every transition must fire on its minute.
+
+#define MINUTE_US (60 * 1000000LL)
+#define DAY_MIN   SCHEDULE_MINUTES_PER_DAY
+#define MAX_APPLIED 32
+
+enum { SUN = 0, MON, TUE, WED, THU, FRI, SAT };
+
+static ThermostatSchedule s_schedule;
+static int64_t s_timer_at_us; // 0 while disarmed
+
+typedef struct {
+    uint16_t minute;   // Minute of week when applied
+    uint8_t heat_half;
+    bool fired;        // From the timer, not a resync
+} applied_t;
+
+static applied_t s_applied[MAX_APPLIED];
+static int s_applied_count;
+static int s_resyncs;
+
+static uint16_t now_minute(void) {
+    return (uint16_t)((s21_port_time_us() / MINUTE_US) % SCHEDULE_MINUTES_PER_WEEK);
+}
+
+static uint32_t now_second(void) {
+    return (uint32_t)((s21_port_time_us() / 1000000) % 60);
+}
+
+static void apply(const schedule_transition_t *t, bool fired) {
+    if (!t || s_applied_count == MAX_APPLIED) return;
+    s_applied[s_applied_count++] = { now_minute(), t->heat_half, fired };
+}
+
+static void arm(uint64_t delay_s) {
+    s_timer_at_us = s21_port_time_us() + (int64_t)delay_s * 1000000;
+}
+
+static void resync(void) {
+    s_resyncs++;
+    s_timer_at_us = 0;
+    if (s_schedule.Count() == 0) return;
+    uint16_t now = now_minute();
+    s_schedule.Seek(now);
+    apply(s_schedule.Current(), false);
+    arm((uint64_t)s_schedule.MinutesUntilNext(now) * 60 - now_second());
+}
+
+static void fire(void) {
+    uint16_t now = now_minute();
+    const schedule_transition_t *next = s_schedule.Next();
+    if (!next || schedule_minute(next) != now) {
+        resync();
+        return;
+    }
+    apply(next, true);
+    s_schedule.Advance();
+    arm((uint64_t)s_schedule.MinutesUntilNext(now) * 60 - now_second());
+}
+
+static void timer_tick(int64_t now_us) {
+    if (s_timer_at_us && now_us >= s_timer_at_us) {
+        s_timer_at_us = 0;
+        fire();
+    }
+}
+
+static void run_until(int day, int hour, int minute) {
+    int64_t until = ((int64_t)day * DAY_MIN + hour * 60 + minute) * MINUTE_US;
+    s21_host_set_tick(timer_tick);
+    if (until > s21_port_time_us()) s21_host_advance_us(until - s21_port_time_us());
+}
+
+static schedule_transition_t at(int hour, int minute, int heat_c) {
+    schedule_transition_t t = {};
+    t.when = (uint16_t)(hour * 60 + minute) | SCHEDULE_HAS_HEAT;
+    t.heat_half = (uint8_t)(heat_c * 2);
+    return t;
+}
+
+static uint16_t week_minute(int day, int hour, int minute) {
+    return (uint16_t)(day * DAY_MIN + hour * 60 + minute);
+}
+
+static void check_fired(int index, int day, int hour, int minute, int heat_c) {
+    CHECK(index < s_applied_count);
+    if (index >= s_applied_count) return;
+    CHECK(s_applied[index].fired);
+    CHECK_EQ(s_applied[index].minute, week_minute(day, hour, minute));
+    CHECK_EQ(s_applied[index].heat_half, heat_c * 2);
+}
+
+// The end of the week wraps to the first transition of the next one, across an empty Sunday
+S21_TEST(week_wrap) {
+    schedule_transition_t mon = at(8, 0, 21), fri = at(22, 0, 17), sat = at(23, 30, 19);
+    CHECK(s_schedule.SetDays(1 << MON, &mon, 1));
+    CHECK(s_schedule.SetDays(1 << FRI, &fri, 1));
+    CHECK(s_schedule.SetDays(1 << SAT, &sat, 1));
+
+    // Before the week's first transition, the last one of the previous week is in effect
+    run_until(SUN, 1, 0);
+    resync();
+    CHECK_EQ(s_applied_count, 1);
+    CHECK_EQ(s_applied[0].heat_half, 19 * 2);
+    CHECK(!s_applied[0].fired);
+    CHECK_EQ(s_schedule.MinutesUntilNext(now_minute()), week_minute(MON, 8, 0) - week_minute(SUN, 1, 0));
+
+    // Two full weeks, across the wrap twice
+    run_until(SUN + 14, 12, 0);
+    CHECK_EQ(s_applied_count, 7);
+    check_fired(1, MON, 8, 0, 21);
+    check_fired(2, FRI, 22, 0, 17);
+    check_fired(3, SAT, 23, 30, 19);
+    check_fired(4, MON, 8, 0, 21);
+    check_fired(5, FRI, 22, 0, 17);
+    check_fired(6, SAT, 23, 30, 19);
+    CHECK_EQ(s_resyncs, 1);
+
+    // A transition on the last minute of the week fires, and the cursor wraps past it
+    schedule_transition_t late = at(23, 59, 25);
+    CHECK(s_schedule.SetDays(1 << SAT, &late, 1));
+    run_until(SUN + 20, 0, 0);
+    resync();
+    int before = s_applied_count;
+    run_until(SUN + 22, 9, 0);
+    check_fired(before, SAT, 23, 59, 25);
+    check_fired(before + 1, MON, 8, 0, 21);
+}
+
+// Days without transitions are skipped, however many there are
+S21_TEST(empty_days) {
+    // Nothing scheduled: nothing applied and the timer stays off
+    resync();
+    CHECK(s_schedule.Current() == nullptr);
+    CHECK(s_schedule.Next() == nullptr);
+    CHECK_EQ(s_schedule.MinutesUntilNext(0), SCHEDULE_MINUTES_PER_WEEK);
+    CHECK_EQ(s_timer_at_us, 0);
+    CHECK_EQ(s_applied_count, 0);
+
+    // Only Wednesday has transitions
+    schedule_transition_t wed[] = { at(6, 30, 22), at(21, 0, 18) };
+    CHECK(s_schedule.SetDays(1 << WED, wed, 2));
+    schedule_transition_t day[SCHEDULE_MAX_DAILY];
+    for (int d = SUN; d <= SAT; d++) CHECK_EQ(s_schedule.GetDay(d, day, SCHEDULE_MAX_DAILY), d == WED ? 2 : 0);
+
+    run_until(THU, 9, 15);
+    resync();
+    CHECK_EQ(s_applied[0].heat_half, 18 * 2);
+    CHECK_EQ(s_schedule.MinutesUntilNext(now_minute()),
+             SCHEDULE_MINUTES_PER_WEEK - week_minute(THU, 9, 15) + week_minute(WED, 6, 30));
+    run_until(THU + 7, 0, 0);
+    CHECK_EQ(s_applied_count, 3);
+    check_fired(1, WED, 6, 30, 22);
+    check_fired(2, WED, 21, 0, 18);
+
+    // A single transition a week is both current and next, a full week away from itself
+    schedule_transition_t once = at(12, 0, 20);
+    CHECK(s_schedule.SetDays(1 << WED, &once, 1));
+    run_until(THU + 12, 0, 0);
+    resync();
+    CHECK(s_schedule.Current() == s_schedule.Next());
+    CHECK_EQ(s_schedule.MinutesUntilNext(week_minute(WED, 12, 0)), SCHEDULE_MINUTES_PER_WEEK);
+    int before = s_applied_count;
+    run_until(THU + 26, 13, 0);
+    CHECK_EQ(s_applied_count, before + 2);
+    check_fired(before, WED, 12, 0, 20);
+    check_fired(before + 1, WED, 12, 0, 20);
+    CHECK(s_applied[before + 1].minute == s_applied[before].minute);
+}
+
+// An edit while the timer is armed moves the cursor back to the start; the edit path
+// resyncs, and a timer that fires before it notices the stale cursor and resyncs itself
+S21_TEST(edit_while_armed) {
+    schedule_transition_t mon[] = { at(8, 0, 21), at(18, 0, 23) };
+    schedule_transition_t tue = at(7, 0, 20);
+    CHECK(s_schedule.SetDays(1 << MON, mon, 2));
+    CHECK(s_schedule.SetDays(1 << TUE, &tue, 1));
+    run_until(MON, 7, 0);
+    resync();
+    CHECK_EQ(s_timer_at_us, (int64_t)week_minute(MON, 8, 0) * MINUTE_US);
+
+    // Edit with a resync, as SetWeeklySchedule does: an earlier transition fires on time
+    schedule_transition_t mon2[] = { at(7, 30, 19), at(8, 0, 21), at(18, 0, 23) };
+    CHECK(s_schedule.SetDays(1 << MON, mon2, 3));
+    resync();
+    int before = s_applied_count;
+    run_until(MON, 8, 30);
+    check_fired(before, MON, 7, 30, 19);
+    check_fired(before + 1, MON, 8, 0, 21);
+
+    // Edit without a resync: the cursor is back on Monday 07:30 while the timer still
+    // points at 18:00, so the firing resyncs and applies 18:00 anyway
+    schedule_transition_t wed = at(9, 0, 16);
+    CHECK(s_schedule.SetDays(1 << WED, &wed, 1));
+    CHECK_EQ(schedule_minute(s_schedule.Next()), week_minute(MON, 7, 30));
+    int resyncs = s_resyncs;
+    before = s_applied_count;
+    run_until(MON, 18, 1);
+    CHECK_EQ(s_resyncs, resyncs + 1);
+    CHECK_EQ(s_applied_count, before + 1);
+    CHECK_EQ(s_applied[before].minute, week_minute(MON, 18, 0));
+    CHECK_EQ(s_applied[before].heat_half, 23 * 2);
+    CHECK_EQ(schedule_minute(s_schedule.Next()), week_minute(TUE, 7, 0));
+
+    // And the schedule carries on in step, including the new Wednesday transition
+    before = s_applied_count;
+    run_until(WED, 10, 0);
+    check_fired(before, TUE, 7, 0, 20);
+    check_fired(before + 1, WED, 9, 0, 16);
+    CHECK_EQ(s_resyncs, resyncs + 1);
+
+    // A rejected edit leaves schedule and cursor alone
+    schedule_transition_t too_many[SCHEDULE_MAX_DAILY + 1];
+    for (int i = 0; i <= SCHEDULE_MAX_DAILY; i++) too_many[i] = at(i, 0, 20);
+    const schedule_transition_t *next = s_schedule.Next();
+    CHECK(!s_schedule.SetDays(1 << THU, too_many, SCHEDULE_MAX_DAILY + 1));
+    CHECK(s_schedule.Next() == next);
+    CHECK_EQ(s_schedule.Count(), 5);
+}
+
+// Save and Load keep the transitions; the cursor needs a Seek afterwards, as after a reboot
+S21_TEST(reload) {
+    schedule_transition_t day[] = { at(6, 0, 21), at(22, 0, 17) };
+    CHECK(s_schedule.SetDays(0x7f, day, 2));
+    CHECK_EQ(s_schedule.Count(), 14);
+    static schedule_storage_t storage;
+    s_schedule.Save(&storage);
+
+    ThermostatSchedule loaded;
+    CHECK(loaded.Load(&storage));
+    CHECK_EQ(loaded.Count(), 14);
+    loaded.Seek(week_minute(TUE, 12, 0));
+    CHECK_EQ(schedule_minute(loaded.Current()), week_minute(TUE, 6, 0));
+    CHECK_EQ(schedule_minute(loaded.Next()), week_minute(TUE, 22, 0));
+
+    // Exactly on a transition minute, that transition is the current one
+    loaded.Seek(week_minute(TUE, 22, 0));
+    CHECK_EQ(schedule_minute(loaded.Current()), week_minute(TUE, 22, 0));
+
+    storage.transitions[1].when = storage.transitions[0].when - 1;
+    CHECK(!loaded.Load(&storage));
+    storage.version++;
+    CHECK(!loaded.Load(&storage));
+}
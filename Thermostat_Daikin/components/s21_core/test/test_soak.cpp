@@ -0,0 +1,159 @@
+#include "s21_test.h"
+#include "s21_driver.h"
+#include "s21_port_host.h"
+#include "s21_sim.h"
+#include "s21_stats.h"
+#include "s21_config.h"
+#include <math.h>
+
+// A simulated day of the poll task against a unit with one fault profile, with a control
+// write every few minutes. Each profile must:
+// - never leave the driver and the unit disagreeing for longer than SOAK_MAX_RECOVERY_S,
+//   counted from a write until the unit has it, or from a fault until the state is read
+//   again
+// - complete every command, and have the unit end up with the last one
+// - agree with the unit within SOAK_MAX_RECOVERY_S once the faults stop
+// - not grow the heap once running
+// The p50/p99 latency to the ACK and to the confirming status read is printed per profile.
+// Built without sanitizers: the heap figures come from the C library's own allocator.
+
+#define SOAK_HOURS 24
+#define SOAK_CMD_EVERY_S 300
+#define SOAK_MAX_RECOVERY_S 30
+#define SOAK_WARMUP_CYCLES 10
+
+static DaikinS21 s_s21;
+static int64_t s_next_cmd_us;
+static uint32_t s_rng = 7;
+static s21_control_t s_last_cmd;
+static uint32_t s_submitted;
+static uint32_t s_completed;
+static uint32_t s_failed;
+
+static void cmd_done(esp_err_t result, void *ctx) {
+    s_completed++;
+    if (result != ESP_OK) s_failed++;
+}
+
+static void submit_commands(int64_t now_us) {
+    if (now_us < s_next_cmd_us) return;
+    s_next_cmd_us = now_us + (int64_t)SOAK_CMD_EVERY_S * 1000000;
+    s_rng = s_rng * 1103515245 + 12345;
+    s21_control_t c = {};
+    c.fields = S21_CTRL_POWER | S21_CTRL_MODE | S21_CTRL_TEMP;
+    c.power = true;
+    c.mode = (s_rng >> 8) % 2 ? FAIKIN_MODE_COOL : FAIKIN_MODE_HEAT;
+    c.target_temp = 18 + ((s_rng >> 12) % 20) * 0.5f;
+    c.trace_id = s21_trace_begin(1);
+    if (s_s21.ApplyControl(&c, cmd_done, nullptr) == ESP_OK) {
+        s_last_cmd = c;
+        s_submitted++;
+    }
+}
+
+static bool agrees(const ac_state_t *driver, const ac_state_t *unit) {
+    return driver->power == unit->power && driver->mode == unit->mode &&
+           fabsf(driver->target_temp - unit->target_temp) < 0.3f;
+}
+
+// Longest time the driver and the unit disagreed while running n_us of poll cycles
+static int64_t run(int64_t n_us, int cycle_from, uint32_t *heap_warm) {
+    int64_t until = s21_port_time_us() + n_us;
+    int64_t apart_since = 0, longest = 0;
+    int cycle = cycle_from;
+    while (s21_port_time_us() < until) {
+        uint32_t heap_before = s21_port_heap_free();
+        s_s21.Poll();
+        s_s21.UpdateMemStats(heap_before);
+        ac_state_t state = s_s21.GetState();
+        s21_stats_sample(&state, s21_port_time_us());
+        s21_config_service(s21_port_time_us());
+        s_s21.Idle(2000);
+        if (++cycle == SOAK_WARMUP_CYCLES && heap_warm) *heap_warm = s21_port_heap_free();
+
+        state = s_s21.GetState();
+        ac_state_t unit = s21_sim_get_unit();
+        int64_t now = s21_port_time_us();
+        if (agrees(&state, &unit)) {
+            apart_since = 0;
+        } else if (!apart_since) {
+            apart_since = now;
+        } else if (now - apart_since > longest) {
+            longest = now - apart_since;
+        }
+    }
+    return longest;
+}
+
+static void soak(const char *profile) {
+    s21_sim_faults_t faults;
+    CHECK(s21_sim_profile(profile, &faults));
+    CHECK_EQ(s_s21.Init(0, 0, S21_TRANSPORT_SIM), ESP_OK);
+    s21_sim_reset(&faults, 42, s21_port_time_us());
+    s_s21.DiscoverCapabilities();
+    s21_stats_init(nullptr, nullptr);
+    s21_trace_clear();
+    s_next_cmd_us = s21_port_time_us() + 60 * 1000000LL;
+    s21_host_set_tick(submit_commands);
+
+    uint32_t heap_warm = 0;
+    int64_t longest_us = run((int64_t)SOAK_HOURS * 3600 * 1000000, 0, &heap_warm);
+    uint32_t heap_end = s21_port_heap_free();
+    s21_host_set_tick(nullptr);
+
+    // Faults stop: the driver catches up and stays caught up
+    s21_sim_set_faults(nullptr);
+    int64_t clean_from = s21_port_time_us();
+    int64_t agreed_at = 0;
+    while (s21_port_time_us() - clean_from < (int64_t)SOAK_MAX_RECOVERY_S * 1000000) {
+        s_s21.Poll();
+        s_s21.Idle(2000);
+        ac_state_t state = s_s21.GetState(), unit = s21_sim_get_unit();
+        if (!agrees(&state, &unit)) agreed_at = 0;
+        else if (!agreed_at) agreed_at = s21_port_time_us();
+    }
+
+    s21_trace_latency_t ack, confirm;
+    CHECK(s21_trace_latency(S21_TRACE_ACK, &ack));
+    CHECK(s21_trace_latency(S21_TRACE_CONFIRM, &confirm));
+    s21_link_stats_t link = s_s21.GetLinkStats();
+    s21_sim_stats_t sim = s21_sim_get_stats();
+    printf("%s: %u commands, %u failed; ack p50 %lu ms p99 %lu ms; confirm p50 %lu ms p99 %lu ms; "
+           "longest apart %lld s; recovered in %lld s; retries %lu timeouts %lu losses %lu; heap %ld bytes\n",
+           profile, s_submitted, s_failed, (unsigned long)ack.p50_us / 1000, (unsigned long)ack.p99_us / 1000,
+           (unsigned long)confirm.p50_us / 1000, (unsigned long)confirm.p99_us / 1000, (long long)(longest_us / 1000000),
+           agreed_at ? (long long)((agreed_at - clean_from) / 1000000) : -1LL, (unsigned long)link.retries,
+           (unsigned long)link.timeouts, (unsigned long)link.link_losses, (long)heap_warm - (long)heap_end);
+
+    // Bounded recovery, during the faults and after them
+    CHECK(longest_us <= (int64_t)SOAK_MAX_RECOVERY_S * 1000000);
+    CHECK(agreed_at != 0);
+    // Every command finished, and the unit has the last one
+    CHECK(s_submitted >= SOAK_HOURS * 3600 / SOAK_CMD_EVERY_S - 1);
+    CHECK_EQ(s_completed, s_submitted);
+    ac_state_t unit = s21_sim_get_unit();
+    CHECK(unit.power == s_last_cmd.power);
+    CHECK_EQ(unit.mode, s_last_cmd.mode);
+    CHECK(fabsf(unit.target_temp - s_last_cmd.target_temp) < 0.3f);
+    CHECK(confirm.count > 0 && confirm.p99_us <= (uint32_t)SOAK_MAX_RECOVERY_S * 1000000);
+    // No heap growth once warmed up
+    CHECK_EQ(heap_end, heap_warm);
+    CHECK_EQ(s_s21.GetMemStats().heap_delta_cycles, 0);
+    CHECK(sim.queries > 0);
+}
+
+S21_TEST(lost_ack) {
+    soak("lost-ack");
+}
+
+S21_TEST(truncated) {
+    soak("truncated");
+}
+
+S21_TEST(checksum) {
+    soak("checksum");
+}
+
+S21_TEST(every_other) {
+    soak("every-other");
+}
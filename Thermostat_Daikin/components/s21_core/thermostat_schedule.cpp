@@ -0,0 +1,115 @@
+#include "thermostat_schedule.h"
+#include <string.h>
+
+ThermostatSchedule::ThermostatSchedule() {
+    Clear();
+}
+
+void ThermostatSchedule::Clear() {
+    m_count = 0;
+    m_next = 0;
+}
+
+bool ThermostatSchedule::SetDays(uint8_t day_mask, const schedule_transition_t *day, int count) {
+    if (count < 0 || count > SCHEDULE_MAX_DAILY) return false;
+
+    // Keep transitions of untouched days, then merge in the new ones
+    schedule_transition_t merged[SCHEDULE_MAX_TRANSITIONS];
+    int n = 0;
+    for (int i = 0; i < m_count; i++) {
+        int weekday = schedule_minute(&m_transitions[i]) / SCHEDULE_MINUTES_PER_DAY;
+        if (!(day_mask & (1 << weekday))) merged[n++] = m_transitions[i];
+    }
+    for (int weekday = 0; weekday < 7; weekday++) {
+        if (!(day_mask & (1 << weekday))) continue;
+        for (int i = 0; i < count; i++) {
+            uint16_t minute = schedule_minute(&day[i]);
+            if (minute >= SCHEDULE_MINUTES_PER_DAY) return false;
+            if (n == SCHEDULE_MAX_TRANSITIONS) return false;
+            merged[n] = day[i];
+            merged[n].when = (day[i].when & ~SCHEDULE_WHEN_MASK) | (weekday * SCHEDULE_MINUTES_PER_DAY + minute);
+            n++;
+        }
+    }
+
+    // Insertion sort: at most SCHEDULE_MAX_TRANSITIONS entries, only on edits
+    for (int i = 1; i < n; i++) {
+        schedule_transition_t t = merged[i];
+        int j = i - 1;
+        while (j >= 0 && schedule_minute(&merged[j]) > schedule_minute(&t)) {
+            merged[j + 1] = merged[j];
+            j--;
+        }
+        merged[j + 1] = t;
+    }
+
+    memcpy(m_transitions, merged, n * sizeof(merged[0]));
+    m_count = n;
+    m_next = 0;
+    return true;
+}
+
+int ThermostatSchedule::GetDay(int weekday, schedule_transition_t *out, int max) const {
+    int n = 0;
+    for (int i = 0; i < m_count && n < max; i++) {
+        uint16_t minute = schedule_minute(&m_transitions[i]);
+        if (minute / SCHEDULE_MINUTES_PER_DAY != weekday) continue;
+        out[n] = m_transitions[i];
+        out[n].when = (m_transitions[i].when & ~SCHEDULE_WHEN_MASK) | (minute % SCHEDULE_MINUTES_PER_DAY);
+        n++;
+    }
+    return n;
+}
+
+void ThermostatSchedule::Seek(uint16_t now) {
+    // First transition strictly after now; wraps to 0 at the end of the week
+    int lo = 0, hi = m_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (schedule_minute(&m_transitions[mid]) <= now) lo = mid + 1;
+        else hi = mid;
+    }
+    m_next = (lo == m_count) ? 0 : lo;
+}
+
+const schedule_transition_t *ThermostatSchedule::Current() const {
+    if (m_count == 0) return nullptr;
+    return &m_transitions[(m_next + m_count - 1) % m_count];
+}
+
+const schedule_transition_t *ThermostatSchedule::Next() const {
+    if (m_count == 0) return nullptr;
+    return &m_transitions[m_next];
+}
+
+void ThermostatSchedule::Advance() {
+    if (m_count == 0) return;
+    m_next = (m_next + 1) % m_count;
+}
+
+uint32_t ThermostatSchedule::MinutesUntilNext(uint16_t now) const {
+    const schedule_transition_t *next = Next();
+    if (!next) return SCHEDULE_MINUTES_PER_WEEK;
+    int32_t delta = (int32_t)schedule_minute(next) - (int32_t)now;
+    if (delta <= 0) delta += SCHEDULE_MINUTES_PER_WEEK;
+    return (uint32_t)delta;
+}
+
+void ThermostatSchedule::Save(schedule_storage_t *out) const {
+    memset(out, 0, sizeof(*out));
+    out->version = SCHEDULE_STORAGE_VERSION;
+    out->count = (uint8_t)m_count;
+    memcpy(out->transitions, m_transitions, m_count * sizeof(m_transitions[0]));
+}
+
+bool ThermostatSchedule::Load(const schedule_storage_t *in) {
+    if (in->version != SCHEDULE_STORAGE_VERSION || in->count > SCHEDULE_MAX_TRANSITIONS) return false;
+    for (int i = 0; i < in->count; i++) {
+        if (schedule_minute(&in->transitions[i]) >= SCHEDULE_MINUTES_PER_WEEK) return false;
+        if (i > 0 && schedule_minute(&in->transitions[i]) < schedule_minute(&in->transitions[i - 1])) return false;
+    }
+    memcpy(m_transitions, in->transitions, in->count * sizeof(m_transitions[0]));
+    m_count = in->count;
+    m_next = 0;
+    return true;
+}
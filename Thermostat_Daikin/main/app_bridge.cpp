@@ -0,0 +1,674 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+
+#include <esp_matter.h>
+#include <esp_matter_console.h>
+#include <platform/CHIPDeviceLayer.h>
+
+#include <app_priv.h>
+#include "app_bridge.h"
+#include "app_reporting.h"
+#include "s21_peer.h"
+
+using namespace esp_matter;
+using namespace chip::app::Clusters;
+
+static const char *TAG = "app_bridge";
+
+// The site key every node of the peer link shares
+#define PEER_NVS_NAMESPACE "peer"
+#define PEER_NVS_KEY_KEY "key"
+
+// The peer link runs for either role; each section below is built only for its role
+#define PEER_LINK (CONFIG_S21_BRIDGE_MODE || CONFIG_S21_PEER_PUBLISH)
+
+#if PEER_LINK
+
+#define FLOAT_TO_MATTER(x) ((int16_t)((x) * 100.0f))
+#define MATTER_TO_FLOAT(x) ((float)(x) / 100.0f)
+
+#define PEER_TASK_STACK_SIZE 4096
+// Receive timeout, which is also the tick for the periodic work
+#define PEER_TICK_MS 1000
+// Enough hops for state to cross a border router
+#define PEER_MULTICAST_HOPS 8
+// Published state is repeated this often even when nothing changes
+#define PEER_PUBLISH_INTERVAL_S 30
+// How often the bridge looks for units that went quiet
+#define BRIDGE_REACHABLE_CHECK_S 10
+// The loopback stand-in unit publishes more often, to make testing quick
+#define LOOPBACK_PUBLISH_INTERVAL_S 5
+
+#define BRIDGE_NVS_NAMESPACE "bridge"
+#define BRIDGE_NVS_KEY_UNITS "units"
+
+static StackType_t s_peer_task_stack[PEER_TASK_STACK_SIZE];
+static StaticTask_t s_peer_task_tcb;
+static int s_sock = -1;
+static struct sockaddr_in6 s_group_addr;
+static uint8_t s_peer_key[S21_PEER_KEY_LEN];
+
+// Messages dropped, cumulative since boot; written by the peer task only
+static struct {
+    uint32_t bad_mac;  // Failed the tag: wrong key or tampered
+    uint32_t foreign;  // Control from an address other than the bridge's
+    uint32_t replayed; // Control with a stale echo or an old seq
+} s_peer_drops;
+
+static bool peer_key_load()
+{
+    nvs_handle_t handle;
+    if (nvs_open(PEER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+    size_t len = sizeof(s_peer_key);
+    esp_err_t err = nvs_get_blob(handle, PEER_NVS_KEY_KEY, s_peer_key, &len);
+    nvs_close(handle);
+    return err == ESP_OK && len == sizeof(s_peer_key);
+}
+
+static int peer_socket_open(uint16_t port, bool join_group)
+{
+    int sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) return -1;
+    struct sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port = htons(port);
+    addr.sin6_addr = in6addr_any;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    int hops = PEER_MULTICAST_HOPS;
+    setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+    if (join_group) {
+        struct ipv6_mreq mreq = {};
+        inet6_aton(S21_PEER_GROUP, &mreq.ipv6mr_multiaddr);
+        mreq.ipv6mr_interface = 0;
+        if (setsockopt(sock, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            ESP_LOGW(TAG, "Failed to join %s, only unicast state will be seen", S21_PEER_GROUP);
+        }
+    }
+    return sock;
+}
+
+static esp_err_t peer_send(int sock, const s21_peer_msg_t *msg, const struct sockaddr_in6 *to)
+{
+    uint8_t buf[S21_PEER_MAX_MSG_LEN];
+    size_t len = s21_peer_encode(msg, s_peer_key, buf, sizeof(buf));
+    if (len == 0) return ESP_ERR_INVALID_SIZE;
+    if (sendto(sock, buf, len, 0, (const struct sockaddr *)to, sizeof(*to)) < 0) return ESP_FAIL;
+    return ESP_OK;
+}
+
+// Read one datagram; false if it is not a valid peer message
+static bool peer_receive(int sock, s21_peer_msg_t *msg, struct sockaddr_in6 *from)
+{
+    uint8_t buf[S21_PEER_MAX_MSG_LEN];
+    socklen_t from_len = sizeof(*from);
+    int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)from, &from_len);
+    if (len <= 0) return false;
+    esp_err_t err = s21_peer_decode(buf, len, s_peer_key, msg);
+    if (err == ESP_ERR_INVALID_CRC) s_peer_drops.bad_mac++;
+    return err == ESP_OK;
+}
+
+#if CONFIG_S21_PEER_PUBLISH || CONFIG_S21_BRIDGE_LOOPBACK_PEER
+// Unit side: apply a control only from the pinned bridge, and only once
+static bool peer_guard_accept(s21_peer_guard_t *guard, const s21_peer_msg_t *msg, const struct sockaddr_in6 *from,
+                              uint16_t publish_seq)
+{
+    uint8_t addr[S21_PEER_ADDR_LEN];
+    memcpy(addr, &from->sin6_addr, 16);
+    memcpy(&addr[16], &from->sin6_port, 2);
+    esp_err_t err = s21_peer_guard_check(guard, msg, addr, publish_seq, esp_timer_get_time());
+    if (err == ESP_ERR_INVALID_STATE) s_peer_drops.foreign++;
+    else if (err != ESP_OK) s_peer_drops.replayed++;
+    return err == ESP_OK;
+}
+#endif
+
+#endif // PEER_LINK
+
+#if CONFIG_S21_BRIDGE_MODE
+
+// Unit ID to endpoint ID, persisted so bridged endpoints keep their IDs
+typedef struct {
+    uint8_t unit_id[S21_PEER_UNIT_ID_LEN];
+    uint16_t endpoint_id;
+} bridge_unit_record_t;
+
+typedef struct {
+    bool used;
+    bridge_unit_record_t rec;  // endpoint_id is 0 until the CHIP thread creates the endpoint
+    struct sockaddr_in6 addr;  // Where control messages for the unit go
+    uint16_t last_seq;
+    int64_t last_seen_us;
+    ac_state_t pending;        // Latest state, same single-slot scheme as the local unit
+    bool has_pending;
+    bool scheduled;
+    bool reachable;            // As last reported, CHIP thread only
+} bridge_unit_t;
+
+// Written by the peer task and read by the CHIP thread, both under s_units_lock
+static bridge_unit_t s_units[APP_BRIDGE_MAX_UNITS];
+static portMUX_TYPE s_units_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static node_t *s_node = nullptr;
+static endpoint_t *s_aggregator = nullptr;
+static bool s_started = false;      // Endpoints created from now on must be enabled
+static uint16_t s_control_seq = 0;  // CHIP thread only; random from the start of the link
+
+static void units_save()
+{
+    bridge_unit_record_t records[APP_BRIDGE_MAX_UNITS];
+    size_t count = 0;
+    taskENTER_CRITICAL(&s_units_lock);
+    for (int i = 0; i < APP_BRIDGE_MAX_UNITS; i++) {
+        if (s_units[i].used && s_units[i].rec.endpoint_id != 0) records[count++] = s_units[i].rec;
+    }
+    taskEXIT_CRITICAL(&s_units_lock);
+
+    nvs_handle_t handle;
+    if (nvs_open(BRIDGE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, BRIDGE_NVS_KEY_UNITS, records, count * sizeof(records[0])) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static size_t units_load(bridge_unit_record_t *records)
+{
+    nvs_handle_t handle;
+    if (nvs_open(BRIDGE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return 0;
+    size_t len = APP_BRIDGE_MAX_UNITS * sizeof(records[0]);
+    esp_err_t err = nvs_get_blob(handle, BRIDGE_NVS_KEY_UNITS, records, &len);
+    nvs_close(handle);
+    if (err != ESP_OK || len % sizeof(records[0]) != 0) return 0;
+    return len / sizeof(records[0]);
+}
+
+// Create (endpoint_id 0) or recreate a bridged Thermostat under the aggregator
+static endpoint_t *bridge_add_endpoint(uint16_t endpoint_id)
+{
+    uint8_t flags = ENDPOINT_FLAG_DESTROYABLE | ENDPOINT_FLAG_BRIDGE;
+    endpoint_t *endpoint = endpoint_id ? endpoint::resume(s_node, flags, endpoint_id, nullptr)
+                                       : endpoint::create(s_node, flags, nullptr);
+    if (!endpoint) return nullptr;
+
+    endpoint::bridged_node::config_t bridged_config;
+    // Until the unit is heard from; bridge_unit_work() sets it
+    bridged_config.bridged_device_basic_information.reachable = false;
+    // Same features as the local thermostat endpoint
+    endpoint::thermostat::config_t thermostat_config;
+    thermostat_config.thermostat.feature_flags = 7;
+    thermostat_config.thermostat.control_sequence_of_operation = 4;
+    if (endpoint::bridged_node::add(endpoint, &bridged_config) != ESP_OK ||
+        endpoint::thermostat::add(endpoint, &thermostat_config) != ESP_OK ||
+        endpoint::set_parent_endpoint(endpoint, s_aggregator) != ESP_OK) {
+        endpoint::destroy(s_node, endpoint);
+        return nullptr;
+    }
+    return endpoint;
+}
+
+static void bridge_report_state(uint16_t endpoint_id, const ac_state_t *state)
+{
+    esp_matter_attr_val_t val = esp_matter_nullable_int16(FLOAT_TO_MATTER(state->current_temp));
+    app_reporting_update(endpoint_id, Thermostat::Id, Thermostat::Attributes::LocalTemperature::Id, &val);
+
+    val = esp_matter_int16(FLOAT_TO_MATTER(state->target_temp));
+    app_reporting_update(endpoint_id, Thermostat::Id,
+                         state->mode == FAIKIN_MODE_HEAT ? Thermostat::Attributes::OccupiedHeatingSetpoint::Id
+                                                         : Thermostat::Attributes::OccupiedCoolingSetpoint::Id, &val);
+
+    val = esp_matter_enum8(app_driver_system_mode(state));
+    app_reporting_update(endpoint_id, Thermostat::Id, Thermostat::Attributes::SystemMode::Id, &val);
+}
+
+static void bridge_set_reachable(bridge_unit_t *unit, bool reachable)
+{
+    if (unit->reachable == reachable || unit->rec.endpoint_id == 0) return;
+    unit->reachable = reachable;
+    esp_matter_attr_val_t val = esp_matter_bool(reachable);
+    app_reporting_update(unit->rec.endpoint_id, BridgedDeviceBasicInformation::Id,
+                         BridgedDeviceBasicInformation::Attributes::Reachable::Id, &val);
+}
+
+// CHIP thread: apply the latest state of one unit, creating its endpoint the first time
+static void bridge_unit_work(intptr_t index)
+{
+    bridge_unit_t *unit = &s_units[index];
+    taskENTER_CRITICAL(&s_units_lock);
+    ac_state_t state = unit->pending;
+    bool has_state = unit->has_pending;
+    unit->has_pending = false;
+    unit->scheduled = false;
+    uint16_t endpoint_id = unit->rec.endpoint_id;
+    taskEXIT_CRITICAL(&s_units_lock);
+
+    if (endpoint_id == 0) {
+        endpoint_t *endpoint = bridge_add_endpoint(0);
+        if (!endpoint) {
+            ESP_LOGE(TAG, "Failed to create bridged endpoint");
+            return;
+        }
+        if (s_started) endpoint::enable(endpoint);
+        endpoint_id = endpoint::get_id(endpoint);
+        taskENTER_CRITICAL(&s_units_lock);
+        unit->rec.endpoint_id = endpoint_id;
+        taskEXIT_CRITICAL(&s_units_lock);
+        units_save();
+        ESP_LOGI(TAG, "Unit %02x%02x%02x%02x%02x%02x bridged on endpoint %u", unit->rec.unit_id[0],
+                 unit->rec.unit_id[1], unit->rec.unit_id[2], unit->rec.unit_id[3], unit->rec.unit_id[4],
+                 unit->rec.unit_id[5], endpoint_id);
+    }
+    if (has_state) bridge_report_state(endpoint_id, &state);
+    bridge_set_reachable(unit, true);
+}
+
+// CHIP thread: mark units that stopped publishing as unreachable
+static void bridge_check_reachable(intptr_t)
+{
+    int64_t stale_before = esp_timer_get_time() - (int64_t)APP_BRIDGE_STALE_S * 1000000;
+    for (int i = 0; i < APP_BRIDGE_MAX_UNITS; i++) {
+        taskENTER_CRITICAL(&s_units_lock);
+        bool stale = s_units[i].used && s_units[i].last_seen_us < stale_before;
+        taskEXIT_CRITICAL(&s_units_lock);
+        if (stale) bridge_set_reachable(&s_units[i], false);
+    }
+}
+
+// Peer task: record a unit's state and hand it to the CHIP thread
+static void bridge_on_state(const s21_peer_msg_t *msg, const struct sockaddr_in6 *from)
+{
+    int index = -1;
+    int free_index = -1;
+    bool schedule = false;
+    taskENTER_CRITICAL(&s_units_lock);
+    for (int i = 0; i < APP_BRIDGE_MAX_UNITS; i++) {
+        if (!s_units[i].used) {
+            if (free_index < 0) free_index = i;
+        } else if (memcmp(s_units[i].rec.unit_id, msg->unit_id, S21_PEER_UNIT_ID_LEN) == 0) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0 && free_index >= 0) {
+        index = free_index;
+        memset(&s_units[index], 0, sizeof(s_units[index]));
+        s_units[index].used = true;
+        memcpy(s_units[index].rec.unit_id, msg->unit_id, S21_PEER_UNIT_ID_LEN);
+    }
+    if (index >= 0) {
+        bridge_unit_t *unit = &s_units[index];
+        // A unit that restarted begins counting again; accept it once it has been quiet
+        bool restarted = unit->last_seen_us < esp_timer_get_time() - (int64_t)APP_BRIDGE_STALE_S * 1000000;
+        if (s21_peer_seq_newer(msg->seq, unit->last_seq) || restarted) {
+            unit->last_seq = msg->seq;
+            unit->last_seen_us = esp_timer_get_time();
+            unit->addr = *from;
+            unit->pending = msg->state;
+            unit->has_pending = true;
+            schedule = !unit->scheduled;
+            unit->scheduled = true;
+        }
+    }
+    taskEXIT_CRITICAL(&s_units_lock);
+
+    if (index < 0) {
+        ESP_LOGW(TAG, "No room to bridge another unit (max %d)", APP_BRIDGE_MAX_UNITS);
+        return;
+    }
+    if (schedule && chip::DeviceLayer::PlatformMgr().ScheduleWork(bridge_unit_work, index) != CHIP_NO_ERROR) {
+        taskENTER_CRITICAL(&s_units_lock);
+        s_units[index].scheduled = false;
+        taskEXIT_CRITICAL(&s_units_lock);
+    }
+}
+
+#endif // CONFIG_S21_BRIDGE_MODE
+
+#if CONFIG_S21_PEER_PUBLISH
+
+static uint8_t s_unit_id[S21_PEER_UNIT_ID_LEN];
+static uint16_t s_publish_seq = 0;  // Random from the start, so controls echoing an earlier boot fail
+static s21_peer_guard_t s_guard;
+static ac_state_t s_published;
+static int64_t s_next_publish_us = 0;
+
+static bool state_equal(const ac_state_t *a, const ac_state_t *b)
+{
+    return a->power == b->power && a->mode == b->mode && a->fan_speed == b->fan_speed &&
+           FLOAT_TO_MATTER(a->target_temp) == FLOAT_TO_MATTER(b->target_temp) &&
+           FLOAT_TO_MATTER(a->current_temp) == FLOAT_TO_MATTER(b->current_temp) &&
+           isnan(a->outside_temp) == isnan(b->outside_temp) &&
+           (isnan(a->outside_temp) || FLOAT_TO_MATTER(a->outside_temp) == FLOAT_TO_MATTER(b->outside_temp));
+}
+
+// Peer task: multicast the local unit's state when it changes, and every interval
+static void publish_local(bool force)
+{
+    ac_state_t state = app_driver_get_state();
+    int64_t now = esp_timer_get_time();
+    if (!force && now < s_next_publish_us && state_equal(&state, &s_published)) return;
+
+    s21_peer_msg_t msg = {};
+    memcpy(msg.unit_id, s_unit_id, S21_PEER_UNIT_ID_LEN);
+    msg.seq = ++s_publish_seq;
+    msg.type = S21_PEER_MSG_STATE;
+    msg.state = state;
+    if (peer_send(s_sock, &msg, &s_group_addr) == ESP_OK) {
+        s_published = state;
+        s_next_publish_us = now + (int64_t)PEER_PUBLISH_INTERVAL_S * 1000000;
+    }
+}
+
+static void publish_on_control(const s21_peer_msg_t *msg, const struct sockaddr_in6 *from)
+{
+    if (memcmp(msg->unit_id, s_unit_id, S21_PEER_UNIT_ID_LEN) != 0) return;
+    if (!peer_guard_accept(&s_guard, msg, from, s_publish_seq)) return;
+    if (app_driver_apply_control(&msg->control) == ESP_OK) publish_local(true);
+}
+
+#endif // CONFIG_S21_PEER_PUBLISH
+
+#if CONFIG_S21_BRIDGE_LOOPBACK_PEER
+
+// A simulated unit on the loopback interface, for trying bridge mode without other nodes.
+// It behaves like a publisher: state goes to the bridge's port, control comes back.
+static const uint8_t s_loop_unit_id[S21_PEER_UNIT_ID_LEN] = { 0x02, 'S', '2', '1', 0x00, 0x01 };
+static int s_loop_sock = -1;
+static ac_state_t s_loop_state;
+static uint16_t s_loop_seq = 0;
+static s21_peer_guard_t s_loop_guard;
+static int64_t s_loop_next_us = 0;
+
+static void loopback_publish()
+{
+    struct sockaddr_in6 to = {};
+    to.sin6_family = AF_INET6;
+    to.sin6_port = htons(S21_PEER_PORT);
+    to.sin6_addr = in6addr_loopback;
+    s21_peer_msg_t msg = {};
+    memcpy(msg.unit_id, s_loop_unit_id, S21_PEER_UNIT_ID_LEN);
+    msg.seq = ++s_loop_seq;
+    msg.type = S21_PEER_MSG_STATE;
+    msg.state = s_loop_state;
+    peer_send(s_loop_sock, &msg, &to);
+    s_loop_next_us = esp_timer_get_time() + (int64_t)LOOPBACK_PUBLISH_INTERVAL_S * 1000000;
+}
+
+static void loopback_receive()
+{
+    s21_peer_msg_t msg;
+    struct sockaddr_in6 from;
+    if (!peer_receive(s_loop_sock, &msg, &from) || msg.type != S21_PEER_MSG_CONTROL) return;
+    if (memcmp(msg.unit_id, s_loop_unit_id, S21_PEER_UNIT_ID_LEN) != 0) return;
+    if (!peer_guard_accept(&s_loop_guard, &msg, &from, s_loop_seq)) return;
+    const s21_control_t *c = &msg.control;
+    if (c->fields & S21_CTRL_POWER) s_loop_state.power = c->power;
+    if (c->fields & S21_CTRL_MODE) s_loop_state.mode = c->mode;
+    if (c->fields & S21_CTRL_TEMP) s_loop_state.target_temp = c->target_temp;
+    if (c->fields & S21_CTRL_FAN) s_loop_state.fan_speed = c->fan_speed;
+    loopback_publish();
+}
+
+// Room temperature drifts towards the target while the simulated unit runs
+static void loopback_tick()
+{
+    if (s_loop_state.power) {
+        float diff = s_loop_state.target_temp - s_loop_state.current_temp;
+        if (fabsf(diff) >= 0.1f) s_loop_state.current_temp += diff > 0 ? 0.1f : -0.1f;
+    }
+    if (esp_timer_get_time() >= s_loop_next_us) loopback_publish();
+}
+
+static esp_err_t loopback_start()
+{
+    s_loop_sock = peer_socket_open(0, false);
+    if (s_loop_sock < 0) return ESP_FAIL;
+    s_loop_state.power = false;
+    s_loop_state.mode = FAIKIN_MODE_COOL;
+    s_loop_state.target_temp = 22.0f;
+    s_loop_state.current_temp = 25.0f;
+    s_loop_state.outside_temp = NAN;
+    s_loop_state.fan_speed = FAIKIN_FAN_AUTO;
+    s_loop_seq = (uint16_t)esp_random();
+    ESP_LOGI(TAG, "Loopback stand-in unit started");
+    return ESP_OK;
+}
+
+#endif // CONFIG_S21_BRIDGE_LOOPBACK_PEER
+
+#if PEER_LINK
+
+static void peer_task(void *arg)
+{
+    int64_t next_check_us = 0;
+    while (true) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(s_sock, &fds);
+        int max_fd = s_sock;
+#if CONFIG_S21_BRIDGE_LOOPBACK_PEER
+        FD_SET(s_loop_sock, &fds);
+        if (s_loop_sock > max_fd) max_fd = s_loop_sock;
+#endif
+        struct timeval tv = { .tv_sec = PEER_TICK_MS / 1000, .tv_usec = (PEER_TICK_MS % 1000) * 1000 };
+        int ready = select(max_fd + 1, &fds, NULL, NULL, &tv);
+
+        if (ready > 0 && FD_ISSET(s_sock, &fds)) {
+            s21_peer_msg_t msg;
+            struct sockaddr_in6 from;
+            if (peer_receive(s_sock, &msg, &from)) {
+#if CONFIG_S21_BRIDGE_MODE
+                if (msg.type == S21_PEER_MSG_STATE) bridge_on_state(&msg, &from);
+#endif
+#if CONFIG_S21_PEER_PUBLISH
+                if (msg.type == S21_PEER_MSG_CONTROL) publish_on_control(&msg, &from);
+#endif
+            }
+        }
+#if CONFIG_S21_BRIDGE_LOOPBACK_PEER
+        if (ready > 0 && FD_ISSET(s_loop_sock, &fds)) loopback_receive();
+        loopback_tick();
+#endif
+#if CONFIG_S21_PEER_PUBLISH
+        publish_local(false);
+#endif
+        int64_t now = esp_timer_get_time();
+        if (now >= next_check_us) {
+            next_check_us = now + (int64_t)BRIDGE_REACHABLE_CHECK_S * 1000000;
+#if CONFIG_S21_BRIDGE_MODE
+            chip::DeviceLayer::PlatformMgr().ScheduleWork(bridge_check_reachable, 0);
+#endif
+        }
+    }
+}
+
+#endif // PEER_LINK
+
+esp_err_t app_bridge_init(node_t *node)
+{
+#if CONFIG_S21_BRIDGE_MODE
+    if (!node) return ESP_ERR_INVALID_ARG;
+    s_node = node;
+    endpoint::aggregator::config_t aggregator_config;
+    s_aggregator = endpoint::aggregator::create(node, &aggregator_config, ENDPOINT_FLAG_NONE, nullptr);
+    if (!s_aggregator) return ESP_FAIL;
+
+    bridge_unit_record_t records[APP_BRIDGE_MAX_UNITS];
+    size_t count = units_load(records);
+    for (size_t i = 0; i < count; i++) {
+        if (!bridge_add_endpoint(records[i].endpoint_id)) {
+            ESP_LOGE(TAG, "Failed to restore bridged endpoint %u", records[i].endpoint_id);
+            continue;
+        }
+        // Unreachable, and writes rejected, until the unit publishes: there is no address to
+        // send them to before that
+        s_units[i].used = true;
+        s_units[i].rec = records[i];
+        s_units[i].reachable = false;
+    }
+    ESP_LOGI(TAG, "Bridge on endpoint %u, %u known units", endpoint::get_id(s_aggregator), (unsigned)count);
+#endif
+    return ESP_OK;
+}
+
+esp_err_t app_bridge_start()
+{
+#if PEER_LINK
+    if (!peer_key_load()) {
+        ESP_LOGE(TAG, "No peer key, link not started. Set one with: matter esp s21peer key <32 hex digits>");
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(&s_group_addr, 0, sizeof(s_group_addr));
+    s_group_addr.sin6_family = AF_INET6;
+    s_group_addr.sin6_port = htons(S21_PEER_PORT);
+    inet6_aton(S21_PEER_GROUP, &s_group_addr.sin6_addr);
+
+#if CONFIG_S21_BRIDGE_MODE
+    const bool join_group = true;
+#else
+    const bool join_group = false;
+#endif
+    s_sock = peer_socket_open(S21_PEER_PORT, join_group);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "Failed to open peer socket");
+        return ESP_FAIL;
+    }
+#if CONFIG_S21_BRIDGE_MODE
+    s_started = true;
+    s_control_seq = (uint16_t)esp_random();
+#endif
+#if CONFIG_S21_PEER_PUBLISH
+    esp_efuse_mac_get_default(s_unit_id);
+    s_publish_seq = (uint16_t)esp_random();
+#endif
+#if CONFIG_S21_BRIDGE_LOOPBACK_PEER
+    if (loopback_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start loopback unit");
+        return ESP_FAIL;
+    }
+#endif
+    xTaskCreateStatic(peer_task, "s21_peer", PEER_TASK_STACK_SIZE, NULL, 4, s_peer_task_stack, &s_peer_task_tcb);
+#endif
+    return ESP_OK;
+}
+
+esp_err_t app_bridge_attribute_update(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id,
+                                      esp_matter_attr_val_t *val)
+{
+#if CONFIG_S21_BRIDGE_MODE
+    if (cluster_id != Thermostat::Id || s_sock < 0) return ESP_OK;
+
+    s21_peer_msg_t msg = {};
+    struct sockaddr_in6 to = {};
+    bridge_unit_t *unit = nullptr;
+    taskENTER_CRITICAL(&s_units_lock);
+    for (int i = 0; i < APP_BRIDGE_MAX_UNITS; i++) {
+        if (s_units[i].used && s_units[i].rec.endpoint_id == endpoint_id) {
+            unit = &s_units[i];
+            memcpy(msg.unit_id, unit->rec.unit_id, S21_PEER_UNIT_ID_LEN);
+            msg.ack_seq = unit->last_seq;
+            to = unit->addr;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_units_lock);
+    if (!unit) return ESP_OK;
+
+    if (attribute_id == Thermostat::Attributes::SystemMode::Id) {
+        if (!app_driver_system_mode_control(val->val.u8, &msg.control)) return ESP_OK;
+    } else if (attribute_id == Thermostat::Attributes::OccupiedHeatingSetpoint::Id ||
+               attribute_id == Thermostat::Attributes::OccupiedCoolingSetpoint::Id) {
+        msg.control.fields = S21_CTRL_TEMP;
+        msg.control.target_temp = MATTER_TO_FLOAT(val->val.i16);
+    } else {
+        return ESP_OK;
+    }
+    // Nowhere to send it, so reject the write instead of letting the attribute drift
+    if (!unit->reachable) return ESP_ERR_INVALID_STATE;
+    msg.type = S21_PEER_MSG_CONTROL;
+    msg.seq = ++s_control_seq;
+    return peer_send(s_sock, &msg, &to);
+#else
+    return ESP_OK;
+#endif
+}
+
+#if CONFIG_ENABLE_CHIP_SHELL
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static esp_err_t s21peer_handler(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[0], "key") == 0) {
+        uint8_t key[S21_PEER_KEY_LEN];
+        const char *hex = argv[1];
+        if (strlen(hex) != 2 * S21_PEER_KEY_LEN) {
+            printf("key must be %d hex digits\n", 2 * S21_PEER_KEY_LEN);
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (int i = 0; i < S21_PEER_KEY_LEN; i++) {
+            int hi = hex_digit(hex[2 * i]), lo = hex_digit(hex[2 * i + 1]);
+            if (hi < 0 || lo < 0) {
+                printf("key must be %d hex digits\n", 2 * S21_PEER_KEY_LEN);
+                return ESP_ERR_INVALID_ARG;
+            }
+            key[i] = (uint8_t)(hi << 4 | lo);
+        }
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(PEER_NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err != ESP_OK) return err;
+        err = nvs_set_blob(handle, PEER_NVS_KEY_KEY, key, sizeof(key));
+        if (err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+        if (err == ESP_OK) printf("Peer key stored, restart to use it\n");
+        return err;
+    }
+    if (argc != 0) {
+        printf("usage: s21peer [key <32 hex digits>]\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+#if PEER_LINK
+    printf("S21P running=%d bad_mac=%lu foreign=%lu replayed=%lu\n", s_sock >= 0, (unsigned long)s_peer_drops.bad_mac,
+           (unsigned long)s_peer_drops.foreign, (unsigned long)s_peer_drops.replayed);
+#else
+    printf("S21P peer link not built in\n");
+#endif
+    return ESP_OK;
+}
+
+esp_err_t app_bridge_register_commands()
+{
+    static const esp_matter::console::command_t command = {
+        .name = "s21peer",
+        .description = "S21 peer link. Usage: matter esp s21peer [key <32 hex digits>]",
+        .handler = s21peer_handler,
+    };
+    esp_err_t err = esp_matter::console::add_commands(&command, 1);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to add s21peer command: %d", err);
+    return err;
+}
+#else
+esp_err_t app_bridge_register_commands()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif // CONFIG_ENABLE_CHIP_SHELL
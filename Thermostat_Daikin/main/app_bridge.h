@@ -0,0 +1,58 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+/** Maximum units a bridge exposes */
+#define APP_BRIDGE_MAX_UNITS 4
+/** A unit not heard from for this long is reported unreachable */
+#define APP_BRIDGE_STALE_S 120
+
+/** Set up bridge mode
+ *
+ * Adds an Aggregator endpoint and recreates the bridged Thermostat endpoints of units seen
+ * before, with the endpoint IDs they had, so controllers keep their bindings across reboots.
+ * Units heard for the first time get a new endpoint while running. Call before
+ * esp_matter::start(); does nothing unless CONFIG_S21_BRIDGE_MODE is set.
+ *
+ * @param[in] node Matter node.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_bridge_init(esp_matter::node_t *node);
+
+/** Start the S21 peer link
+ *
+ * Opens the UDP socket and starts the peer task. In bridge mode it listens for unit state on
+ * the S21_PEER_GROUP multicast group and, with CONFIG_S21_BRIDGE_LOOPBACK_PEER, runs a
+ * simulated unit on the loopback interface. With CONFIG_S21_PEER_PUBLISH it multicasts the
+ * local unit's state and applies control messages from a bridge: only from the address of
+ * the first bridge it accepts, and only once each (see s21_peer_guard_check()). Every
+ * message is signed with the site key, which must be set first with
+ * "matter esp s21peer key". Call after esp_matter::start().
+ *
+ * @return ESP_OK on success, or if neither role is enabled.
+ * @return ESP_ERR_INVALID_STATE if no site key is set.
+ * @return error in case of failure.
+ */
+esp_err_t app_bridge_start();
+
+/** Forward a write on a bridged Thermostat endpoint to its unit
+ *
+ * Called from the attribute PRE_UPDATE callback for endpoints other than the local thermostat.
+ * Endpoints restored at boot stay unreachable until their unit publishes.
+ *
+ * @return ESP_OK if the endpoint is not bridged or the write was sent.
+ * @return ESP_ERR_INVALID_STATE if the unit is not reachable.
+ * @return error if the write cannot be sent; the attribute then keeps its old value.
+ */
+esp_err_t app_bridge_attribute_update(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id,
+                                      esp_matter_attr_val_t *val);
+
+/** Register the "s21peer" console command: drop counters, and "key <hex>" to set the site key */
+esp_err_t app_bridge_register_commands();
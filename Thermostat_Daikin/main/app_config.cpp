@@ -0,0 +1,59 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_matter_console.h>
+
+#include "app_config.h"
+#include "s21_config.h"
+
+static const char *TAG = "app_config";
+
+#if CONFIG_ENABLE_CHIP_SHELL
+static esp_err_t s21config_handler(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[0], "poll") == 0) {
+        long ms = strtol(argv[1], NULL, 10);
+        if (ms < 0 || ms > 60000) {
+            printf("poll interval must be 0 to 60000 ms\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        s21_config_set_poll_interval((uint32_t)ms);
+        return ESP_OK;
+    }
+    if (argc != 0) {
+        printf("usage: s21config [poll <ms>]\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    s21_config_t cfg = s21_config_get();
+    s21_config_stats_t st = s21_config_get_stats();
+    printf("S21C v=%u len=%u flags=0x%lx caps=0x%08lx poll=%lu bit_q4=%lu state=%u/%c/%c/%d filter_base=%u\n",
+           cfg.version, cfg.length, (unsigned long)cfg.flags, (unsigned long)cfg.caps.regs,
+           (unsigned long)cfg.poll_interval_ms, (unsigned long)cfg.bit_q4, cfg.power, cfg.mode ? cfg.mode : '-', cfg.fan_speed ? cfg.fan_speed : '-',
+           cfg.target_temp, cfg.filter_base_hours);
+    printf("S21C changes=%lu writes=%lu errors=%lu dirty=%d\n", (unsigned long)st.changes, (unsigned long)st.writes,
+           (unsigned long)st.write_errors, st.dirty);
+    return ESP_OK;
+}
+
+esp_err_t app_config_register_commands()
+{
+    static const esp_matter::console::command_t command = {
+        .name = "s21config",
+        .description = "S21 driver config. Usage: matter esp s21config [poll <ms>]",
+        .handler = s21config_handler,
+    };
+    esp_err_t err = esp_matter::console::add_commands(&command, 1);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to add s21config command: %d", err);
+    return err;
+}
+#else
+esp_err_t app_config_register_commands()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif // CONFIG_ENABLE_CHIP_SHELL
@@ -0,0 +1,20 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+
+/** Register the driver config shell command
+ *
+ * Adds "matter esp s21config [poll <ms>]". Without arguments it prints the driver config blob
+ * (s21_config.h) as cached in RAM and its write-back counters. poll sets the idle time between
+ * poll cycles, overriding the board default and CONFIG_S21_POLL_INTERVAL_MS until set back to
+ * 0; like every config change it reaches flash once changes have settled. Call before
+ * esp_matter::console::init().
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_config_register_commands();
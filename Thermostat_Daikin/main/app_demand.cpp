@@ -0,0 +1,361 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <esp_matter.h>
+#include <esp_matter_console.h>
+#include <app/EventLogging.h>
+#include <app/clusters/device-energy-management-server/device-energy-management-server.h>
+#include <app/reporting/reporting.h>
+#include <platform/CHIPDeviceLayer.h>
+
+#include <app_priv.h>
+#include "app_demand.h"
+
+using namespace esp_matter;
+using namespace chip::app::Clusters;
+using namespace chip::app::Clusters::DeviceEnergyManagement;
+using chip::app::DataModel::Nullable;
+using chip::Protocols::InteractionModel::Status;
+
+static const char *TAG = "app_demand";
+
+#define DEMAND_RATED_POWER_MW ((int64_t)CONFIG_S21_DEMAND_RATED_POWER_W * 1000)
+
+// Ramp state, only touched on the CHIP thread
+static uint8_t s_target_pct = S21_DEMAND_MAX_PCT;
+static uint8_t s_applied_pct = S21_DEMAND_MAX_PCT;
+static uint8_t s_step_pct = S21_DEMAND_MAX_PCT;
+static bool s_step_busy = false;
+static bool s_step_armed = false;
+
+// Timing of the request in progress, shared with the driver task's completion callback.
+// s_generation changes with each request, so a step ACKed for an older one is not counted.
+static app_demand_stats_t s_stats;
+static uint32_t s_generation = 0;
+static int64_t s_request_us = 0;
+static bool s_awaiting_response = false;
+static bool s_awaiting_settle = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void demand_step();
+
+static void demand_step_timer(chip::System::Layer *layer, void *context)
+{
+    s_step_armed = false;
+    demand_step();
+}
+
+static void demand_arm_step()
+{
+    if (s_step_armed) return;
+    if (chip::DeviceLayer::SystemLayer().StartTimer(chip::System::Clock::Seconds32(APP_DEMAND_RAMP_STEP_S),
+                                                    demand_step_timer, nullptr) == CHIP_NO_ERROR) {
+        s_step_armed = true;
+    }
+}
+
+// Runs on the CHIP thread once the driver has finished with a step
+static void demand_step_work(intptr_t context)
+{
+    esp_err_t result = (esp_err_t)context;
+    s_step_busy = false;
+    if (result == ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGE(TAG, "Unit has no demand control");
+        return;
+    }
+    if (result == ESP_OK) s_applied_pct = s_step_pct;
+    if (s_applied_pct == s_target_pct && result == ESP_OK) return;
+
+    // A request that came in while an older step was with the driver has not had its first
+    // step yet; that one goes out straight away
+    taskENTER_CRITICAL(&s_lock);
+    bool first = s_awaiting_response && result == ESP_OK;
+    taskEXIT_CRITICAL(&s_lock);
+    if (first) demand_step();
+    else demand_arm_step();
+}
+
+// Driver task: the unit ACKed the step, or it failed. Timing is taken here, next to the ACK.
+static void demand_step_done(esp_err_t result, void *ctx)
+{
+    uint32_t generation = (uint32_t)(uintptr_t)ctx;
+    uint32_t elapsed_ms = 0;
+    taskENTER_CRITICAL(&s_lock);
+    if (result != ESP_OK) {
+        s_stats.failures++;
+    } else if (generation == s_generation) {
+        elapsed_ms = (uint32_t)((esp_timer_get_time() - s_request_us) / 1000);
+        s_stats.limit_pct = s_step_pct;
+        if (s_awaiting_response) {
+            s_awaiting_response = false;
+            s_stats.last_response_ms = elapsed_ms;
+            if (elapsed_ms > s_stats.max_response_ms) s_stats.max_response_ms = elapsed_ms;
+        }
+        if (s_awaiting_settle && s_step_pct == s_stats.target_pct) {
+            s_awaiting_settle = false;
+            s_stats.last_settle_ms = elapsed_ms;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (chip::DeviceLayer::PlatformMgr().ScheduleWork(demand_step_work, (intptr_t)result) != CHIP_NO_ERROR) {
+        ESP_LOGE(TAG, "Failed to schedule the next ramp step");
+    }
+}
+
+// Send the next step towards the target, unless one is already with the driver
+static void demand_step()
+{
+    if (s_step_busy || s_applied_pct == s_target_pct) return;
+    s21_demand_t demand = {};
+    demand.limit_pct = s21_demand_ramp_step(s_applied_pct, s_target_pct, APP_DEMAND_RAMP_STEP_PCT);
+    taskENTER_CRITICAL(&s_lock);
+    s_step_pct = demand.limit_pct;
+    uint32_t generation = s_generation;
+    taskEXIT_CRITICAL(&s_lock);
+    if (app_driver_apply_demand(&demand, demand_step_done, (void *)(uintptr_t)generation) != ESP_OK) {
+        demand_arm_step();
+        return;
+    }
+    s_step_busy = true;
+}
+
+// Head for a new limit. The first step goes out straight away.
+static void demand_set_target(uint8_t pct)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_generation++;
+    s_request_us = esp_timer_get_time();
+    s_stats.requests++;
+    s_stats.target_pct = pct;
+    s_awaiting_response = pct != s_applied_pct;
+    s_awaiting_settle = s_awaiting_response;
+    taskEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Demand limit %u%% -> %u%%", s_applied_pct, pct);
+    s_target_pct = pct;
+    if (s_step_armed) {
+        chip::DeviceLayer::SystemLayer().CancelTimer(demand_step_timer, nullptr);
+        s_step_armed = false;
+    }
+    demand_step();
+}
+
+// Share of the rated input for a power in mW, within what the unit accepts
+static uint8_t demand_pct_for_power(int64_t power_mw)
+{
+    int64_t pct = power_mw * 100 / DEMAND_RATED_POWER_MW;
+    if (pct < S21_DEMAND_MIN_PCT) pct = S21_DEMAND_MIN_PCT;
+    if (pct > S21_DEMAND_MAX_PCT) pct = S21_DEMAND_MAX_PCT;
+    return (uint8_t)pct;
+}
+
+class DemandDelegate : public DeviceEnergyManagement::Delegate {
+public:
+    DemandDelegate()
+    {
+        mAdjust[0].minPower = DEMAND_RATED_POWER_MW * S21_DEMAND_MIN_PCT / 100;
+        mAdjust[0].maxPower = DEMAND_RATED_POWER_MW;
+        mAdjust[0].minDuration = APP_DEMAND_MIN_DURATION_S;
+        mAdjust[0].maxDuration = APP_DEMAND_MAX_DURATION_S;
+        Structs::PowerAdjustCapabilityStruct::Type capability;
+        capability.powerAdjustCapability.SetNonNull(chip::app::DataModel::List<const Structs::PowerAdjustStruct::Type>(mAdjust));
+        capability.cause = PowerAdjustReasonEnum::kNoAdjustment;
+        mCapability.SetNonNull(capability);
+    }
+
+    Status PowerAdjustRequest(const int64_t powerMw, const uint32_t durationS, AdjustmentCauseEnum cause) override
+    {
+        uint8_t pct = demand_pct_for_power(powerMw);
+        bool started = mState != ESAStateEnum::kPowerAdjustActive;
+        chip::DeviceLayer::SystemLayer().CancelTimer(AdjustExpired, this);
+        if (chip::DeviceLayer::SystemLayer().StartTimer(chip::System::Clock::Seconds32(durationS), AdjustExpired,
+                                                        this) != CHIP_NO_ERROR) {
+            return Status::Failure;
+        }
+        if (started) mStartUs = esp_timer_get_time();
+        SetCause(cause == AdjustmentCauseEnum::kGridOptimization ? PowerAdjustReasonEnum::kGridOptimizationAdjustment
+                                                                   : PowerAdjustReasonEnum::kLocalOptimizationAdjustment);
+        SetESAState(ESAStateEnum::kPowerAdjustActive);
+        if (started) {
+            Events::PowerAdjustStart::Type event;
+            chip::EventNumber number;
+            chip::app::LogEvent(event, mEndpointId, number);
+        }
+        ESP_LOGI(TAG, "Power adjustment to %lld mW for %lu s", (long long)powerMw, (unsigned long)durationS);
+        demand_set_target(pct);
+        return Status::Success;
+    }
+
+    Status CancelPowerAdjustRequest() override
+    {
+        if (mState != ESAStateEnum::kPowerAdjustActive) return Status::InvalidInState;
+        EndAdjust(CauseEnum::kCancelled);
+        return Status::Success;
+    }
+
+    // Only the Power Adjustment feature is enabled
+    Status StartTimeAdjustRequest(const uint32_t requestedStartTimeUtc, AdjustmentCauseEnum cause) override
+    {
+        return Status::UnsupportedCommand;
+    }
+    Status PauseRequest(const uint32_t durationS, AdjustmentCauseEnum cause) override { return Status::UnsupportedCommand; }
+    Status ResumeRequest() override { return Status::UnsupportedCommand; }
+    Status ModifyForecastRequest(const uint32_t forecastID,
+                                 const chip::app::DataModel::DecodableList<Structs::SlotAdjustmentStruct::Type> &slotAdjustments,
+                                 AdjustmentCauseEnum cause) override
+    {
+        return Status::UnsupportedCommand;
+    }
+    Status RequestConstraintBasedForecast(const chip::app::DataModel::DecodableList<Structs::ConstraintsStruct::Type> &constraints,
+                                          AdjustmentCauseEnum cause) override
+    {
+        return Status::UnsupportedCommand;
+    }
+    Status CancelRequest() override { return Status::UnsupportedCommand; }
+
+    ESATypeEnum GetESAType() override { return ESATypeEnum::kSpaceHeatingCooling; }
+    bool GetESACanGenerate() override { return false; }
+    ESAStateEnum GetESAState() override { return mState; }
+    int64_t GetAbsMinPower() override { return 0; }
+    int64_t GetAbsMaxPower() override { return DEMAND_RATED_POWER_MW; }
+    const Nullable<Structs::PowerAdjustCapabilityStruct::Type> &GetPowerAdjustmentCapability() override { return mCapability; }
+    const Nullable<Structs::ForecastStruct::Type> &GetForecast() override { return mForecast; }
+    OptOutStateEnum GetOptOutState() override { return OptOutStateEnum::kNoOptOut; }
+
+    // The attributes are fixed by the unit and CONFIG_S21_DEMAND_RATED_POWER_W; only the
+    // state moves, driven by the requests above
+    CHIP_ERROR SetESAState(ESAStateEnum state) override
+    {
+        if (state == mState) return CHIP_NO_ERROR;
+        mState = state;
+        MatterReportingAttributeChangeCallback(mEndpointId, DeviceEnergyManagement::Id, Attributes::ESAState::Id);
+        return CHIP_NO_ERROR;
+    }
+    CHIP_ERROR SetAbsMinPower(int64_t) override { return CHIP_NO_ERROR; }
+    CHIP_ERROR SetAbsMaxPower(int64_t) override { return CHIP_NO_ERROR; }
+    CHIP_ERROR SetPowerAdjustmentCapability(const Nullable<Structs::PowerAdjustCapabilityStruct::Type> &) override
+    {
+        return CHIP_NO_ERROR;
+    }
+    CHIP_ERROR SetForecast(const Nullable<Structs::ForecastStruct::Type> &) override { return CHIP_NO_ERROR; }
+
+private:
+    static void AdjustExpired(chip::System::Layer *layer, void *context)
+    {
+        static_cast<DemandDelegate *>(context)->EndAdjust(CauseEnum::kNormalCompletion);
+    }
+
+    void SetCause(PowerAdjustReasonEnum cause)
+    {
+        if (mCapability.Value().cause == cause) return;
+        mCapability.Value().cause = cause;
+        MatterReportingAttributeChangeCallback(mEndpointId, DeviceEnergyManagement::Id,
+                                               Attributes::PowerAdjustmentCapability::Id);
+    }
+
+    void EndAdjust(CauseEnum cause)
+    {
+        chip::DeviceLayer::SystemLayer().CancelTimer(AdjustExpired, this);
+        SetCause(PowerAdjustReasonEnum::kNoAdjustment);
+        SetESAState(ESAStateEnum::kOnline);
+        Events::PowerAdjustEnd::Type event;
+        event.cause = cause;
+        event.duration = (uint32_t)((esp_timer_get_time() - mStartUs) / 1000000);
+        event.energyUse = 0; // The unit does not meter its input
+        chip::EventNumber number;
+        chip::app::LogEvent(event, mEndpointId, number);
+        ESP_LOGI(TAG, "Power adjustment ended after %lu s", (unsigned long)event.duration);
+        demand_set_target(S21_DEMAND_MAX_PCT);
+    }
+
+    ESAStateEnum mState = ESAStateEnum::kOnline;
+    int64_t mStartUs = 0;
+    Structs::PowerAdjustStruct::Type mAdjust[1];
+    Nullable<Structs::PowerAdjustCapabilityStruct::Type> mCapability;
+    Nullable<Structs::ForecastStruct::Type> mForecast;
+};
+
+static DemandDelegate s_delegate;
+
+esp_err_t app_demand_init(endpoint_t *endpoint)
+{
+    if (!endpoint) return ESP_ERR_INVALID_ARG;
+    if (!app_driver_has_register(S21_REG_ECONO)) return ESP_ERR_NOT_SUPPORTED;
+
+    // The driver lifts any cap left over from before a reboot
+    s_stats.limit_pct = S21_DEMAND_MAX_PCT;
+    s_stats.target_pct = S21_DEMAND_MAX_PCT;
+
+    // The delegate reports its attribute changes and logs its events against this endpoint
+    s_delegate.SetEndpointId(endpoint::get_id(endpoint));
+    cluster::device_energy_management::config_t dem_config;
+    dem_config.delegate = &s_delegate;
+    cluster_t *cluster = cluster::device_energy_management::create(endpoint, &dem_config, CLUSTER_FLAG_SERVER);
+    if (!cluster) {
+        ESP_LOGE(TAG, "Failed to create device energy management cluster");
+        return ESP_FAIL;
+    }
+    cluster::device_energy_management::feature::power_adjustment::add(cluster);
+    return endpoint::add_device_type(endpoint, endpoint::device_energy_management::get_device_type_id(),
+                                     endpoint::device_energy_management::get_device_type_version());
+}
+
+esp_err_t app_demand_get_stats(app_demand_stats_t *stats)
+{
+    if (!stats) return ESP_ERR_INVALID_ARG;
+    taskENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+#if CONFIG_ENABLE_CHIP_SHELL
+static void demand_console_work(intptr_t context)
+{
+    demand_set_target((uint8_t)context);
+}
+
+static esp_err_t s21demand_handler(int argc, char **argv)
+{
+    if (argc == 1) {
+        int pct = strcmp(argv[0], "off") == 0 ? S21_DEMAND_MAX_PCT : atoi(argv[0]);
+        if (pct < S21_DEMAND_MIN_PCT || pct > S21_DEMAND_MAX_PCT) {
+            printf("usage: s21demand [%d-%d|off]\n", S21_DEMAND_MIN_PCT, S21_DEMAND_MAX_PCT);
+            return ESP_ERR_INVALID_ARG;
+        }
+        chip::DeviceLayer::PlatformMgr().ScheduleWork(demand_console_work, pct);
+        return ESP_OK;
+    }
+    app_demand_stats_t stats;
+    app_demand_get_stats(&stats);
+    printf("S21D limit=%u target=%u requests=%lu failures=%lu response=%lu max_response=%lu settle=%lu\n",
+           stats.limit_pct, stats.target_pct, (unsigned long)stats.requests, (unsigned long)stats.failures,
+           (unsigned long)stats.last_response_ms, (unsigned long)stats.max_response_ms,
+           (unsigned long)stats.last_settle_ms);
+    return ESP_OK;
+}
+
+esp_err_t app_demand_register_commands()
+{
+    static const esp_matter::console::command_t command = {
+        .name = "s21demand",
+        .description = "S21 demand limit. Usage: matter esp s21demand [<percent>|off]",
+        .handler = s21demand_handler,
+    };
+    esp_err_t err = esp_matter::console::add_commands(&command, 1);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to add s21demand command: %d", err);
+    return err;
+}
+#else
+esp_err_t app_demand_register_commands()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif // CONFIG_ENABLE_CHIP_SHELL
@@ -0,0 +1,64 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+/** Demand limit change per ramp step, in percent of the rated input */
+#define APP_DEMAND_RAMP_STEP_PCT 10
+/** Time between two ramp steps once the unit has ACKed the previous one */
+#define APP_DEMAND_RAMP_STEP_S 5
+/** Shortest and longest power adjustment a controller may ask for */
+#define APP_DEMAND_MIN_DURATION_S 60
+#define APP_DEMAND_MAX_DURATION_S (4 * 3600)
+
+/** Demand response timing, since boot */
+typedef struct {
+    uint8_t limit_pct;          /**< Limit the unit last ACKed */
+    uint8_t target_pct;         /**< Limit the ramp is heading for */
+    uint32_t requests;          /**< Power adjustments and cancellations received */
+    uint32_t failures;          /**< Ramp steps the unit did not ACK in time */
+    uint32_t last_response_ms;  /**< Request arriving to the unit ACKing the first ramp step */
+    uint32_t max_response_ms;
+    uint32_t last_settle_ms;    /**< Request arriving to the unit ACKing the final limit */
+} app_demand_stats_t;
+
+/** Initialize demand response
+ *
+ * Adds a Device Energy Management cluster (Power Adjustment feature) and its device type to
+ * the endpoint. A PowerAdjustRequest caps the unit's input at the requested power, as an S21
+ * demand limit relative to CONFIG_S21_DEMAND_RATED_POWER_W; the cap is ramped in
+ * APP_DEMAND_RAMP_STEP_PCT steps, each sent ahead of queued control writes. The cap is lifted
+ * the same way when the duration runs out or the request is cancelled. Call before
+ * esp_matter::start().
+ *
+ * @param[in] endpoint Thermostat endpoint.
+ *
+ * @return ESP_OK on success.
+ * @return ESP_ERR_NOT_SUPPORTED if the unit has no demand control (no F7 register).
+ * @return error in case of failure.
+ */
+esp_err_t app_demand_init(esp_matter::endpoint_t *endpoint);
+
+/** Get demand response timing. Safe from any task.
+ *
+ * @param[out] stats Snapshot of the counters.
+ *
+ * @return ESP_OK on success.
+ * @return ESP_ERR_INVALID_ARG if stats is NULL.
+ */
+esp_err_t app_demand_get_stats(app_demand_stats_t *stats);
+
+/** Register the demand response shell command
+ *
+ * Adds "matter esp s21demand [<percent>|off]", which prints the timing counters, or sets or
+ * lifts a cap by hand, ramped like a PowerAdjustRequest but without a duration. Call before
+ * esp_matter::console::init().
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_demand_register_commands();
@@ -3,6 +3,7 @@
 */
 
 #include <esp_log.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -17,7 +18,14 @@
 #include <app/server/Server.h>
 #include <app/server/CommissioningWindowManager.h>
 
+#include "app_bridge.h"
+#include "app_maintenance.h"
+#include "board_profiles.h"
+#include "app_presets.h"
+#include "app_reporting.h"
+#include "s21_config.h"
 #include "s21_driver.h"
+#include "s21_stats.h"
 
 using namespace chip::app::Clusters;
 using namespace chip::app::Clusters::Thermostat;
@@ -30,107 +38,220 @@ static DaikinS21 s21;
 // Global Temperature Storage
 int16_t g_current_temp_int = 2100; 
 
-#define S21_TX_PIN 21
-#define S21_RX_PIN 20
-#define BUTTON_GPIO_PIN 23
-
 #define FLOAT_TO_MATTER(x) ((int16_t)((x) * 100.0f))
 #define MATTER_TO_FLOAT(x) ((float)(x) / 100.0f)
 
+// Log memory stats every N poll cycles
+#define S21_MEM_STATS_LOG_CYCLES 150
+
+// The poll task runs from static memory so driver start-up never touches the heap
+static StackType_t s_poll_task_stack[S21_POLL_TASK_STACK_SIZE];
+static StaticTask_t s_poll_task_tcb;
+
 static void s21_poll_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "S21 Poll Task Started");
     while (1) {
+        uint32_t heap_before = s21_port_heap_free();
         s21.Poll();
-        vTaskDelay(pdMS_TO_TICKS(2000));
+        s21.UpdateMemStats(heap_before);
+
+        ac_state_t state = s21.GetState();
+        s21_stats_sample(&state, s21_port_time_us());
+        s21_config_service(s21_port_time_us());
+
+        s21_mem_stats_t stats = s21.GetMemStats();
+        if (stats.poll_cycles % S21_MEM_STATS_LOG_CYCLES == 0) {
+            ESP_LOGI(TAG, "Mem: stack free %lu, heap free %lu (min %lu), heap changed in %lu/%lu cycles",
+                     (unsigned long)stats.stack_hwm_bytes, (unsigned long)stats.heap_free_bytes,
+                     (unsigned long)stats.heap_min_free_bytes, (unsigned long)stats.heap_delta_cycles,
+                     (unsigned long)stats.poll_cycles);
+            s21_link_stats_t link = s21.GetLinkStats();
+            ESP_LOGI(TAG, "Link: bit %.1fus, %lu bytes, parity %lu, framing %lu, votes %lu, bad frames %lu, retries %lu, "
+                     "lost %lu (max outage %lu ms)",
+                     link.uart.bit_period_us, (unsigned long)link.uart.bytes, (unsigned long)link.uart.parity_errors,
+                     (unsigned long)link.uart.framing_errors, (unsigned long)link.uart.vote_disagreements,
+                     (unsigned long)link.parser.bad_frames, (unsigned long)link.retries,
+                     (unsigned long)link.link_losses, (unsigned long)link.max_outage_ms);
+        }
+        // Control commands from other tasks are sent as they arrive during the wait
+        uint32_t interval_ms = s21_config_get().poll_interval_ms;
+        s21.Idle(interval_ms ? interval_ms : board_poll_interval_ms());
     }
 }
 
+uint8_t app_driver_system_mode(const ac_state_t *state)
+{
+    if (!state->power) return 0; // Off
+    switch (state->mode) {
+        case FAIKIN_MODE_COOL: return 3;
+        case FAIKIN_MODE_HEAT: return 4;
+        default: return 1; // Auto
+    }
+}
+
+bool app_driver_system_mode_control(uint8_t system_mode, s21_control_t *ctrl)
+{
+    ctrl->fields = S21_CTRL_POWER | S21_CTRL_MODE;
+    ctrl->power = true;
+    switch (system_mode) {
+        case 0: ctrl->fields = S21_CTRL_POWER; ctrl->power = false; break; 
+        case 1: ctrl->mode = FAIKIN_MODE_AUTO; break;
+        case 3: ctrl->mode = FAIKIN_MODE_COOL; break;
+        case 4: ctrl->mode = FAIKIN_MODE_HEAT; break;
+        default: ctrl->fields = 0; return false;
+    }
+    return true;
+}
+
 struct AppEventData {
     ac_state_t state;
 };
 
+// Single-slot mailbox between the poll task and the CHIP thread. The poll task
+// overwrites the slot with the newest state, and only schedules work when none is
+// pending, so bursts of changes collapse into one update without any allocation.
+// Until the thermostat endpoint exists and Matter has started, the newest state is
+// only held; app_driver_thermostat_set_defaults() sends it.
+static AppEventData s_pending_update;
+static bool s_update_held = false;
+static bool s_update_ready = false;
+static bool s_update_scheduled = false;
+static portMUX_TYPE s_update_lock = portMUX_INITIALIZER_UNLOCKED;
+
 static void AppDriverUpdateTask(intptr_t context)
 {
-    AppEventData *data = (AppEventData *)context;
-    if (!data) return;
+    AppEventData update;
+    taskENTER_CRITICAL(&s_update_lock);
+    update = s_pending_update;
+    s_update_scheduled = false;
+    taskEXIT_CRITICAL(&s_update_lock);
+    AppEventData *data = &update;
 
     // --- 1. Update Local Temp ---
     int16_t new_temp = FLOAT_TO_MATTER(data->state.current_temp);
     if (g_current_temp_int != new_temp) {
         g_current_temp_int = new_temp;
-        MatterReportingAttributeChangeCallback(
-            thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::LocalTemperature::Id);
+        app_reporting_mark_dirty(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::LocalTemperature::Id);
+    }
+
+    // --- 1b. Update Outdoor Temp (only created when the unit reports it) ---
+    if (s21.HasRegister(S21_REG_OUTSIDE_TEMP) && !isnan(data->state.outside_temp)) {
+        esp_matter_attr_val_t outdoor = esp_matter_nullable_int16(FLOAT_TO_MATTER(data->state.outside_temp));
+        app_reporting_update(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::OutdoorTemperature::Id, &outdoor);
     }
 
     // --- 2. Update Target Temp ---
     esp_matter_attr_val_t val = esp_matter_int16(FLOAT_TO_MATTER(data->state.target_temp));
+    bool occupied = app_presets_is_occupied();
     if (data->state.mode == FAIKIN_MODE_HEAT) {
-        esp_matter::attribute::report(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::OccupiedHeatingSetpoint::Id, &val);
+        app_reporting_update(thermostat_endpoint_id, Thermostat::Id,
+                             occupied ? Thermostat::Attributes::OccupiedHeatingSetpoint::Id
+                                      : Thermostat::Attributes::UnoccupiedHeatingSetpoint::Id, &val);
     } else {
-        esp_matter::attribute::report(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::OccupiedCoolingSetpoint::Id, &val);
+        app_reporting_update(thermostat_endpoint_id, Thermostat::Id,
+                             occupied ? Thermostat::Attributes::OccupiedCoolingSetpoint::Id
+                                      : Thermostat::Attributes::UnoccupiedCoolingSetpoint::Id, &val);
     }
 
     // --- 3. Update System Mode ---
-    uint8_t matter_mode = 0; // Off
-    if (data->state.power) {
-        switch(data->state.mode) {
-            case FAIKIN_MODE_AUTO: matter_mode = 1; break; 
-            case FAIKIN_MODE_COOL: matter_mode = 3; break; 
-            case FAIKIN_MODE_HEAT: matter_mode = 4; break; 
-            default: matter_mode = 1; break; 
-        }
-    }
-    val = esp_matter_enum8(matter_mode);
-    esp_matter::attribute::report(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::SystemMode::Id, &val);
+    val = esp_matter_enum8(app_driver_system_mode(&data->state));
+    app_reporting_update(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::SystemMode::Id, &val);
 
     // --- 4. Update Running State (Idle vs Active) ---
     // 0=Idle, 1=Heat, 2=Cool (Bitmap)
     uint16_t running_state = 0; 
     
-    if (data->state.power) {
-        if (data->state.mode == FAIKIN_MODE_HEAT && data->state.current_temp < data->state.target_temp) {
+    if (s21_state_active(&data->state)) {
+        if (data->state.mode == FAIKIN_MODE_HEAT) {
              running_state = 1; // Active Heating
-        } else if (data->state.mode == FAIKIN_MODE_COOL && data->state.current_temp > data->state.target_temp) {
+        } else if (data->state.mode == FAIKIN_MODE_COOL) {
              running_state = 2; // Active Cooling
         }
-        // Else (at temp) -> 0 (Idle)
+        // Else (compressor idle, or at temp) -> 0 (Idle)
     }
     
     val = esp_matter_bitmap16(running_state);
-    esp_matter::attribute::report(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::ThermostatRunningState::Id, &val);
+    app_reporting_update(thermostat_endpoint_id, Thermostat::Id, Thermostat::Attributes::ThermostatRunningState::Id, &val);
     // ------------------------------------------------
-
-    free(data);
 }
 
 static void s21_state_change_callback(const ac_state_t *state)
 {
-    if (thermostat_endpoint_id == 0) return;
-    AppEventData *data = (AppEventData *)malloc(sizeof(AppEventData));
-    if (data) {
-        data->state = *state;
-        chip::DeviceLayer::PlatformMgr().ScheduleWork(AppDriverUpdateTask, (intptr_t)data);
+    bool schedule;
+    taskENTER_CRITICAL(&s_update_lock);
+    s_pending_update.state = *state;
+    s_update_held = true;
+    schedule = s_update_ready && !s_update_scheduled;
+    if (schedule) s_update_scheduled = true;
+    taskEXIT_CRITICAL(&s_update_lock);
+
+    if (schedule && chip::DeviceLayer::PlatformMgr().ScheduleWork(AppDriverUpdateTask, 0) != CHIP_NO_ERROR) {
+        taskENTER_CRITICAL(&s_update_lock);
+        s_update_scheduled = false;
+        taskEXIT_CRITICAL(&s_update_lock);
     }
 }
 
 static esp_err_t app_driver_thermostat_set_value(void *handle, esp_matter_attr_val_t *val, uint32_t attribute_id)
 {
+    s21_control_t ctrl = {};
     if (attribute_id == Thermostat::Attributes::SystemMode::Id) {
-        uint8_t mode = val->val.u8;
-        ac_state_t current = s21.GetState();
-        switch (mode) {
-            case 0: s21.SetPower(false); break; 
-            case 1: if (!current.power) s21.SetPower(true); s21.SetMode(FAIKIN_MODE_AUTO); break;
-            case 3: if (!current.power) s21.SetPower(true); s21.SetMode(FAIKIN_MODE_COOL); break;
-            case 4: if (!current.power) s21.SetPower(true); s21.SetMode(FAIKIN_MODE_HEAT); break;
-        }
+        if (!app_driver_system_mode_control(val->val.u8, &ctrl)) return ESP_OK;
     }
     else if (attribute_id == Thermostat::Attributes::OccupiedCoolingSetpoint::Id || 
              attribute_id == Thermostat::Attributes::OccupiedHeatingSetpoint::Id) {
-        s21.SetTemp(MATTER_TO_FLOAT(val->val.i16));
+        // Occupied setpoints only drive the unit while the space is occupied, and vice versa
+        if (!app_presets_is_occupied()) return ESP_OK;
+        ctrl.fields = S21_CTRL_TEMP;
+        ctrl.target_temp = MATTER_TO_FLOAT(val->val.i16);
     }
-    return ESP_OK;
+    else if (attribute_id == Thermostat::Attributes::UnoccupiedCoolingSetpoint::Id ||
+             attribute_id == Thermostat::Attributes::UnoccupiedHeatingSetpoint::Id) {
+        if (app_presets_is_occupied()) return ESP_OK;
+        ctrl.fields = S21_CTRL_TEMP;
+        ctrl.target_temp = MATTER_TO_FLOAT(val->val.i16);
+    }
+    else {
+        return ESP_OK;
+    }
+    // Spans run from this PRE_UPDATE to the unit confirming the change; see app_trace.h
+    ctrl.trace_id = s21_trace_begin(attribute_id);
+    // A full command queue rejects the write rather than blocking the CHIP thread
+    return s21.ApplyControl(&ctrl);
+}
+
+esp_err_t app_driver_apply_setpoints(const int16_t *heat, const int16_t *cool, bool occupied, int fan_speed)
+{
+    uint32_t heat_id = occupied ? Thermostat::Attributes::OccupiedHeatingSetpoint::Id
+                                : Thermostat::Attributes::UnoccupiedHeatingSetpoint::Id;
+    uint32_t cool_id = occupied ? Thermostat::Attributes::OccupiedCoolingSetpoint::Id
+                                : Thermostat::Attributes::UnoccupiedCoolingSetpoint::Id;
+    if (heat) {
+        esp_matter_attr_val_t val = esp_matter_int16(*heat);
+        app_reporting_update(thermostat_endpoint_id, Thermostat::Id, heat_id, &val);
+    }
+    if (cool) {
+        esp_matter_attr_val_t val = esp_matter_int16(*cool);
+        app_reporting_update(thermostat_endpoint_id, Thermostat::Id, cool_id, &val);
+    }
+
+    // The unit has a single target; take the setpoint that matches its mode
+    ac_state_t current = s21.GetState();
+    const int16_t *target = (current.mode == FAIKIN_MODE_HEAT) ? heat : (cool ? cool : heat);
+
+    s21_control_t ctrl = {};
+    if (target) {
+        ctrl.fields |= S21_CTRL_TEMP;
+        ctrl.target_temp = MATTER_TO_FLOAT(*target);
+    }
+    if (fan_speed >= 0) {
+        ctrl.fields |= S21_CTRL_FAN;
+        ctrl.fan_speed = (uint8_t)fan_speed;
+    }
+    if (!ctrl.fields) return ESP_OK;
+    ctrl.trace_id = s21_trace_begin(0);
+    return s21.ApplyControl(&ctrl);
 }
 
 esp_err_t app_driver_attribute_update(app_driver_handle_t driver_handle, uint16_t endpoint_id, uint32_t cluster_id,
@@ -139,19 +260,83 @@ esp_err_t app_driver_attribute_update(app_driver_handle_t driver_handle, uint16_
     if (endpoint_id == thermostat_endpoint_id && cluster_id == Thermostat::Id) {
         return app_driver_thermostat_set_value(driver_handle, val, attribute_id);
     }
+#if CONFIG_S21_BRIDGE_MODE
+    return app_bridge_attribute_update(endpoint_id, cluster_id, attribute_id, val);
+#else
     return ESP_OK;
+#endif
 }
 
-esp_err_t app_driver_thermostat_set_defaults(uint16_t endpoint_id) { return ESP_OK; }
+// The attributes start from the state the driver notified while the endpoint was being
+// created, or from its current one (the stored state, if the unit has not answered yet)
+esp_err_t app_driver_thermostat_set_defaults(uint16_t endpoint_id)
+{
+    ac_state_t state = s21.GetState();
+    taskENTER_CRITICAL(&s_update_lock);
+    if (!s_update_held) s_pending_update.state = state;
+    s_update_held = true;
+    s_update_ready = true;
+    bool schedule = !s_update_scheduled;
+    s_update_scheduled = true;
+    taskEXIT_CRITICAL(&s_update_lock);
+
+    if (schedule && chip::DeviceLayer::PlatformMgr().ScheduleWork(AppDriverUpdateTask, 0) != CHIP_NO_ERROR) {
+        taskENTER_CRITICAL(&s_update_lock);
+        s_update_scheduled = false;
+        taskEXIT_CRITICAL(&s_update_lock);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
 
 app_driver_handle_t app_driver_thermostat_init()
 {
-    s21.Init(S21_TX_PIN, S21_RX_PIN);
+    static const char *transport_names[] = { "bit-bang", "UART", "simulated unit" };
+    ESP_LOGI(TAG, "Board %s, S21 on TX %d RX %d via %s", s_board.name, s_board.s21_tx_pin, s_board.s21_rx_pin,
+             transport_names[board_transport()]);
+    // The state callback goes first, so no status read during discovery goes unnotified
     s21.SetStateCallback(s21_state_change_callback);
-    xTaskCreate(s21_poll_task, "s21_poll", 4096, NULL, 5, NULL);
+    s21.Init(s_board.s21_tx_pin, s_board.s21_rx_pin, board_transport());
+    s21.DiscoverCapabilities();
+    s21.SetMaintCallback(app_maintenance_on_change);
+    xTaskCreateStatic(s21_poll_task, "s21_poll", S21_POLL_TASK_STACK_SIZE, NULL, 5, s_poll_task_stack, &s_poll_task_tcb);
     return (app_driver_handle_t)1;
 }
 
+esp_err_t app_driver_apply_control(const s21_control_t *ctrl)
+{
+    return s21.ApplyControl(ctrl);
+}
+
+esp_err_t app_driver_apply_demand(const s21_demand_t *demand, s21_cmd_done_cb_t done, void *ctx)
+{
+    return s21.ApplyDemand(demand, done, ctx);
+}
+
+ac_state_t app_driver_get_state()
+{
+    return s21.GetState();
+}
+
+bool app_driver_has_register(s21_reg_t reg)
+{
+    return s21.HasRegister(reg);
+}
+
+esp_err_t app_driver_get_link_stats(s21_link_stats_t *stats)
+{
+    if (!stats) return ESP_ERR_INVALID_ARG;
+    *stats = s21.GetLinkStats();
+    return ESP_OK;
+}
+
+esp_err_t app_driver_get_mem_stats(s21_mem_stats_t *stats)
+{
+    if (!stats) return ESP_ERR_INVALID_ARG;
+    *stats = s21.GetMemStats();
+    return ESP_OK;
+}
+
 static void app_driver_button_toggle_cb(void *arg, void *data)
 {
     ESP_LOGI(TAG, "Button Pressed: Opening Commissioning Window");
@@ -164,8 +349,9 @@ static void app_driver_button_toggle_cb(void *arg, void *data)
 
 app_driver_handle_t app_driver_button_init()
 {
+    if (s_board.button_pin < 0) return NULL;
     button_config_t btn_cfg = {0};
-    button_gpio_config_t btn_gpio_cfg = { .gpio_num = BUTTON_GPIO_PIN, .active_level = 0 };
+    button_gpio_config_t btn_gpio_cfg = { .gpio_num = s_board.button_pin, .active_level = 0 };
     button_handle_t btn_handle = NULL;
     esp_err_t err = iot_button_new_gpio_device(&btn_cfg, &btn_gpio_cfg, &btn_handle);
     if (err == ESP_OK && btn_handle) {
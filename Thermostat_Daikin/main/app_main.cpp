@@ -15,6 +15,14 @@
 
 #include <app_priv.h>
 #include <app_reset.h>
+#include "app_bridge.h"
+#include "app_config.h"
+#include "app_demand.h"
+#include "app_maintenance.h"
+#include "app_presets.h"
+#include "app_schedule.h"
+#include "app_stats.h"
+#include "app_trace.h"
 #if CHIP_DEVICE_CONFIG_ENABLE_THREAD
 #include <platform/ESP32/OpenthreadLauncher.h>
 #endif
@@ -66,6 +74,11 @@ public:
 
     CHIP_ERROR Read(const chip::app::ConcreteReadAttributePath & aPath, chip::app::AttributeValueEncoder & aEncoder) override
     {
+        // Bridged thermostats keep LocalTemperature in attribute storage
+        if (aPath.mEndpointId != thermostat_endpoint_id)
+        {
+            return CHIP_NO_ERROR;
+        }
         if (aPath.mAttributeId == Thermostat::Attributes::LocalTemperature::Id)
         {
             return aEncoder.Encode(g_current_temp_int);
@@ -185,6 +198,9 @@ extern "C" void app_main()
     esp_err_t err = ESP_OK;
     nvs_flash_init();
 
+    // Runtime statistics are fed from the driver's poll task, so start them first
+    app_stats_init();
+
     app_driver_handle_t thermostat_handle = app_driver_thermostat_init();
     
     // --- ENABLE BUTTON ---
@@ -225,9 +241,46 @@ extern "C" void app_main()
         // 5. Running State (Fixes the "Off when Idle" bug)
         // 0=Idle, 1=Heat, 2=Cool
         ensure_attribute(cluster, Thermostat::Attributes::ThermostatRunningState::Id, ESP_MATTER_VAL_TYPE_BITMAP16, esp_matter_bitmap16(0));
+
+        // 6. Outdoor Temperature, only if the unit has an outside sensor
+        if (app_driver_has_register(S21_REG_OUTSIDE_TEMP)) {
+            ensure_attribute(cluster, Thermostat::Attributes::OutdoorTemperature::Id, ESP_MATTER_VAL_TYPE_NULLABLE_INT16, esp_matter_nullable_int16(nullable<int16_t>()));
+        }
+
+        // 7. On-device weekly schedule (ScheduleConfiguration feature)
+        err = app_schedule_init(cluster);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to initialize schedule, err:%d", err);
+        }
+
+        // 8. Presets (Home/Away/Sleep/Eco) and occupancy setback
+        err = app_presets_init(thermostat_endpoint_id, cluster);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to initialize presets, err:%d", err);
+        }
+    }
+
+    // --- FILTER MONITORING AND FAULTS ---
+    err = app_maintenance_init(endpoint);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize maintenance reporting, err:%d", err);
     }
     // ------------------------------------
 
+    // --- DEMAND RESPONSE, only if the unit has demand control ---
+    err = app_demand_init(endpoint);
+    if (err != ESP_OK && err != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGE(TAG, "Failed to initialize demand response, err:%d", err);
+    }
+    // ------------------------------------
+
+    // --- BRIDGED UNITS ---
+    err = app_bridge_init(node);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize bridge, err:%d", err);
+    }
+    // ---------------------
+
     // --- REGISTER THE ACCESSOR ---
     chip::app::AttributeAccessInterfaceRegistry::Instance().Register(&sLocalTempAccessor);
     // -----------------------------
@@ -262,6 +315,11 @@ extern "C" void app_main()
     ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to start Matter, err:%d", err));
 
     app_driver_thermostat_set_defaults(thermostat_endpoint_id);
+
+    err = app_bridge_start();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start S21 peer link, err:%d", err);
+    }
     
 #if CONFIG_ENABLE_ENCRYPTED_OTA
     err = esp_matter_ota_requestor_encrypted_init(s_decryption_key, s_decryption_key_len);
@@ -273,14 +331,18 @@ extern "C" void app_main()
     esp_matter::console::wifi_register_commands();
     esp_matter::console::factoryreset_register_commands();
     esp_matter::console::attribute_register_commands();
+    app_trace_register_commands();
+    app_stats_register_commands();
+    app_config_register_commands();
+    app_demand_register_commands();
+    app_bridge_register_commands();
 #if CONFIG_OPENTHREAD_CLI
     esp_matter::console::otcli_register_commands();
 #endif
     esp_matter::console::init();
 #endif
 
-    while (true) {
-        MEMORY_PROFILER_DUMP_HEAP_STAT("Idle");
-        vTaskDelay(10000 / portTICK_PERIOD_MS);
-    }
+    // Nothing left to do here: returning frees the main task stack. Driver memory
+    // usage is reported by the poll task (see app_driver_get_mem_stats()).
+    MEMORY_PROFILER_DUMP_HEAP_STAT("Idle");
 }
\ No newline at end of file
@@ -0,0 +1,231 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <esp_log.h>
+#include <nvs.h>
+#include <string.h>
+
+#include <esp_matter.h>
+#include <app/clusters/general-diagnostics-server/general-diagnostics-server.h>
+#include <app/clusters/resource-monitoring-server/resource-monitoring-server.h>
+#include <platform/CHIPDeviceLayer.h>
+#include <platform/DiagnosticDataProvider.h>
+#include <platform/ESP32/DiagnosticDataProviderImpl.h>
+
+#include "app_maintenance.h"
+#include "app_reporting.h"
+#include "s21_config.h"
+
+using namespace esp_matter;
+using namespace chip::app::Clusters;
+using chip::Protocols::InteractionModel::Status;
+
+static const char *TAG = "app_maintenance";
+
+// Where the filter base was kept before it moved into the driver config blob
+#define MAINT_NVS_NAMESPACE "maint"
+#define MAINT_NVS_KEY_FILTER_BASE "filter_base"
+// Condition (percent left) below which the filter raises a warning
+#define FILTER_WARNING_PERCENT 10
+
+// Latest data from the poll task, same single-slot scheme as the state updates
+static s21_maint_t s_pending;
+static bool s_scheduled = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Only touched on the CHIP thread
+static s21_maint_t s_current;
+static uint16_t s_filter_base_hours = 0; // Filter hours at the last ResetCondition
+static bool s_filter_reset_pending = false; // ResetCondition waiting for the first filter read
+static uint16_t s_endpoint_id = chip::kInvalidEndpointId;
+
+static void filter_base_save()
+{
+    s21_config_set_filter_base(s_filter_base_hours);
+}
+
+static void filter_base_load()
+{
+    s21_config_t config = s21_config_get();
+    if (config.flags & S21_CONFIG_HAS_FILTER) {
+        s_filter_base_hours = config.filter_base_hours;
+        return;
+    }
+    // First boot since the move: take the old key over, if there is one, and drop it. Saving
+    // even the default marks the move as done, so the old key is looked for only once.
+    nvs_handle_t handle;
+    if (nvs_open(MAINT_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        if (nvs_get_u16(handle, MAINT_NVS_KEY_FILTER_BASE, &s_filter_base_hours) == ESP_OK) {
+            nvs_erase_key(handle, MAINT_NVS_KEY_FILTER_BASE);
+            nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    filter_base_save();
+}
+
+class FilterDelegate : public ResourceMonitoring::Delegate {
+public:
+    CHIP_ERROR Init() override { return CHIP_NO_ERROR; }
+
+    // ResetCondition: the unit counts hours since its own reset, so count from here. Before
+    // the first filter read there is no "here" yet, and the reset waits for it.
+    Status PostResetCondition() override
+    {
+        s_filter_reset_pending = true;
+        Update();
+        return Status::Success;
+    }
+
+    void Update()
+    {
+        ResourceMonitoring::Instance *instance = GetInstance();
+        if (!instance || !s_current.filter_known) return;
+
+        if (s_filter_reset_pending) {
+            s_filter_reset_pending = false;
+            s_filter_base_hours = s_current.filter_hours;
+            filter_base_save();
+        }
+        // The unit's own counter went backwards: its filter sign was reset at the unit
+        uint16_t base = s21_filter_base_check(&s_current, s_filter_base_hours);
+        if (base != s_filter_base_hours) {
+            s_filter_base_hours = base;
+            filter_base_save();
+        }
+        // The driver's filter_sign counts from the same base, but only from its next filter
+        // read; right after a ResetCondition it is still the old one
+        uint32_t used = s21_filter_used_hours(s_current.filter_hours, s_filter_base_hours);
+        uint8_t condition = used >= S21_FILTER_LIFE_HOURS ? 0 : 100 - (used * 100 / S21_FILTER_LIFE_HOURS);
+
+        ResourceMonitoring::ChangeIndicationEnum indication = ResourceMonitoring::ChangeIndicationEnum::kOk;
+        if (condition == 0) {
+            indication = ResourceMonitoring::ChangeIndicationEnum::kCritical;
+        } else if (condition < FILTER_WARNING_PERCENT) {
+            indication = ResourceMonitoring::ChangeIndicationEnum::kWarning;
+        }
+        instance->UpdateCondition(condition);
+        instance->UpdateChangeIndication(indication);
+    }
+};
+
+static FilterDelegate s_filter_delegate;
+
+using chip::DeviceLayer::GeneralFaults;
+using chip::DeviceLayer::kMaxHardwareFaults;
+
+static GeneralDiagnostics::HardwareFaultEnum fault_enum(s21_fault_class_t fault_class)
+{
+    switch (fault_class) {
+    case S21_FAULT_SENSOR:
+        return GeneralDiagnostics::HardwareFaultEnum::kSensor;
+    case S21_FAULT_OVER_TEMP:
+        return GeneralDiagnostics::HardwareFaultEnum::kResettableOverTemp;
+    case S21_FAULT_POWER:
+        return GeneralDiagnostics::HardwareFaultEnum::kPowerSource;
+    default:
+        return GeneralDiagnostics::HardwareFaultEnum::kUnspecified;
+    }
+}
+
+// The faults a unit error code stands for: none, or the one its class maps to
+static void fault_list(const char *code, GeneralFaults<kMaxHardwareFaults> &faults)
+{
+    s21_fault_class_t fault_class = s21_fault_class(code);
+    if (fault_class != S21_FAULT_NONE) faults.add(chip::to_underlying(fault_enum(fault_class)));
+}
+
+// General Diagnostics reads ActiveHardwareFaults from the diagnostic data provider; the
+// platform one has no faults to give, so serve the unit's on top of it
+class FaultDiagnostics : public chip::DeviceLayer::DiagnosticDataProviderImpl {
+public:
+    CHIP_ERROR GetActiveHardwareFaults(GeneralFaults<kMaxHardwareFaults> &hardwareFaults) override
+    {
+        fault_list(s_current.error_code, hardwareFaults);
+        return CHIP_NO_ERROR;
+    }
+};
+
+static FaultDiagnostics s_diagnostics;
+
+// After s_current has the new code, so a read triggered by the change sees it
+static void report_fault_change(const char *previous_code, const char *current_code)
+{
+    GeneralFaults<kMaxHardwareFaults> previous;
+    GeneralFaults<kMaxHardwareFaults> current;
+    fault_list(previous_code, previous);
+    fault_list(current_code, current);
+    GeneralDiagnosticsServer::Instance().OnHardwareFaultsDetect(previous, current);
+}
+
+static void compressor_hours_update(uint16_t hours)
+{
+    if (s_endpoint_id == chip::kInvalidEndpointId) return;
+    esp_matter_attr_val_t val = esp_matter_uint32(hours);
+    app_reporting_update(s_endpoint_id, Thermostat::Id, APP_MAINT_ATTR_COMPRESSOR_HOURS, &val);
+}
+
+static void maintenance_update_work(intptr_t context)
+{
+    s21_maint_t maint;
+    taskENTER_CRITICAL(&s_lock);
+    maint = s_pending;
+    s_scheduled = false;
+    taskEXIT_CRITICAL(&s_lock);
+
+    s21_maint_t previous = s_current;
+    s_current = maint;
+    if (strcmp(maint.error_code, previous.error_code) != 0) {
+        ESP_LOGI(TAG, "Fault %s -> %s", previous.error_code[0] ? previous.error_code : "none",
+                 maint.error_code[0] ? maint.error_code : "none");
+        report_fault_change(previous.error_code, maint.error_code);
+    }
+    if (maint.compressor_hours != previous.compressor_hours) compressor_hours_update(maint.compressor_hours);
+    s_filter_delegate.Update();
+}
+
+void app_maintenance_on_change(const s21_maint_t *maint)
+{
+    bool schedule;
+    taskENTER_CRITICAL(&s_lock);
+    s_pending = *maint;
+    schedule = !s_scheduled;
+    s_scheduled = true;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (schedule && chip::DeviceLayer::PlatformMgr().ScheduleWork(maintenance_update_work, 0) != CHIP_NO_ERROR) {
+        taskENTER_CRITICAL(&s_lock);
+        s_scheduled = false;
+        taskEXIT_CRITICAL(&s_lock);
+    }
+}
+
+esp_err_t app_maintenance_init(endpoint_t *endpoint)
+{
+    if (!endpoint) return ESP_ERR_INVALID_ARG;
+    filter_base_load();
+
+    cluster::hepa_filter_monitoring::config_t filter_config;
+    filter_config.delegate = &s_filter_delegate;
+    cluster_t *cluster = cluster::hepa_filter_monitoring::create(endpoint, &filter_config, CLUSTER_FLAG_SERVER);
+    if (!cluster) {
+        ESP_LOGE(TAG, "Failed to create filter monitoring cluster");
+        return ESP_FAIL;
+    }
+    cluster::hepa_filter_monitoring::feature::condition::config_t condition_config;
+    cluster::hepa_filter_monitoring::feature::condition::add(cluster, &condition_config);
+    cluster::hepa_filter_monitoring::feature::warning::add(cluster);
+
+    // Compressor run hours have no standard attribute; keep them next to the thermostat's own
+    cluster_t *thermostat = cluster::get(endpoint, Thermostat::Id);
+    if (!thermostat || !attribute::create(thermostat, APP_MAINT_ATTR_COMPRESSOR_HOURS, ATTRIBUTE_FLAG_NONE,
+                                          esp_matter_uint32(0))) {
+        ESP_LOGE(TAG, "Failed to create compressor hours attribute");
+        return ESP_FAIL;
+    }
+    s_endpoint_id = endpoint::get_id(endpoint);
+
+    chip::DeviceLayer::SetDiagnosticDataProvider(&s_diagnostics);
+    return ESP_OK;
+}
@@ -0,0 +1,35 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+#include <platform/CHIPDeviceConfig.h>
+
+#include "s21_driver.h"
+
+/** Compressor run hours (uint32, read only), a manufacturer specific Thermostat attribute */
+#define APP_MAINT_ATTR_COMPRESSOR_HOURS (((uint32_t)CHIP_DEVICE_CONFIG_DEVICE_VENDOR_ID << 16) | 0x0000)
+
+/** Initialize filter monitoring and fault reporting
+ *
+ * Adds a HEPA Filter Monitoring cluster (Condition and Warning features) to the endpoint, and
+ * the compressor run hours attribute to its Thermostat cluster, which must exist already.
+ * Unit error codes are raised as General Diagnostics HardwareFaultChange events, mapped by
+ * s21_fault_class() to Sensor, ResettableOverTemp, PowerSource or Unspecified, and the same
+ * faults are served as ActiveHardwareFaults. Call before esp_matter::start().
+ *
+ * @param[in] endpoint Thermostat endpoint.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_maintenance_init(esp_matter::endpoint_t *endpoint);
+
+/** Driver callback for maintenance changes
+ *
+ * Called from the S21 poll task. Copies the data and hands it to the CHIP thread.
+ */
+void app_maintenance_on_change(const s21_maint_t *maint);
@@ -0,0 +1,368 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <esp_log.h>
+#include <nvs.h>
+#include <string.h>
+
+#include <esp_matter.h>
+#include <app/clusters/thermostat-server/thermostat-delegate.h>
+#include <app/clusters/thermostat-server/thermostat-server.h>
+#include <lib/support/Span.h>
+#include <platform/CHIPDeviceLayer.h>
+
+#include "iot_button.h"
+#include "button_gpio.h"
+
+#include <app_priv.h>
+#include "app_presets.h"
+#include "app_reporting.h"
+#include "board_profiles.h"
+#include "faikin_enums.h"
+
+using namespace esp_matter;
+using namespace chip::app::Clusters;
+using namespace chip::app::Clusters::Thermostat;
+using chip::ByteSpan;
+using chip::CharSpan;
+using chip::MutableByteSpan;
+using chip::app::DataModel::Nullable;
+
+static const char *TAG = "app_presets";
+
+// Occupancy sensor contact (e.g. a PIR output) is on s_board.occupancy_pin
+#define OCCUPANCY_ACTIVE_LEVEL 1
+
+#define PRESETS_NVS_NAMESPACE "presets"
+#define PRESETS_NVS_KEY       "list"
+#define PRESETS_STORAGE_VERSION 1
+// Handles of the built-in presets; user presets get handles from PRESET_FIRST_USER_HANDLE
+#define PRESET_HANDLE_HOME  1
+#define PRESET_HANDLE_AWAY  2
+#define PRESET_HANDLE_SLEEP 3
+#define PRESET_HANDLE_ECO   4
+#define PRESET_FIRST_USER_HANDLE 16
+
+#define PRESET_HAS_HEAT (1 << 0)
+#define PRESET_HAS_COOL (1 << 1)
+#define PRESET_BUILT_IN (1 << 2)
+
+// Stored form of a preset. All handles are one byte.
+typedef struct {
+    uint8_t handle;
+    uint8_t scenario;  // PresetScenarioEnum
+    uint8_t flags;     // PRESET_*
+    int8_t fan_speed;  // FAIKIN_FAN_*, -1 to leave the fan alone
+    int16_t heat;      // 0.01 C
+    int16_t cool;      // 0.01 C
+    char name[APP_PRESET_NAME_LEN];
+} preset_record_t;
+
+typedef struct {
+    uint8_t version; // PRESETS_STORAGE_VERSION
+    uint8_t count;
+    uint8_t reserved[2];
+    preset_record_t presets[APP_PRESETS_MAX];
+} preset_storage_t;
+
+static const preset_record_t s_builtin_presets[] = {
+    { PRESET_HANDLE_HOME,  (uint8_t)PresetScenarioEnum::kOccupied,    PRESET_HAS_HEAT | PRESET_HAS_COOL | PRESET_BUILT_IN, FAIKIN_FAN_AUTO,  2100, 2400, "Home" },
+    { PRESET_HANDLE_AWAY,  (uint8_t)PresetScenarioEnum::kUnoccupied,  PRESET_HAS_HEAT | PRESET_HAS_COOL | PRESET_BUILT_IN, FAIKIN_FAN_AUTO,  1600, 2800, "Away" },
+    { PRESET_HANDLE_SLEEP, (uint8_t)PresetScenarioEnum::kSleep,       PRESET_HAS_HEAT | PRESET_HAS_COOL | PRESET_BUILT_IN, FAIKIN_FAN_QUIET, 1800, 2600, "Sleep" },
+    { PRESET_HANDLE_ECO,   (uint8_t)PresetScenarioEnum::kUserDefined, PRESET_HAS_HEAT | PRESET_HAS_COOL | PRESET_BUILT_IN, FAIKIN_FAN_1,     1900, 2600, "Eco" },
+};
+
+static const Structs::PresetTypeStruct::Type s_preset_types[] = {
+    { PresetScenarioEnum::kOccupied, 1, chip::BitMask<PresetTypeFeaturesBitmap>(PresetTypeFeaturesBitmap::kAutomatic) },
+    { PresetScenarioEnum::kUnoccupied, 1, chip::BitMask<PresetTypeFeaturesBitmap>(PresetTypeFeaturesBitmap::kAutomatic) },
+    { PresetScenarioEnum::kSleep, 1, chip::BitMask<PresetTypeFeaturesBitmap>() },
+    { PresetScenarioEnum::kUserDefined, 3, chip::BitMask<PresetTypeFeaturesBitmap>(PresetTypeFeaturesBitmap::kSupportsNames) },
+};
+
+// Presets and pending edits; only touched on the CHIP thread
+static preset_storage_t s_store;
+static preset_record_t s_pending[APP_PRESETS_MAX];
+static uint8_t s_pending_count = 0;
+static uint8_t s_active_handle = 0; // 0 = no active preset
+static uint16_t s_endpoint_id = 0;
+static volatile bool s_occupied = true;
+
+static const preset_record_t *find_preset(uint8_t handle)
+{
+    for (uint8_t i = 0; i < s_store.count; i++) {
+        if (s_store.presets[i].handle == handle) return &s_store.presets[i];
+    }
+    return NULL;
+}
+
+static bool handle_in_use(uint8_t handle)
+{
+    for (uint8_t i = 0; i < s_pending_count; i++) {
+        if (s_pending[i].handle == handle) return true;
+    }
+    return find_preset(handle) != NULL;
+}
+
+// First user handle in neither the committed nor the pending list, 0 if there is none.
+// Searching rather than counting means an aborted edit wastes nothing and a handle never
+// runs into the built-in range.
+static uint8_t allocate_handle()
+{
+    for (unsigned handle = PRESET_FIRST_USER_HANDLE; handle <= UINT8_MAX; handle++) {
+        if (!handle_in_use((uint8_t)handle)) return (uint8_t)handle;
+    }
+    return 0;
+}
+
+static void record_to_struct(const preset_record_t &r, PresetStructWithOwnedMembers &preset)
+{
+    uint8_t handle = r.handle;
+    preset.SetPresetHandle(chip::app::DataModel::MakeNullable(ByteSpan(&handle, 1)));
+    preset.SetPresetScenario((PresetScenarioEnum)r.scenario);
+    CharSpan name(r.name, strnlen(r.name, sizeof(r.name)));
+    preset.SetName(chip::MakeOptional(chip::app::DataModel::MakeNullable(name)));
+    chip::Optional<int16_t> heat, cool;
+    if (r.flags & PRESET_HAS_HEAT) heat.SetValue(r.heat);
+    if (r.flags & PRESET_HAS_COOL) cool.SetValue(r.cool);
+    preset.SetHeatingSetpoint(heat);
+    preset.SetCoolingSetpoint(cool);
+    preset.SetBuiltIn(chip::app::DataModel::MakeNullable((r.flags & PRESET_BUILT_IN) != 0));
+}
+
+static void presets_save()
+{
+    nvs_handle_t handle;
+    if (nvs_open(PRESETS_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, PRESETS_NVS_KEY, &s_store, sizeof(s_store)) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void presets_load()
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(s_store);
+    esp_err_t err = nvs_open(PRESETS_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, PRESETS_NVS_KEY, &s_store, &len);
+        nvs_close(handle);
+    }
+    if (err == ESP_OK && len == sizeof(s_store) && s_store.version == PRESETS_STORAGE_VERSION &&
+        s_store.count <= APP_PRESETS_MAX) {
+        return;
+    }
+    memset(&s_store, 0, sizeof(s_store));
+    s_store.version = PRESETS_STORAGE_VERSION;
+    s_store.count = sizeof(s_builtin_presets) / sizeof(s_builtin_presets[0]);
+    memcpy(s_store.presets, s_builtin_presets, sizeof(s_builtin_presets));
+}
+
+// Setpoints and fan of a preset go to the unit as one merged write. Presets carry no mode:
+// PresetStruct has none, and the mode stays whatever SystemMode says.
+static void preset_apply(const preset_record_t *p)
+{
+    bool occupied = p->scenario != (uint8_t)PresetScenarioEnum::kUnoccupied &&
+                    p->scenario != (uint8_t)PresetScenarioEnum::kVacation;
+    ESP_LOGI(TAG, "Applying preset %.*s", (int)strnlen(p->name, sizeof(p->name)), p->name);
+    app_driver_apply_setpoints((p->flags & PRESET_HAS_HEAT) ? &p->heat : NULL,
+                               (p->flags & PRESET_HAS_COOL) ? &p->cool : NULL, occupied, p->fan_speed);
+}
+
+class PresetDelegate : public Delegate {
+public:
+    std::optional<chip::System::Clock::Milliseconds16> GetMaxAtomicWriteTimeout(chip::AttributeId attributeId) override
+    {
+        if (attributeId == Attributes::Presets::Id) {
+            return std::make_optional(chip::System::Clock::Milliseconds16(3000));
+        }
+        return std::nullopt;
+    }
+
+    CHIP_ERROR GetPresetTypeAtIndex(size_t index, Structs::PresetTypeStruct::Type &presetType) override
+    {
+        if (index >= sizeof(s_preset_types) / sizeof(s_preset_types[0])) return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+        presetType = s_preset_types[index];
+        return CHIP_NO_ERROR;
+    }
+
+    uint8_t GetNumberOfPresets() override { return APP_PRESETS_MAX; }
+
+    CHIP_ERROR GetPresetAtIndex(size_t index, PresetStructWithOwnedMembers &preset) override
+    {
+        if (index >= s_store.count) return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+        record_to_struct(s_store.presets[index], preset);
+        return CHIP_NO_ERROR;
+    }
+
+    CHIP_ERROR GetActivePresetHandle(Nullable<MutableByteSpan> &activePresetHandle) override
+    {
+        if (s_active_handle == 0) {
+            activePresetHandle.SetNull();
+            return CHIP_NO_ERROR;
+        }
+        return chip::CopySpanToMutableSpan(ByteSpan(&s_active_handle, 1), activePresetHandle.Value());
+    }
+
+    CHIP_ERROR SetActivePresetHandle(const Nullable<ByteSpan> &newActivePresetHandle) override
+    {
+        if (newActivePresetHandle.IsNull()) {
+            s_active_handle = 0;
+            return CHIP_NO_ERROR;
+        }
+        if (newActivePresetHandle.Value().size() != 1) return CHIP_ERROR_INVALID_ARGUMENT;
+        const preset_record_t *p = find_preset(newActivePresetHandle.Value()[0]);
+        if (!p) return CHIP_ERROR_INVALID_ARGUMENT;
+        s_active_handle = p->handle;
+        preset_apply(p);
+        return CHIP_NO_ERROR;
+    }
+
+    void InitializePendingPresets() override
+    {
+        memcpy(s_pending, s_store.presets, s_store.count * sizeof(s_pending[0]));
+        s_pending_count = s_store.count;
+    }
+
+    CHIP_ERROR AppendToPendingPresetList(const PresetStructWithOwnedMembers &preset) override
+    {
+        if (s_pending_count == APP_PRESETS_MAX) return CHIP_ERROR_NO_MEMORY;
+
+        preset_record_t r = {};
+        if (preset.GetPresetHandle().IsNull()) {
+            r.handle = allocate_handle();
+            if (r.handle == 0) return CHIP_ERROR_NO_MEMORY;
+        } else {
+            if (preset.GetPresetHandle().Value().size() != 1) return CHIP_ERROR_INVALID_ARGUMENT;
+            r.handle = preset.GetPresetHandle().Value()[0];
+        }
+        // A preset already in the pending list with this handle is being replaced
+        uint8_t slot = s_pending_count;
+        for (uint8_t i = 0; i < s_pending_count; i++) {
+            if (s_pending[i].handle == r.handle) slot = i;
+        }
+        const preset_record_t *existing = find_preset(r.handle);
+
+        r.scenario = (uint8_t)preset.GetPresetScenario();
+        r.fan_speed = existing ? existing->fan_speed : -1;
+        if (preset.GetHeatingSetpoint().HasValue()) {
+            r.flags |= PRESET_HAS_HEAT;
+            r.heat = preset.GetHeatingSetpoint().Value();
+        }
+        if (preset.GetCoolingSetpoint().HasValue()) {
+            r.flags |= PRESET_HAS_COOL;
+            r.cool = preset.GetCoolingSetpoint().Value();
+        }
+        if (existing && (existing->flags & PRESET_BUILT_IN)) r.flags |= PRESET_BUILT_IN;
+        if (preset.GetName().HasValue() && !preset.GetName().Value().IsNull()) {
+            CharSpan name = preset.GetName().Value().Value();
+            memcpy(r.name, name.data(), name.size() < sizeof(r.name) ? name.size() : sizeof(r.name));
+        }
+
+        if (slot == s_pending_count) s_pending_count++;
+        s_pending[slot] = r;
+        return CHIP_NO_ERROR;
+    }
+
+    CHIP_ERROR GetPendingPresetAtIndex(size_t index, PresetStructWithOwnedMembers &preset) override
+    {
+        if (index >= s_pending_count) return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+        record_to_struct(s_pending[index], preset);
+        return CHIP_NO_ERROR;
+    }
+
+    CHIP_ERROR CommitPendingPresets() override
+    {
+        memcpy(s_store.presets, s_pending, s_pending_count * sizeof(s_pending[0]));
+        s_store.count = s_pending_count;
+        if (s_active_handle && !find_preset(s_active_handle)) s_active_handle = 0;
+        presets_save();
+        return CHIP_NO_ERROR;
+    }
+
+    void ClearPendingPresetList() override { s_pending_count = 0; }
+};
+
+static PresetDelegate s_delegate;
+
+static const preset_record_t *find_preset_by_scenario(PresetScenarioEnum scenario)
+{
+    for (uint8_t i = 0; i < s_store.count; i++) {
+        if (s_store.presets[i].scenario == (uint8_t)scenario) return &s_store.presets[i];
+    }
+    return NULL;
+}
+
+// Runs on the CHIP thread
+static void occupancy_changed(intptr_t context)
+{
+    bool occupied = context != 0;
+    esp_matter_attr_val_t val = esp_matter_bitmap8(occupied ? 1 : 0);
+    app_reporting_update(s_endpoint_id, Thermostat::Id, Attributes::Occupancy::Id, &val);
+
+    const preset_record_t *p = find_preset_by_scenario(occupied ? PresetScenarioEnum::kOccupied
+                                                                : PresetScenarioEnum::kUnoccupied);
+    if (!p) return;
+    s_active_handle = p->handle;
+    app_reporting_mark_dirty(s_endpoint_id, Thermostat::Id, Attributes::ActivePresetHandle::Id);
+    preset_apply(p);
+}
+
+void app_presets_set_occupancy(bool occupied)
+{
+    if (s_occupied == occupied) return;
+    s_occupied = occupied;
+    ESP_LOGI(TAG, "Occupancy: %s", occupied ? "occupied" : "unoccupied");
+    chip::DeviceLayer::PlatformMgr().ScheduleWork(occupancy_changed, occupied ? 1 : 0);
+}
+
+bool app_presets_is_occupied()
+{
+    return s_occupied;
+}
+
+static void occupancy_input_cb(void *arg, void *data)
+{
+    app_presets_set_occupancy((intptr_t)data != 0);
+}
+
+static void occupancy_input_init()
+{
+    if (s_board.occupancy_pin < 0) return;
+    button_config_t cfg = {0};
+    button_gpio_config_t gpio_cfg = { .gpio_num = s_board.occupancy_pin, .active_level = OCCUPANCY_ACTIVE_LEVEL };
+    button_handle_t handle = NULL;
+    if (iot_button_new_gpio_device(&cfg, &gpio_cfg, &handle) != ESP_OK || !handle) {
+        ESP_LOGE(TAG, "Failed to set up occupancy input");
+        return;
+    }
+    iot_button_register_cb(handle, BUTTON_PRESS_DOWN, NULL, occupancy_input_cb, (void *)1);
+    iot_button_register_cb(handle, BUTTON_PRESS_UP, NULL, occupancy_input_cb, (void *)0);
+}
+
+esp_err_t app_presets_init(uint16_t endpoint_id, cluster_t *cluster)
+{
+    if (!cluster) return ESP_ERR_INVALID_ARG;
+    s_endpoint_id = endpoint_id;
+    presets_load();
+
+    cluster::thermostat::feature::presets::config_t presets_config;
+    esp_err_t err = cluster::thermostat::feature::presets::add(cluster, &presets_config);
+    if (err != ESP_OK) return err;
+
+    // Occupancy feature: sets its FeatureMap bit and creates the Occupancy attribute
+    cluster::thermostat::feature::occupancy::config_t occupancy_config;
+    err = cluster::thermostat::feature::occupancy::add(cluster, &occupancy_config);
+    if (err != ESP_OK) return err;
+    if (!attribute::get(cluster, Attributes::UnoccupiedHeatingSetpoint::Id)) {
+        attribute::create(cluster, Attributes::UnoccupiedHeatingSetpoint::Id, ATTRIBUTE_FLAG_WRITABLE | ATTRIBUTE_FLAG_NONVOLATILE,
+                          esp_matter_int16(1600));
+    }
+    if (!attribute::get(cluster, Attributes::UnoccupiedCoolingSetpoint::Id)) {
+        attribute::create(cluster, Attributes::UnoccupiedCoolingSetpoint::Id, ATTRIBUTE_FLAG_WRITABLE | ATTRIBUTE_FLAG_NONVOLATILE,
+                          esp_matter_int16(2800));
+    }
+
+    SetDefaultDelegate(endpoint_id, &s_delegate);
+    occupancy_input_init();
+    return ESP_OK;
+}
@@ -0,0 +1,40 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+/** Presets the device can hold, built-in ones included */
+#define APP_PRESETS_MAX 6
+/** Longest preset name kept in NVS */
+#define APP_PRESET_NAME_LEN 16
+
+/** Initialize thermostat presets and occupancy
+ *
+ * Adds the Thermostat Presets feature with built-in Home, Away, Sleep and Eco presets,
+ * the Occupancy attribute and the Unoccupied setpoints, and registers the preset delegate.
+ * If an occupancy input pin is configured, it drives Occupancy: leaving switches to the
+ * Away preset, arriving switches back to Home. Call before esp_matter::start().
+ *
+ * @param[in] endpoint_id Thermostat endpoint.
+ * @param[in] cluster Thermostat cluster of the endpoint.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_presets_init(uint16_t endpoint_id, esp_matter::cluster_t *cluster);
+
+/** Report a change of occupancy
+ *
+ * Updates the Occupancy attribute and switches between the Home and Away presets.
+ * Safe to call from any task.
+ *
+ * @param[in] occupied New occupancy.
+ */
+void app_presets_set_occupancy(bool occupied);
+
+/** Current occupancy, as last reported */
+bool app_presets_is_occupied();
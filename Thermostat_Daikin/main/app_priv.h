@@ -11,6 +11,8 @@
 #include <esp_err.h>
 #include <esp_matter.h>
 
+#include "s21_driver.h"
+
 #if CHIP_DEVICE_CONFIG_ENABLE_THREAD
 #include "esp_openthread_types.h"
 #endif
@@ -56,7 +58,10 @@ esp_err_t app_driver_attribute_update(app_driver_handle_t driver_handle, uint16_
 
 /** Set defaults for thermostat driver
  *
- * Set the attribute drivers to their default values from the created data model (stub for now).
+ * Start reporting the unit's state to the thermostat endpoint. Until this is called, state
+ * changes from the driver are only held; the newest one, or the driver's current state if
+ * there was none, becomes the first value of the thermostat attributes. Call once the
+ * endpoint exists and Matter has started.
  *
  * @param[in] endpoint_id Endpoint ID of the driver.
  *
@@ -65,6 +70,97 @@ esp_err_t app_driver_attribute_update(app_driver_handle_t driver_handle, uint16_
  */
 esp_err_t app_driver_thermostat_set_defaults(uint16_t endpoint_id);
 
+/** Apply heating and/or cooling setpoints
+ *
+ * Updates the Occupied or Unoccupied setpoint attributes and queues one control write to the
+ * unit, using the setpoint that matches the unit's current mode. Must run on the CHIP thread.
+ *
+ * @param[in] heat Heating setpoint in 0.01 C, or NULL to leave it unchanged.
+ * @param[in] cool Cooling setpoint in 0.01 C, or NULL to leave it unchanged.
+ * @param[in] occupied Update the Occupied setpoints if true, the Unoccupied ones otherwise.
+ * @param[in] fan_speed FAIKIN_FAN_* to set in the same write, or -1 to leave it unchanged.
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t app_driver_apply_setpoints(const int16_t *heat, const int16_t *cool, bool occupied, int fan_speed);
+
+/** Queue a control write to the local unit
+ *
+ * Safe from any task; returns without waiting for the unit.
+ *
+ * @param[in] ctrl Fields to change.
+ *
+ * @return ESP_OK if queued.
+ * @return ESP_ERR_NO_MEM if the driver's command queue is full.
+ */
+esp_err_t app_driver_apply_control(const s21_control_t *ctrl);
+
+/** Queue a demand limit for the local unit, ahead of pending control writes
+ *
+ * Safe from any task; returns without waiting for the unit.
+ *
+ * @param[in] demand Limit and econo mode.
+ * @param[in] done Called on the driver task once the unit ACKs the limit, or with an error.
+ * @param[in] ctx Passed to done.
+ *
+ * @return ESP_OK if queued.
+ * @return ESP_ERR_INVALID_ARG if the limit is out of range.
+ * @return ESP_ERR_NO_MEM if the driver's command queue is full.
+ */
+esp_err_t app_driver_apply_demand(const s21_demand_t *demand, s21_cmd_done_cb_t done, void *ctx);
+
+/** Get the local unit's state, including queued changes. Safe from any task. */
+ac_state_t app_driver_get_state();
+
+/** Matter Thermostat SystemMode for a unit state (0 off, 1 auto, 3 cool, 4 heat) */
+uint8_t app_driver_system_mode(const ac_state_t *state);
+
+/** Build the control write for a Matter Thermostat SystemMode
+ *
+ * @param[in] system_mode SystemMode value.
+ * @param[out] ctrl Power and mode fields to apply.
+ *
+ * @return false if the unit has no equivalent of the mode.
+ */
+bool app_driver_system_mode_control(uint8_t system_mode, s21_control_t *ctrl);
+
+/** Check a unit capability
+ *
+ * Valid once app_driver_thermostat_init() has run capability discovery. Use it to decide which
+ * optional Matter attributes to create.
+ *
+ * @param[in] reg Register to check.
+ *
+ * @return true if the connected unit answers queries for the register.
+ */
+bool app_driver_has_register(s21_reg_t reg);
+
+/** Get S21 link quality
+ *
+ * Character errors, majority-vote disagreements, the tracked bit period and frame retries.
+ * Compare `retries` against `uart.bytes` over time to see the effect of timing calibration.
+ *
+ * @param[out] stats Snapshot of the link statistics.
+ *
+ * @return ESP_OK on success.
+ * @return ESP_ERR_INVALID_ARG if stats is NULL.
+ */
+esp_err_t app_driver_get_link_stats(s21_link_stats_t *stats);
+
+/** Get driver memory usage
+ *
+ * Returns the poll task stack high-water mark and the heap change observed across poll cycles.
+ * The heap figures are for the whole system, so other tasks move them too: a steady fall hints
+ * at a leak, but they cannot show that the poll task itself does not allocate. The host test
+ * test_alloc checks that by counting malloc calls across poll cycles.
+ *
+ * @param[out] stats Snapshot of the driver memory statistics.
+ *
+ * @return ESP_OK on success.
+ * @return ESP_ERR_INVALID_ARG if stats is NULL.
+ */
+esp_err_t app_driver_get_mem_stats(s21_mem_stats_t *stats);
+
 #if CHIP_DEVICE_CONFIG_ENABLE_THREAD
 #define ESP_OPENTHREAD_DEFAULT_RADIO_CONFIG()                                           \
     {                                                                                   \
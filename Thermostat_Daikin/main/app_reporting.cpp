@@ -0,0 +1,206 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdint.h>
+
+#include <esp_matter.h>
+#include <app/AttributePathParams.h>
+#include <app/InteractionModelEngine.h>
+#include <app/util/attribute-storage.h>
+#include <platform/CHIPDeviceLayer.h>
+
+#include "app_reporting.h"
+#include "report_windows.h"
+
+using namespace esp_matter;
+using chip::app::AttributePathParams;
+using chip::app::ConcreteAttributePath;
+using chip::app::ConcreteClusterPath;
+using chip::app::InteractionModelEngine;
+using chip::app::ReadHandler;
+
+static const char *TAG = "app_reporting";
+
+// All of this is only touched on the CHIP thread
+static ReportWindows s_windows(APP_REPORT_MIN_WINDOW_MS, APP_REPORT_MAX_WINDOW_MS);
+static app_reporting_stats_t s_stats;
+
+static bool handler_covers(ReadHandler *handler, const ConcreteAttributePath &path)
+{
+    for (auto *node = handler->GetAttributePathList(); node; node = node->mpNext) {
+        if (node->mValue.IsAttributePathSupersetOf(path)) return true;
+    }
+    return false;
+}
+
+static ReadHandler *find_subscription(uint32_t subscription_id)
+{
+    InteractionModelEngine *engine = InteractionModelEngine::GetInstance();
+    for (uint32_t i = 0; i < engine->GetNumActiveReadHandlers(); i++) {
+        ReadHandler *handler = engine->ActiveHandlerAt(i);
+        if (handler && handler->IsType(ReadHandler::InteractionType::Subscribe) &&
+            handler->GetSubscriptionId() == subscription_id) {
+            return handler;
+        }
+    }
+    return nullptr;
+}
+
+// A changed value needs a new data version at once, whether or not anyone is subscribed:
+// readers and subscribers with a data version filter would otherwise keep a stale cache
+static void bump_data_version(uint16_t endpoint_id, uint32_t cluster_id)
+{
+    chip::DataVersion *version = emberAfDataVersionStorage(ConcreteClusterPath(endpoint_id, cluster_id));
+    if (version) (*version)++;
+}
+
+// Report the paths of one closed window that its subscription still covers. The subscription
+// may have ended or changed its paths since they were queued.
+static void report_window(uint32_t subscription_id, const report_path_t *paths, int count)
+{
+    s_stats.windows++;
+    ReadHandler *handler = find_subscription(subscription_id);
+    for (int i = 0; i < count; i++) {
+        const report_path_t &p = paths[i];
+        if (!handler || !handler_covers(handler, ConcreteAttributePath(p.endpoint_id, p.cluster_id, p.attribute_id))) {
+            continue;
+        }
+        // Data versions were bumped when the values changed; this only wakes the subscriptions.
+        // Every subscription covering the path wakes, so it is no longer pending in any window.
+        InteractionModelEngine::GetInstance()->GetReportingEngine().SetDirty(
+            AttributePathParams(p.endpoint_id, p.cluster_id, p.attribute_id));
+        s_windows.Reported(p);
+        s_stats.reported++;
+    }
+}
+
+static void flush_windows(chip::System::Layer *layer, void *context);
+
+// Arm the timer for the next window to close
+static void arm_timer()
+{
+    chip::DeviceLayer::SystemLayer().CancelTimer(flush_windows, nullptr);
+    int64_t deadline = s_windows.NextDeadline();
+    if (deadline < 0) return;
+    int64_t delay_us = deadline - esp_timer_get_time();
+    uint32_t delay_ms = delay_us > 0 ? (uint32_t)((delay_us + 999) / 1000) : 0;
+    if (chip::DeviceLayer::SystemLayer().StartTimer(chip::System::Clock::Milliseconds32(delay_ms), flush_windows,
+                                                    nullptr) != CHIP_NO_ERROR) {
+        ESP_LOGW(TAG, "Failed to arm report windows, reporting now");
+        report_path_t paths[REPORT_MAX_PENDING];
+        uint32_t subscription_id;
+        int count;
+        while ((count = s_windows.TakeDue(INT64_MAX, &subscription_id, paths)) >= 0) {
+            report_window(subscription_id, paths, count);
+        }
+    }
+}
+
+static void flush_windows(chip::System::Layer *layer, void *context)
+{
+    report_path_t paths[REPORT_MAX_PENDING];
+    uint32_t subscription_id;
+    int count;
+    while ((count = s_windows.TakeDue(esp_timer_get_time(), &subscription_id, paths)) >= 0) {
+        report_window(subscription_id, paths, count);
+    }
+    arm_timer();
+}
+
+void app_reporting_mark_dirty(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id)
+{
+    s_stats.changes++;
+    bump_data_version(endpoint_id, cluster_id);
+
+    // Queue the change in the window of every subscription covering it, each window as long
+    // as its own subscription's min-interval
+    ConcreteAttributePath path(endpoint_id, cluster_id, attribute_id);
+    report_path_t pending = { endpoint_id, cluster_id, attribute_id };
+    InteractionModelEngine *engine = InteractionModelEngine::GetInstance();
+    int64_t now_us = esp_timer_get_time();
+    bool subscribed = false;
+    for (uint32_t i = 0; i < engine->GetNumActiveReadHandlers(); i++) {
+        ReadHandler *handler = engine->ActiveHandlerAt(i);
+        if (!handler || !handler->IsType(ReadHandler::InteractionType::Subscribe) || !handler_covers(handler, path)) {
+            continue;
+        }
+        subscribed = true;
+        uint16_t min_s, max_s;
+        handler->GetReportingIntervals(min_s, max_s);
+        uint32_t subscription_id = handler->GetSubscriptionId();
+        int result = s_windows.Add(subscription_id, min_s, pending, now_us);
+        if (result == REPORT_FULL) {
+            // Close this subscription's window early, or report now if no window is free
+            report_path_t paths[REPORT_MAX_PENDING];
+            int count = s_windows.Take(subscription_id, paths);
+            if (count) report_window(subscription_id, paths, count);
+            result = s_windows.Add(subscription_id, min_s, pending, now_us);
+            if (result == REPORT_FULL) report_window(subscription_id, &pending, 1);
+        }
+        if (result == REPORT_COALESCED) s_stats.coalesced++;
+    }
+    if (!subscribed) {
+        // Nothing to report; a later subscription picks the value up in its priming report
+        s_stats.skipped++;
+        return;
+    }
+    arm_timer();
+}
+
+static bool attr_val_equal(const esp_matter_attr_val_t &a, const esp_matter_attr_val_t &b)
+{
+    if (a.type != b.type) return false;
+    switch (a.type) {
+    case ESP_MATTER_VAL_TYPE_BOOLEAN:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_BOOLEAN:
+        return a.val.b == b.val.b;
+    case ESP_MATTER_VAL_TYPE_INT8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT8:
+        return a.val.i8 == b.val.i8;
+    case ESP_MATTER_VAL_TYPE_UINT8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT8:
+    case ESP_MATTER_VAL_TYPE_ENUM8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_ENUM8:
+    case ESP_MATTER_VAL_TYPE_BITMAP8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_BITMAP8:
+        return a.val.u8 == b.val.u8;
+    case ESP_MATTER_VAL_TYPE_INT16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT16:
+        return a.val.i16 == b.val.i16;
+    case ESP_MATTER_VAL_TYPE_UINT16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT16:
+    case ESP_MATTER_VAL_TYPE_BITMAP16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_BITMAP16:
+        return a.val.u16 == b.val.u16;
+    case ESP_MATTER_VAL_TYPE_UINT32:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT32:
+    case ESP_MATTER_VAL_TYPE_BITMAP32:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_BITMAP32:
+        return a.val.u32 == b.val.u32;
+    default:
+        return false;
+    }
+}
+
+esp_err_t app_reporting_update(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id,
+                               esp_matter_attr_val_t *val)
+{
+    attribute_t *attr = attribute::get(endpoint_id, cluster_id, attribute_id);
+    if (!attr) return ESP_ERR_NOT_FOUND;
+
+    esp_matter_attr_val_t current = esp_matter_invalid(NULL);
+    if (attribute::get_val(attr, &current) == ESP_OK && attr_val_equal(current, *val)) return ESP_OK;
+
+    esp_err_t err = attribute::set_val(attr, val);
+    if (err != ESP_OK) return err;
+    app_reporting_mark_dirty(endpoint_id, cluster_id, attribute_id);
+    return ESP_OK;
+}
+
+app_reporting_stats_t app_reporting_get_stats()
+{
+    return s_stats;
+}
@@ -0,0 +1,51 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+/** Shortest report window, for subscriptions with a min-interval of 0 */
+#define APP_REPORT_MIN_WINDOW_MS 200
+/** Longest time a change is held back, whatever the subscription min-interval */
+#define APP_REPORT_MAX_WINDOW_MS 5000
+
+/** Reporting counters, cumulative since boot */
+typedef struct {
+    uint32_t changes;   // Attribute changes seen
+    uint32_t coalesced; // Changes merged into one already pending for the same subscription
+    uint32_t reported;  // Changes handed to the reporting engine
+    uint32_t skipped;   // Changes nobody was subscribed to; only their data version moved
+    uint32_t windows;   // Report windows flushed
+} app_reporting_stats_t;
+
+/** Update an attribute and schedule its report
+ *
+ * Stores the value and bumps the cluster data version straight away, so reads always see it.
+ * The report is queued in the report window of each active subscription covering the
+ * attribute; a window lasts its subscription's min-interval, and closes with every change
+ * pending in it. A subscription that has ended or dropped the attribute by then gets nothing.
+ * Must run on the CHIP thread.
+ *
+ * @param[in] endpoint_id Endpoint ID of the attribute.
+ * @param[in] cluster_id Cluster ID of the attribute.
+ * @param[in] attribute_id Attribute ID of the attribute.
+ * @param[in] val New value.
+ *
+ * @return ESP_OK on success (including when the value did not change).
+ * @return ESP_ERR_NOT_FOUND if the attribute does not exist.
+ */
+esp_err_t app_reporting_update(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id,
+                               esp_matter_attr_val_t *val);
+
+/** Schedule a report for an attribute whose value is served elsewhere
+ *
+ * For attributes backed by an AttributeAccessInterface. Bumps the cluster data version at
+ * once, like app_reporting_update(). Must run on the CHIP thread.
+ */
+void app_reporting_mark_dirty(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id);
+
+/** Get reporting counters */
+app_reporting_stats_t app_reporting_get_stats();
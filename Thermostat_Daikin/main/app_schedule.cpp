@@ -0,0 +1,300 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include <esp_matter.h>
+#include <app/CommandHandler.h>
+#include <app/data-model/Decode.h>
+#include <platform/CHIPDeviceLayer.h>
+
+#include <app_priv.h>
+#include "app_presets.h"
+#include "app_schedule.h"
+#include "thermostat_schedule.h"
+
+using namespace esp_matter;
+using namespace chip::app::Clusters;
+using chip::app::CommandHandler;
+using chip::app::ConcreteCommandPath;
+using chip::Protocols::InteractionModel::Status;
+
+static const char *TAG = "app_schedule";
+
+#define SCHEDULE_NVS_NAMESPACE "sched"
+#define SCHEDULE_NVS_KEY       "weekly"
+// Wall clock before this is treated as "not set yet" (2020-01-01)
+#define SCHEDULE_MIN_VALID_TIME 1577836800
+// How often to look again while the wall clock is not set
+#define SCHEDULE_CLOCK_RETRY_S 60
+
+// Away bit of ScheduleDayOfWeekBitmap; there is no away schedule, so it is ignored
+#define SCHEDULE_DAYS_MASK 0x7F
+
+static ThermostatSchedule s_schedule;
+static esp_timer_handle_t s_timer = NULL;
+
+// Schedule before the edit in progress, put back if the edit cannot be stored
+static schedule_storage_t s_undo;
+
+static esp_err_t schedule_save()
+{
+    static schedule_storage_t storage;
+    s_schedule.Save(&storage);
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SCHEDULE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(handle, SCHEDULE_NVS_KEY, &storage,
+                       offsetof(schedule_storage_t, transitions) + storage.count * sizeof(schedule_transition_t));
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+static void schedule_load()
+{
+    static schedule_storage_t storage;
+    memset(&storage, 0, sizeof(storage));
+    nvs_handle_t handle;
+    if (nvs_open(SCHEDULE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    size_t len = sizeof(storage);
+    esp_err_t err = nvs_get_blob(handle, SCHEDULE_NVS_KEY, &storage, &len);
+    nvs_close(handle);
+    if (err == ESP_OK && s_schedule.Load(&storage)) {
+        ESP_LOGI(TAG, "Loaded %d schedule transitions", s_schedule.Count());
+    }
+}
+
+// Current local time as minute of the week, and seconds into that minute
+static bool schedule_now(uint16_t *minute_of_week, uint32_t *second)
+{
+    time_t now = time(NULL);
+    if (now < SCHEDULE_MIN_VALID_TIME) return false;
+    struct tm local;
+    localtime_r(&now, &local);
+    *minute_of_week = local.tm_wday * SCHEDULE_MINUTES_PER_DAY + local.tm_hour * 60 + local.tm_min;
+    *second = local.tm_sec;
+    return true;
+}
+
+static void schedule_apply(const schedule_transition_t *t)
+{
+    int16_t heat = schedule_decode_setpoint(t->heat_half);
+    int16_t cool = schedule_decode_setpoint(t->cool_half);
+    ESP_LOGI(TAG, "Applying transition at minute %u", schedule_minute(t));
+    // The transition sets whichever pair of setpoints is in effect now
+    app_driver_apply_setpoints((t->when & SCHEDULE_HAS_HEAT) ? &heat : NULL,
+                               (t->when & SCHEDULE_HAS_COOL) ? &cool : NULL, app_presets_is_occupied(), -1);
+}
+
+static void schedule_arm(uint64_t delay_s)
+{
+    esp_timer_stop(s_timer);
+    esp_timer_start_once(s_timer, delay_s * 1000000ULL);
+}
+
+// Re-position on the schedule, apply whatever should be in effect now and arm the timer
+void app_schedule_resync()
+{
+    uint16_t now;
+    uint32_t second;
+    if (!schedule_now(&now, &second)) {
+        schedule_arm(SCHEDULE_CLOCK_RETRY_S);
+        return;
+    }
+    esp_timer_stop(s_timer);
+    if (s_schedule.Count() == 0) return;
+
+    s_schedule.Seek(now);
+    schedule_apply(s_schedule.Current());
+    schedule_arm((uint64_t)s_schedule.MinutesUntilNext(now) * 60 - second);
+}
+
+// Runs on the CHIP thread when the timer fires
+static void schedule_fire(intptr_t context)
+{
+    uint16_t now;
+    uint32_t second;
+    const schedule_transition_t *next = s_schedule.Next();
+    if (!next || !schedule_now(&now, &second) || schedule_minute(next) != now) {
+        // Clock not set yet, or it moved under us: find our place again
+        app_schedule_resync();
+        return;
+    }
+    schedule_apply(next);
+    s_schedule.Advance();
+    schedule_arm((uint64_t)s_schedule.MinutesUntilNext(now) * 60 - second);
+}
+
+static void schedule_timer_cb(void *arg)
+{
+    chip::DeviceLayer::PlatformMgr().ScheduleWork(schedule_fire, 0);
+}
+
+// Store an edit and run it. An edit that cannot be stored would be gone after the next
+// reboot, so it is undone and the command fails.
+static Status schedule_commit()
+{
+    esp_err_t err = schedule_save();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store the schedule, err:%d", err);
+        s_schedule.Load(&s_undo);
+    }
+    app_schedule_resync();
+    return err == ESP_OK ? Status::Success : Status::Failure;
+}
+
+static esp_err_t set_weekly_schedule_cb(const ConcreteCommandPath &command_path, chip::TLV::TLVReader &tlv_data,
+                                        void *opaque_ptr)
+{
+    CommandHandler *handler = (CommandHandler *)opaque_ptr;
+    Thermostat::Commands::SetWeeklySchedule::DecodableType req;
+    if (chip::app::DataModel::Decode(tlv_data, req) != CHIP_NO_ERROR) {
+        handler->AddStatus(command_path, Status::InvalidCommand);
+        return ESP_OK;
+    }
+
+    schedule_transition_t day[SCHEDULE_MAX_DAILY];
+    int count = 0;
+    bool want_heat = req.modeForSequence.Has(Thermostat::ScheduleModeBitmap::kHeatSetpointPresent);
+    bool want_cool = req.modeForSequence.Has(Thermostat::ScheduleModeBitmap::kCoolSetpointPresent);
+    auto it = req.transitions.begin();
+    while (it.Next()) {
+        const auto &t = it.GetValue();
+        if (t.transitionTime >= SCHEDULE_MINUTES_PER_DAY) {
+            handler->AddStatus(command_path, Status::ConstraintError);
+            return ESP_OK;
+        }
+        if (count == SCHEDULE_MAX_DAILY) {
+            handler->AddStatus(command_path, Status::ResourceExhausted);
+            return ESP_OK;
+        }
+        schedule_transition_t &out = day[count++];
+        out.when = t.transitionTime;
+        out.heat_half = out.cool_half = 0;
+        if (want_heat && !t.heatSetpoint.IsNull()) {
+            out.when |= SCHEDULE_HAS_HEAT;
+            out.heat_half = schedule_encode_setpoint(t.heatSetpoint.Value());
+        }
+        if (want_cool && !t.coolSetpoint.IsNull()) {
+            out.when |= SCHEDULE_HAS_COOL;
+            out.cool_half = schedule_encode_setpoint(t.coolSetpoint.Value());
+        }
+    }
+    if (it.GetStatus() != CHIP_NO_ERROR || count != req.numberOfTransitionsForSequence) {
+        handler->AddStatus(command_path, Status::InvalidCommand);
+        return ESP_OK;
+    }
+
+    s_schedule.Save(&s_undo);
+    if (!s_schedule.SetDays(req.dayOfWeekForSequence.Raw() & SCHEDULE_DAYS_MASK, day, count)) {
+        handler->AddStatus(command_path, Status::ResourceExhausted);
+        return ESP_OK;
+    }
+    handler->AddStatus(command_path, schedule_commit());
+    return ESP_OK;
+}
+
+static esp_err_t get_weekly_schedule_cb(const ConcreteCommandPath &command_path, chip::TLV::TLVReader &tlv_data,
+                                        void *opaque_ptr)
+{
+    CommandHandler *handler = (CommandHandler *)opaque_ptr;
+    Thermostat::Commands::GetWeeklySchedule::DecodableType req;
+    if (chip::app::DataModel::Decode(tlv_data, req) != CHIP_NO_ERROR) {
+        handler->AddStatus(command_path, Status::InvalidCommand);
+        return ESP_OK;
+    }
+
+    // One response carries one day: return the first requested one
+    uint8_t days = req.daysToReturn.Raw() & SCHEDULE_DAYS_MASK;
+    int weekday = 0;
+    while (weekday < 7 && !(days & (1 << weekday))) weekday++;
+    if (weekday == 7) {
+        handler->AddStatus(command_path, Status::InvalidCommand);
+        return ESP_OK;
+    }
+
+    schedule_transition_t day[SCHEDULE_MAX_DAILY];
+    Thermostat::Structs::WeeklyScheduleTransitionStruct::Type transitions[SCHEDULE_MAX_DAILY];
+    int count = s_schedule.GetDay(weekday, day, SCHEDULE_MAX_DAILY);
+    uint8_t mode = 0;
+    for (int i = 0; i < count; i++) {
+        transitions[i].transitionTime = schedule_minute(&day[i]);
+        if (day[i].when & SCHEDULE_HAS_HEAT) {
+            transitions[i].heatSetpoint.SetNonNull(schedule_decode_setpoint(day[i].heat_half));
+            mode |= (uint8_t)Thermostat::ScheduleModeBitmap::kHeatSetpointPresent;
+        }
+        if (day[i].when & SCHEDULE_HAS_COOL) {
+            transitions[i].coolSetpoint.SetNonNull(schedule_decode_setpoint(day[i].cool_half));
+            mode |= (uint8_t)Thermostat::ScheduleModeBitmap::kCoolSetpointPresent;
+        }
+    }
+
+    Thermostat::Commands::GetWeeklyScheduleResponse::Type resp;
+    resp.numberOfTransitionsForSequence = (uint8_t)count;
+    resp.dayOfWeekForSequence = chip::BitMask<Thermostat::ScheduleDayOfWeekBitmap>((uint8_t)(1 << weekday));
+    resp.modeForSequence = chip::BitMask<Thermostat::ScheduleModeBitmap>(mode);
+    resp.transitions = chip::app::DataModel::List<const Thermostat::Structs::WeeklyScheduleTransitionStruct::Type>(
+        transitions, count);
+    handler->AddResponse(command_path, resp);
+    return ESP_OK;
+}
+
+static esp_err_t clear_weekly_schedule_cb(const ConcreteCommandPath &command_path, chip::TLV::TLVReader &tlv_data,
+                                          void *opaque_ptr)
+{
+    CommandHandler *handler = (CommandHandler *)opaque_ptr;
+    s_schedule.Save(&s_undo);
+    s_schedule.Clear();
+    handler->AddStatus(command_path, schedule_commit());
+    return ESP_OK;
+}
+
+esp_err_t app_schedule_init(cluster_t *cluster)
+{
+    if (!cluster) return ESP_ERR_INVALID_ARG;
+
+    // Advertise ScheduleConfiguration on top of whatever the cluster already has
+    attribute_t *feature_map = attribute::get(cluster, Globals::Attributes::FeatureMap::Id);
+    if (feature_map) {
+        esp_matter_attr_val_t val = esp_matter_invalid(NULL);
+        attribute::get_val(feature_map, &val);
+        val.val.u32 |= (uint32_t)Thermostat::Feature::kScheduleConfiguration;
+        attribute::set_val(feature_map, &val);
+    }
+
+    if (!attribute::get(cluster, Thermostat::Attributes::StartOfWeek::Id)) {
+        attribute::create(cluster, Thermostat::Attributes::StartOfWeek::Id, ATTRIBUTE_FLAG_NONE, esp_matter_enum8(0));
+    }
+    if (!attribute::get(cluster, Thermostat::Attributes::NumberOfWeeklyTransitions::Id)) {
+        attribute::create(cluster, Thermostat::Attributes::NumberOfWeeklyTransitions::Id, ATTRIBUTE_FLAG_NONE,
+                          esp_matter_uint8(SCHEDULE_MAX_TRANSITIONS));
+    }
+    if (!attribute::get(cluster, Thermostat::Attributes::NumberOfDailyTransitions::Id)) {
+        attribute::create(cluster, Thermostat::Attributes::NumberOfDailyTransitions::Id, ATTRIBUTE_FLAG_NONE,
+                          esp_matter_uint8(SCHEDULE_MAX_DAILY));
+    }
+
+    command::create(cluster, Thermostat::Commands::SetWeeklySchedule::Id, COMMAND_FLAG_ACCEPTED, set_weekly_schedule_cb);
+    command::create(cluster, Thermostat::Commands::GetWeeklySchedule::Id, COMMAND_FLAG_ACCEPTED, get_weekly_schedule_cb);
+    command::create(cluster, Thermostat::Commands::ClearWeeklySchedule::Id, COMMAND_FLAG_ACCEPTED, clear_weekly_schedule_cb);
+    command::create(cluster, Thermostat::Commands::GetWeeklyScheduleResponse::Id, COMMAND_FLAG_GENERATED, NULL);
+
+    schedule_load();
+
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = schedule_timer_cb;
+    timer_args.name = "schedule";
+    esp_err_t err = esp_timer_create(&timer_args, &s_timer);
+    if (err != ESP_OK) return err;
+
+    // The first evaluation needs the CHIP stack; the clock is probably not set yet anyway
+    schedule_arm(SCHEDULE_CLOCK_RETRY_S);
+    return ESP_OK;
+}
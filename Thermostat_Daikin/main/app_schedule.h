@@ -0,0 +1,30 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+/** Initialize the on-device weekly schedule
+ *
+ * Adds the Thermostat ScheduleConfiguration feature (SetWeeklySchedule, GetWeeklySchedule,
+ * ClearWeeklySchedule and their attributes) to the cluster, loads the stored schedule from
+ * NVS and arms the transition timer. Call before esp_matter::start().
+ *
+ * Transitions are evaluated against the local wall clock, so nothing fires until the
+ * system time has been set (e.g. by Matter Time Synchronization or SNTP).
+ *
+ * @param[in] cluster Thermostat cluster of the thermostat endpoint.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_schedule_init(esp_matter::cluster_t *cluster);
+
+/** Re-evaluate the schedule against the current time
+ *
+ * Call after the wall clock has been stepped. Must run on the CHIP thread.
+ */
+void app_schedule_resync();
@@ -0,0 +1,270 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_matter_console.h>
+
+#include "app_stats.h"
+#include "s21_stats.h"
+
+static const char *TAG = "app_stats";
+
+#define STATS_PARTITION_LABEL "s21stats"
+#define STATS_MAGIC 0x53323153 // "S21S"
+// The wall clock counts as set from 2024-01-01 on
+#define STATS_CLOCK_VALID_AFTER 1704067200
+
+// One log record per bucket. Records never straddle a sector; the tail of each sector is unused.
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;              // One more than the previous record; the highest is the newest
+    uint32_t unix_hour;        // Wall clock hour the bucket ended in, 0 if the clock was not set
+    s21_stats_bucket_t bucket;
+    uint32_t reserved;
+    s21_stats_totals_t totals; // Totals including this bucket, restored at boot
+    uint32_t crc;              // esp_rom_crc32_le() of everything above
+} stats_record_t;
+
+static_assert(sizeof(stats_record_t) == 80, "record layout is stored in flash");
+
+// Log position, guarded by s_log_mutex since appends run on the poll task and dumps on the console
+static const esp_partition_t *s_part = nullptr;
+static SemaphoreHandle_t s_log_mutex = nullptr;
+static StaticSemaphore_t s_log_mutex_buf;
+static uint32_t s_sectors;
+static uint32_t s_per_sector;
+static uint32_t s_head_sector;     // Sector the next record goes to
+static uint32_t s_head_slot;       // Slot in that sector; 0 means the sector is erased first
+static uint32_t s_next_seq;
+
+static size_t record_offset(uint32_t sector, uint32_t slot)
+{
+    return (size_t)sector * s_part->erase_size + (size_t)slot * sizeof(stats_record_t);
+}
+
+static uint32_t record_crc(const stats_record_t *rec)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)rec, offsetof(stats_record_t, crc));
+}
+
+static bool record_read(uint32_t sector, uint32_t slot, stats_record_t *rec)
+{
+    if (esp_partition_read(s_part, record_offset(sector, slot), rec, sizeof(*rec)) != ESP_OK) return false;
+    return rec->magic == STATS_MAGIC && rec->crc == record_crc(rec);
+}
+
+static bool slot_blank(uint32_t sector, uint32_t slot)
+{
+    uint32_t words[sizeof(stats_record_t) / 4];
+    if (esp_partition_read(s_part, record_offset(sector, slot), words, sizeof(words)) != ESP_OK) return false;
+    for (size_t i = 0; i < sizeof(words) / 4; i++) {
+        if (words[i] != UINT32_MAX) return false;
+    }
+    return true;
+}
+
+// Find the newest record; the next one goes after it
+static bool log_scan(stats_record_t *newest)
+{
+    bool found = false;
+    uint32_t newest_sector = 0, newest_slot = 0;
+    stats_record_t rec;
+    for (uint32_t sector = 0; sector < s_sectors; sector++) {
+        for (uint32_t slot = 0; slot < s_per_sector; slot++) {
+            if (!record_read(sector, slot, &rec)) continue;
+            if (!found || (int32_t)(rec.seq - newest->seq) > 0) {
+                *newest = rec;
+                newest_sector = sector;
+                newest_slot = slot;
+                found = true;
+            }
+        }
+    }
+    s_head_sector = 0;
+    s_head_slot = 0;
+    s_next_seq = 1;
+    if (!found) return false;
+
+    s_next_seq = newest->seq + 1;
+    s_head_sector = newest_sector;
+    s_head_slot = newest_slot + 1;
+    // A write cut short by a reset leaves the slot dirty; continue in a fresh sector then
+    if (s_head_slot == s_per_sector || !slot_blank(s_head_sector, s_head_slot)) {
+        s_head_sector = (s_head_sector + 1) % s_sectors;
+        s_head_slot = 0;
+    }
+    return true;
+}
+
+static esp_err_t log_append(stats_record_t *rec)
+{
+    if (s_head_slot == 0) {
+        esp_err_t err = esp_partition_erase_range(s_part, record_offset(s_head_sector, 0), s_part->erase_size);
+        if (err != ESP_OK) return err;
+    }
+    rec->magic = STATS_MAGIC;
+    rec->seq = s_next_seq;
+    rec->crc = record_crc(rec);
+    esp_err_t err = esp_partition_write(s_part, record_offset(s_head_sector, s_head_slot), rec, sizeof(*rec));
+    if (err != ESP_OK) return err;
+    s_next_seq++;
+    if (++s_head_slot == s_per_sector) {
+        s_head_sector = (s_head_sector + 1) % s_sectors;
+        s_head_slot = 0;
+    }
+    return ESP_OK;
+}
+
+// Runs on the S21 poll task once an hour. A sector erase holds up polling for a few tens of
+// milliseconds once every s_per_sector hours.
+static void stats_on_rollup(const s21_stats_bucket_t *bucket, const s21_stats_totals_t *totals)
+{
+    if (!s_part) return;
+    stats_record_t rec = {};
+    time_t now = time(nullptr);
+    rec.unix_hour = now >= STATS_CLOCK_VALID_AFTER ? (uint32_t)(now / 3600) : 0;
+    rec.bucket = *bucket;
+    rec.totals = *totals;
+    xSemaphoreTake(s_log_mutex, portMAX_DELAY);
+    esp_err_t err = log_append(&rec);
+    xSemaphoreGive(s_log_mutex);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to log statistics: %d", err);
+}
+
+esp_err_t app_stats_init()
+{
+    s_log_mutex = xSemaphoreCreateMutexStatic(&s_log_mutex_buf);
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, STATS_PARTITION_LABEL);
+    if (!s_part) {
+        ESP_LOGW(TAG, "No %s partition, statistics are not saved", STATS_PARTITION_LABEL);
+        s21_stats_init(nullptr, stats_on_rollup);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_sectors = s_part->size / s_part->erase_size;
+    s_per_sector = s_part->erase_size / sizeof(stats_record_t);
+
+    stats_record_t newest;
+    if (log_scan(&newest)) {
+        s21_stats_init(&newest.totals, stats_on_rollup);
+        ESP_LOGI(TAG, "Restored %lu hours of statistics, log at record %lu", (unsigned long)newest.totals.buckets,
+                 (unsigned long)newest.seq);
+    } else {
+        s21_stats_init(nullptr, stats_on_rollup);
+        ESP_LOGI(TAG, "Statistics log is empty, %lu hours fit", (unsigned long)((s_sectors - 1) * s_per_sector));
+    }
+    return ESP_OK;
+}
+
+#if CONFIG_ENABLE_CHIP_SHELL
+
+static uint32_t on_seconds(const uint32_t *mode_s)
+{
+    uint32_t on_s = 0;
+    for (int i = 0; i < S21_STATS_MODE_COUNT; i++) on_s += mode_s[i];
+    return on_s;
+}
+
+// Column order of the dump; keep it in step with print_bucket()
+static void print_header()
+{
+    printf("S21S seq,hour,cool_s,heat_s,auto_s,dry_s,fan_s,off_s,active_s,setpoints,power_ons,room,target,outside\n");
+}
+
+static void print_bucket(uint32_t seq, uint32_t hour, const s21_stats_bucket_t *b)
+{
+    printf("S21S %lu,%lu", (unsigned long)seq, (unsigned long)hour);
+    for (int i = 0; i < S21_STATS_MODE_COUNT; i++) printf(",%u", b->mode_s[i]);
+    printf(",%u,%u,%u,%u,%d,%d,%d\n", b->off_s, b->active_s, b->setpoint_changes, b->power_ons, b->room_avg,
+           b->target_avg, b->outside_avg);
+}
+
+static void print_totals(const s21_stats_totals_t *t)
+{
+    uint32_t on_s = on_seconds(t->mode_s);
+    printf("S21S total hours=%lu cool_s=%lu heat_s=%lu auto_s=%lu dry_s=%lu fan_s=%lu active_s=%lu duty=%u.%u%% "
+           "setpoints=%lu power_ons=%lu\n",
+           (unsigned long)t->buckets, (unsigned long)t->mode_s[S21_STATS_MODE_COOL],
+           (unsigned long)t->mode_s[S21_STATS_MODE_HEAT], (unsigned long)t->mode_s[S21_STATS_MODE_AUTO],
+           (unsigned long)t->mode_s[S21_STATS_MODE_DRY], (unsigned long)t->mode_s[S21_STATS_MODE_FAN],
+           (unsigned long)t->active_s, s21_stats_duty_permille(t->active_s, on_s) / 10,
+           s21_stats_duty_permille(t->active_s, on_s) % 10, (unsigned long)t->setpoint_changes,
+           (unsigned long)t->power_ons);
+}
+
+// Oldest first: the sector after the head is the next to be erased, so it holds the oldest records
+static void dump_log()
+{
+    print_header();
+    if (!s_part) return;
+    stats_record_t rec;
+    xSemaphoreTake(s_log_mutex, portMAX_DELAY);
+    for (uint32_t i = 1; i <= s_sectors; i++) {
+        uint32_t sector = (s_head_sector + i) % s_sectors;
+        for (uint32_t slot = 0; slot < s_per_sector; slot++) {
+            if (record_read(sector, slot, &rec)) print_bucket(rec.seq, rec.unix_hour, &rec.bucket);
+        }
+    }
+    xSemaphoreGive(s_log_mutex);
+}
+
+static esp_err_t s21stats_handler(int argc, char **argv)
+{
+    const char *cmd = argc == 1 ? argv[0] : "dump";
+    if (argc > 1) cmd = "";
+
+    s21_stats_bucket_t current;
+    uint32_t current_s;
+    s21_stats_totals_t totals;
+    if (strcmp(cmd, "dump") == 0) {
+        dump_log();
+        s21_stats_get(&current, &current_s, &totals);
+        print_totals(&totals);
+    } else if (strcmp(cmd, "now") == 0) {
+        s21_stats_get(&current, &current_s, &totals);
+        printf("S21S current elapsed_s=%lu\n", (unsigned long)current_s);
+        print_header();
+        print_bucket(s_next_seq, 0, &current);
+        print_totals(&totals);
+    } else if (strcmp(cmd, "clear") == 0) {
+        if (s_part) {
+            xSemaphoreTake(s_log_mutex, portMAX_DELAY);
+            esp_partition_erase_range(s_part, 0, s_part->size);
+            s_head_sector = 0;
+            s_head_slot = 0;
+            s_next_seq = 1;
+            xSemaphoreGive(s_log_mutex);
+        }
+        s21_stats_init(nullptr, stats_on_rollup);
+    } else {
+        printf("usage: s21stats [dump|now|clear]\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_stats_register_commands()
+{
+    static const esp_matter::console::command_t command = {
+        .name = "s21stats",
+        .description = "S21 runtime statistics. Usage: matter esp s21stats [dump|now|clear]",
+        .handler = s21stats_handler,
+    };
+    esp_err_t err = esp_matter::console::add_commands(&command, 1);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to add s21stats command: %d", err);
+    return err;
+}
+#else
+esp_err_t app_stats_register_commands()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif // CONFIG_ENABLE_CHIP_SHELL
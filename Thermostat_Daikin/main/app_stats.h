@@ -0,0 +1,31 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+
+/** Start runtime statistics
+ *
+ * Opens the "s21stats" flash partition, restores the totals from the newest record and starts
+ * the S21 statistics engine (s21_stats.h). Each hourly bucket is then appended to the
+ * partition, which is written as a circular log one sector at a time, so the oldest hours are
+ * dropped a sector at a time once it is full. Call before app_driver_thermostat_init().
+ *
+ * @return ESP_OK on success.
+ * @return ESP_ERR_NOT_FOUND if the partition table has no "s21stats" partition; statistics
+ *         are then still gathered but not saved.
+ */
+esp_err_t app_stats_init();
+
+/** Register the runtime statistics shell commands
+ *
+ * Adds "matter esp s21stats [dump|now|clear]". dump prints the logged hourly buckets, oldest
+ * first, as comma separated lines; now prints the bucket in progress and the totals; clear
+ * erases the log and the totals. Call before esp_matter::console::init().
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_stats_register_commands();
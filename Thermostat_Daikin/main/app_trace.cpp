@@ -0,0 +1,113 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_matter_console.h>
+
+#include "app_trace.h"
+#include "s21_sim.h"
+#include "s21_trace.h"
+
+static const char *TAG = "app_trace";
+
+#if CONFIG_ENABLE_CHIP_SHELL
+
+// Line format parsed by tools/s21_trace_timeline.py; keep the two in step
+static void print_span(const s21_trace_span_t *span)
+{
+    printf("S21T id=%u tag=0x%08lx t0=%lld", span->id, (unsigned long)span->tag, (long long)span->start_us);
+    for (int i = 0; i < S21_TRACE_STAGE_COUNT; i++) {
+        const char *name = s21_trace_stage_name((s21_trace_stage_t)i);
+        if (span->stage_us[i] == S21_TRACE_NONE) printf(" %s=-", name);
+        else printf(" %s=%lu", name, (unsigned long)span->stage_us[i]);
+    }
+    if (span->done) printf(" res=0x%x\n", span->result);
+    else printf(" res=open\n");
+}
+
+static void print_latency(s21_trace_stage_t stage)
+{
+    s21_trace_latency_t lat;
+    if (!s21_trace_latency(stage, &lat)) return;
+    printf("S21T lat stage=%s n=%lu p50=%lu p99=%lu max=%lu\n", s21_trace_stage_name(stage), (unsigned long)lat.count,
+           (unsigned long)lat.p50_us, (unsigned long)lat.p99_us, (unsigned long)lat.max_us);
+}
+
+static esp_err_t s21trace_handler(int argc, char **argv)
+{
+    if (argc == 1 && strcmp(argv[0], "clear") == 0) {
+        s21_trace_clear();
+        return ESP_OK;
+    }
+    if (argc == 1 && strcmp(argv[0], "stats") == 0) {
+        print_latency(S21_TRACE_ACK);
+        print_latency(S21_TRACE_CONFIRM);
+        return ESP_OK;
+    }
+    if (argc > 1 || (argc == 1 && strcmp(argv[0], "dump") != 0)) {
+        printf("usage: s21trace [dump|stats|clear]\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    s21_trace_span_t span;
+    int count = 0;
+    for (size_t i = 0; s21_trace_get(i, &span); i++) {
+        if (span.id == 0) continue;
+        print_span(&span);
+        count++;
+    }
+    printf("S21T spans=%d\n", count);
+    return ESP_OK;
+}
+
+#if CONFIG_S21_TRANSPORT_SIM
+static esp_err_t s21sim_handler(int argc, char **argv)
+{
+    if (argc == 1) {
+        s21_sim_faults_t faults;
+        if (!s21_sim_profile(argv[0], &faults)) {
+            printf("profiles: clean lost-ack truncated checksum every-other brownout mixed\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        s21_sim_set_faults(&faults);
+        // Latency figures from here on are for the new profile
+        s21_trace_clear();
+        return ESP_OK;
+    }
+    s21_sim_stats_t st = s21_sim_get_stats();
+    printf("S21SIM queries=%lu bad=%lu dropped=%lu truncated=%lu checksum=%lu skipped=%lu outages=%lu boot_naks=%lu "
+           "writes=%lu\n", (unsigned long)st.queries, (unsigned long)st.bad_queries, (unsigned long)st.dropped,
+           (unsigned long)st.truncated, (unsigned long)st.bad_checksums, (unsigned long)st.skipped,
+           (unsigned long)st.outages, (unsigned long)st.boot_naks, (unsigned long)st.writes);
+    return ESP_OK;
+}
+#endif // CONFIG_S21_TRANSPORT_SIM
+
+esp_err_t app_trace_register_commands()
+{
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "s21trace",
+            .description = "S21 command latency trace. Usage: matter esp s21trace [dump|stats|clear]",
+            .handler = s21trace_handler,
+        },
+#if CONFIG_S21_TRANSPORT_SIM
+        {
+            .name = "s21sim",
+            .description = "Simulated S21 unit faults. Usage: matter esp s21sim [profile]",
+            .handler = s21sim_handler,
+        },
+#endif
+    };
+    esp_err_t err = esp_matter::console::add_commands(commands, sizeof(commands) / sizeof(commands[0]));
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to add s21trace commands: %d", err);
+    return err;
+}
+#else
+esp_err_t app_trace_register_commands()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif // CONFIG_ENABLE_CHIP_SHELL
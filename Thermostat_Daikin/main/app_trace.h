@@ -0,0 +1,24 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <esp_err.h>
+
+/** Register the command latency trace shell commands
+ *
+ * Adds "matter esp s21trace [dump|stats|clear]". dump prints one line per span from the S21
+ * trace buffer (s21_trace.h), oldest first, with each stage as an offset in microseconds from
+ * the attribute PRE_UPDATE. tools/s21_trace_timeline.py turns a captured dump into a timeline.
+ * stats prints p50/p99 latency to the unit's ACK and to the confirming status read, over all
+ * commands since the last clear.
+ *
+ * With CONFIG_S21_TRANSPORT_SIM it also adds "matter esp s21sim [profile]", which switches the
+ * simulated unit to a fault profile from s21_sim.h, or prints what it has injected so far.
+ * Call before esp_matter::console::init().
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t app_trace_register_commands();
@@ -0,0 +1,77 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#pragma once
+
+#include <sdkconfig.h>
+#include <soc/soc_caps.h>
+
+#include "s21_port.h"
+
+// Board wiring and S21 link settings, chosen at build time with the
+// "Daikin S21 Board" menu in menuconfig
+typedef struct {
+    const char *name;
+    int s21_tx_pin;
+    int s21_rx_pin;
+    int button_pin;            // Opens the commissioning window, active low
+    int occupancy_pin;         // Occupancy sensor contact, -1 when there is none
+    s21_transport_t transport; // Transport the board ships with
+    uint32_t poll_interval_ms; // Idle time between poll cycles
+} board_profile_t;
+
+typedef enum {
+    BOARD_DAIKIN_C6_PCB = 0,
+    BOARD_DEVKIT,
+    BOARD_CUSTOM,
+} board_id_t;
+
+#if CONFIG_S21_BOARD_CUSTOM
+#define BOARD_CUSTOM_PINS CONFIG_S21_CUSTOM_TX_PIN, CONFIG_S21_CUSTOM_RX_PIN, \
+                          CONFIG_S21_CUSTOM_BUTTON_PIN, CONFIG_S21_CUSTOM_OCCUPANCY_PIN
+#else
+#define BOARD_CUSTOM_PINS -1, -1, -1, -1
+#endif
+
+// Indexed by board_id_t. The Daikin PCB has always run bit-banged, which also follows the
+// drifting baud rate of older units; its UART is there to pick in menuconfig.
+static constexpr board_profile_t s_board_profiles[] = {
+    { "daikin-c6-pcb", 21, 20, 23, -1, S21_TRANSPORT_BITBANG, 2000 },
+    { "devkit",        4,  5,  9,  -1, S21_TRANSPORT_UART, 2000 },
+    { "custom",        BOARD_CUSTOM_PINS, S21_TRANSPORT_UART, 2000 },
+};
+
+#if CONFIG_S21_BOARD_DAIKIN_C6_PCB
+static constexpr board_id_t s_board_id = BOARD_DAIKIN_C6_PCB;
+#elif CONFIG_S21_BOARD_CUSTOM
+static constexpr board_id_t s_board_id = BOARD_CUSTOM;
+#else
+static constexpr board_id_t s_board_id = BOARD_DEVKIT;
+#endif
+
+static constexpr const board_profile_t &s_board = s_board_profiles[s_board_id];
+
+static_assert(s_board.s21_tx_pin >= 0 && s_board.s21_tx_pin < SOC_GPIO_PIN_COUNT, "S21 TX pin not on this chip");
+static_assert(s_board.s21_rx_pin >= 0 && s_board.s21_rx_pin < SOC_GPIO_PIN_COUNT, "S21 RX pin not on this chip");
+static_assert(s_board.button_pin < SOC_GPIO_PIN_COUNT, "Button pin not on this chip");
+static_assert(s_board.occupancy_pin < SOC_GPIO_PIN_COUNT, "Occupancy pin not on this chip");
+
+// menuconfig overrides for the selected profile
+static constexpr s21_transport_t board_transport()
+{
+#if CONFIG_S21_TRANSPORT_UART
+    return S21_TRANSPORT_UART;
+#elif CONFIG_S21_TRANSPORT_BITBANG
+    return S21_TRANSPORT_BITBANG;
+#elif CONFIG_S21_TRANSPORT_SIM
+    return S21_TRANSPORT_SIM;
+#else
+    return s_board.transport;
+#endif
+}
+
+static constexpr uint32_t board_poll_interval_ms()
+{
+    return CONFIG_S21_POLL_INTERVAL_MS > 0 ? CONFIG_S21_POLL_INTERVAL_MS : s_board.poll_interval_ms;
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Build every target/board combination and report flash and RAM use.
+
+Run from Thermostat_Daikin/ with ESP-IDF and esp-matter exported:
+
+    tools/build_matrix.py                      # all combinations below
+    tools/build_matrix.py --target esp32c6     # one target, every board it supports
+
+Each combination builds in build-matrix/<target>-<board>/ with its own sdkconfig.
+sdkconfig.defaults and sdkconfig.defaults.<target> apply as in a normal build, and
+the board is selected with an extra defaults file written next to the build.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+# Board profiles from main/Kconfig.projbuild and the targets each one builds for
+BOARDS = {
+    "daikin-c6-pcb": ("CONFIG_S21_BOARD_DAIKIN_C6_PCB", ["esp32c6"]),
+    "devkit": ("CONFIG_S21_BOARD_DEVKIT", ["esp32c2", "esp32c6", "esp32h2"]),
+}
+
+BUILD_ROOT = "build-matrix"
+
+
+def run(cmd, log_path):
+    with open(log_path, "w") as log:
+        return subprocess.call(cmd, stdout=log, stderr=subprocess.STDOUT)
+
+
+def size_summary(build_dir):
+    out = subprocess.check_output(["idf.py", "-B", build_dir, "size", "--format", "json"],
+                                  stderr=subprocess.DEVNULL)
+    # idf.py prints its own progress lines before the JSON object
+    text = out.decode()
+    data = json.loads(text[text.index("{"):])
+    flash = data.get("total_size", data.get("flash_total", 0))
+    dram = data.get("used_dram", data.get("dram_total_used", 0))
+    dram_total = dram + data.get("available_dram", data.get("dram_remain", 0))
+    return flash, dram, dram_total
+
+
+def build(target, board, config):
+    name = "%s-%s" % (target, board)
+    build_dir = os.path.join(BUILD_ROOT, name)
+    os.makedirs(build_dir, exist_ok=True)
+    board_defaults = os.path.join(build_dir, "sdkconfig.board")
+    with open(board_defaults, "w") as f:
+        f.write("%s=y\n" % config)
+    defaults = ";".join(["sdkconfig.defaults", "sdkconfig.defaults.%s" % target, board_defaults])
+    cmd = ["idf.py", "-B", build_dir,
+           "-D", "IDF_TARGET=%s" % target,
+           "-D", "SDKCONFIG=%s" % os.path.join(build_dir, "sdkconfig"),
+           "-D", "SDKCONFIG_DEFAULTS=%s" % defaults,
+           "build"]
+    log_path = os.path.join(build_dir, "build.log")
+    if run(cmd, log_path) != 0:
+        return name, None, log_path
+    return name, size_summary(build_dir), log_path
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--target", help="only build this IDF target")
+    parser.add_argument("--board", choices=sorted(BOARDS), help="only build this board profile")
+    args = parser.parse_args()
+
+    results = []
+    for board, (config, targets) in sorted(BOARDS.items()):
+        if args.board and board != args.board:
+            continue
+        for target in targets:
+            if args.target and target != args.target:
+                continue
+            print("Building %s for %s..." % (board, target), flush=True)
+            results.append(build(target, board, config))
+
+    print()
+    print("%-24s %10s %10s %10s" % ("build", "flash", "dram", "dram free"))
+    failed = False
+    for name, size, log_path in results:
+        if size is None:
+            print("%-24s FAILED, see %s" % (name, log_path))
+            failed = True
+            continue
+        flash, dram, dram_total = size
+        print("%-24s %10d %10d %10d" % (name, flash, dram, dram_total - dram))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
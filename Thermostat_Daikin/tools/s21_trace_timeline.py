@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Turn an S21 command trace dump into a timeline.
+
+Capture the output of "matter esp s21trace dump" from the device console (a full
+monitor log is fine; only lines starting with S21T are read) and run:
+
+    tools/s21_trace_timeline.py capture.log
+
+Each command is printed with the time spent between consecutive stages, then a
+summary of each stage-to-stage gap over all completed commands.
+"""
+
+import argparse
+import re
+import sys
+
+STAGES = ["pre", "enq", "deq", "tx", "ack", "g1"]
+LABELS = {
+    ("pre", "enq"): "matter write",
+    ("enq", "deq"): "queued",
+    ("deq", "tx"): "bus gap",
+    ("tx", "ack"): "on the wire",
+    ("ack", "g1"): "until status read",
+}
+BAR_WIDTH = 60
+
+LINE_RE = re.compile(r"S21T (id=\d+.*)$")
+
+
+def parse(lines):
+    spans = []
+    for line in lines:
+        m = LINE_RE.search(line.rstrip())
+        if not m:
+            continue
+        fields = dict(kv.split("=", 1) for kv in m.group(1).split())
+        span = {
+            "id": int(fields["id"]),
+            "tag": fields["tag"],
+            "t0": int(fields["t0"]),
+            "res": fields["res"],
+            "stages": {},
+        }
+        for stage in STAGES:
+            value = fields.get(stage, "-")
+            if value != "-":
+                span["stages"][stage] = int(value)
+        spans.append(span)
+    return spans
+
+
+def describe_result(res):
+    if res == "open":
+        return "in progress"
+    if res == "0x0":
+        return "ok"
+    return "failed " + res
+
+
+def print_timeline(span, scale_us):
+    stages = span["stages"]
+    print("#%d tag %s: %s" % (span["id"], span["tag"], describe_result(span["res"])))
+    reached = [s for s in STAGES if s in stages]
+    for prev, cur in zip(reached, reached[1:]):
+        start, end = stages[prev], stages[cur]
+        offset = int(start / scale_us * BAR_WIDTH)
+        length = max(1, int((end - start) / scale_us * BAR_WIDTH))
+        label = LABELS.get((prev, cur), "%s-%s" % (prev, cur))
+        print("  %-18s %8.1f ms |%s%s" % (label, (end - start) / 1000.0, " " * offset, "#" * length))
+    if reached:
+        print("  %-18s %8.1f ms" % ("total", stages[reached[-1]] / 1000.0))
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    index = min(len(values) - 1, int(round(pct / 100.0 * (len(values) - 1))))
+    return values[index]
+
+
+def print_summary(spans):
+    print("Stage gaps over %d spans (ms): p50 / p99 / max" % len(spans))
+    for prev, cur in zip(STAGES, STAGES[1:]):
+        gaps = [s["stages"][cur] - s["stages"][prev] for s in spans
+                if prev in s["stages"] and cur in s["stages"]]
+        if not gaps:
+            continue
+        print("  %-18s %8.1f %8.1f %8.1f" % (LABELS[(prev, cur)], percentile(gaps, 50) / 1000.0,
+                                             percentile(gaps, 99) / 1000.0, max(gaps) / 1000.0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="captured console output (default: stdin)")
+    args = parser.parse_args()
+
+    with (open(args.log) if args.log else sys.stdin) as f:
+        spans = parse(f)
+    if not spans:
+        print("no S21T lines found", file=sys.stderr)
+        return 1
+
+    scale_us = max(max(s["stages"].values()) for s in spans) or 1
+    for span in spans:
+        print_timeline(span, scale_us)
+    print_summary(spans)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())